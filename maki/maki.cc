@@ -4,28 +4,84 @@
 
 #include "sushi.h"
 
+/* options */
+
+static std::string trace_file;
+static bool print_stats = false;
+static bool update = false;
+
+static void print_usage(char **argv)
+{
+	fprintf(stderr, "usage: %s [options] <project.sushi> (xcode|xcworkspace|vs|ninja)\n", argv[0]);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  --trace=<file.json>   write phase timings in Chrome trace event format\n");
+	fprintf(stderr, "  --stats               print allocations and peak RSS for each phase\n");
+	fprintf(stderr, "  --update              merge into the existing Xcode project keeping its ids,\n");
+	fprintf(stderr, "                        or keep the project guids of the existing solution\n");
+	exit(1);
+}
+
+static std::vector<std::string> parse_options(int argc, char **argv)
+{
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--trace=", 8) == 0) {
+			trace_file = argv[i] + 8;
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			print_stats = true;
+		} else if (strcmp(argv[i], "--update") == 0) {
+			update = true;
+		} else if (strncmp(argv[i], "--", 2) == 0) {
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			print_usage(argv);
+		} else {
+			args.push_back(argv[i]);
+		}
+	}
+	if (args.size() != 2) {
+		print_usage(argv);
+	}
+	return args;
+}
+
 /* main */
 
 int main(int argc, char **argv)
 {
-	if (argc != 3) {
-		fprintf(stderr, "usage: %s <project.sushi> (xcode|vs)\n", argv[0]);
-		exit(1);
+	std::vector<std::string> args = parse_options(argc, argv);
+
+	if (trace_file.size() > 0) {
+		trace::enable();
+	}
+	if (print_stats) {
+		stats::enable();
 	}
 
 	project proj;
-	proj.read(argv[1]);
+	proj.read(args[0]);
 
-	if (strcmp(argv[2], "xcode") == 0) {
-		XcodeprojPtr xcodeproj = Xcodeproj::createProject(proj.root);
+	if (args[1] == "xcode") {
+		XcodeprojPtr xcodeproj = update ? Xcodeproj::updateProject(proj.root) :
+			Xcodeproj::createProject(proj.root);
 		xcodeproj->write(proj.root);
-	} else if (strcmp(argv[2], "vs") == 0) {
-		VSSolutionPtr solution = VSSolution::createSolution(proj.root);
+	} else if (args[1] == "xcworkspace") {
+		XcworkspacePtr workspace = Xcworkspace::createWorkspace(proj.root);
+		workspace->write(proj.root);
+	} else if (args[1] == "vs") {
+		VSSolutionPtr solution = update ? VSSolution::updateSolution(proj.root) :
+			VSSolution::createSolution(proj.root);
 		solution->write(proj.root);
-	} else if (strcmp(argv[2], "ninja") == 0) {
+	} else if (args[1] == "ninja") {
 		NinjaPtr ninja = Ninja::createBuild(proj.root);
 		ninja->write(proj.root);
 	} else {
-		fprintf(stderr, "unknown project format: %s\n", argv[2]);
+		fprintf(stderr, "unknown project format: %s\n", args[1].c_str());
+	}
+
+	if (trace_file.size() > 0) {
+		trace::write(trace_file);
+	}
+	if (print_stats) {
+		stats::print(std::cerr, args[1]);
 	}
 }
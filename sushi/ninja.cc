@@ -20,11 +20,12 @@
 #include <map>
 #include <set>
 
-#include "tinyxml2.h"
 
 #include "sushi.h"
 
 #include "util.h"
+#include "stats.h"
+#include "trace.h"
 #include "project_parser.h"
 #include "project.h"
 #include "ninja.h"
@@ -55,19 +56,35 @@ static std::vector<std::string> lib_deps(project_root_ptr root, std::vector<std:
 	return lib_deps;
 }
 
+/*
+ * The top level build file holds the tools and rules, and includes one
+ * build file per configuration with subninja. Each configuration builds
+ * into $builddir/<config>/ with flags from its defines and variables,
+ * and has a <config>/all target. The edges of each target are written
+ * once to ninja/targets/<target>.ninja, which every configuration includes
+ * so that its $configdir and $cflags apply in the scope of the inclusion.
+ */
 NinjaPtr Ninja::createBuild(project_root_ptr root)
 {
+	trace_scope trace("materialize", "ninja");
+
 	// construct empty solution
 	auto config = root->get_config("*");
 	NinjaPtr ninja = std::make_shared<Ninja>();
 	ninja->createEmptyBuild(root, config->vars);
 
-	// create library targets
+	std::vector<std::string> config_list = root->get_config_list();
+	if (config_list.size() == 0) {
+		config_list.push_back("Default");
+	}
+
+	// create library targets followed by tool targets, once for all configurations
+	std::vector<std::pair<std::string,NinjaPtr>> targets;
 	for (auto lib_name : root->get_lib_list()) {
 		auto lib = root->get_lib(lib_name);
-		ninja->createTarget(
+		NinjaPtr target_ninja = std::make_shared<Ninja>();
+		target_ninja->createTarget(
 			root,
-			config->vars,
 			lib->lib_name,
 			lib->lib_type == "static" ? "StaticLibrary" : "DynamicLibrary",
 			lib->libs,
@@ -76,14 +93,13 @@ NinjaPtr Ninja::createBuild(project_root_ptr root)
 			std::vector<std::string>(),
 			util::globre_list(lib->source)
 		);
+		targets.push_back(std::pair<std::string,NinjaPtr>("ninja/targets/" + lib->lib_name + ".ninja", target_ninja));
 	}
-
-	// create tool targets
 	for (auto tool_name : root->get_tool_list()) {
 		auto tool = root->get_tool(tool_name);
-		ninja->createTarget(
+		NinjaPtr target_ninja = std::make_shared<Ninja>();
+		target_ninja->createTarget(
 			root,
-			config->vars,
 			tool->tool_name,
 			"Application",
 			tool->libs,
@@ -92,11 +108,38 @@ NinjaPtr Ninja::createBuild(project_root_ptr root)
 			lib_deps(root, root->get_libs(tool)),
 			util::globre_list(tool->source)
 		);
+		targets.push_back(std::pair<std::string,NinjaPtr>("ninja/targets/" + tool->tool_name + ".ninja", target_ninja));
+	}
+	ninja->fileList.insert(ninja->fileList.end(), targets.begin(), targets.end());
+
+	// create configurations that build every target with their own flags
+	std::vector<std::string> config_all;
+	for (auto config_name : config_list) {
+		NinjaPtr config_ninja = std::make_shared<Ninja>();
+		config_ninja->createConfigBuild(root, config_name);
+		for (auto &target : targets) {
+			config_ninja->addTarget(target.first, target.second);
+		}
+		std::string all_target = config_name + "/all";
+		config_ninja->ninjaBuildList.push_back(std::make_shared<NinjaBuild>(all_target, "phony",
+			util::join(config_ninja->outputList, " ")));
+		config_all.push_back(all_target);
+		std::string config_file = "ninja/" + config_name + ".ninja";
+		ninja->subninjaList.push_back(config_file);
+		ninja->fileList.push_back(std::pair<std::string,NinjaPtr>(config_file, config_ninja));
 	}
+	ninja->ninjaBuildList.push_back(std::make_shared<NinjaBuild>("all", "phony", util::join(config_all, " ")));
 
 	return ninja;
 }
 
+/* value of a build speed variable, or empty if it is not set */
+static std::string build_var(std::map<std::string,std::string> &vars, std::string name)
+{
+	auto var_i = vars.find(name);
+	return var_i != vars.end() ? var_i->second : std::string();
+}
+
 void Ninja::createEmptyBuild(project_root_ptr root, std::map<std::string,std::string> vars)
 {
 	// TODO - add detection: currently hard coded to MSC and GCC
@@ -110,24 +153,9 @@ void Ninja::createEmptyBuild(project_root_ptr root, std::map<std::string,std::st
 	NinjaVarPtr ar_var = std::make_shared<NinjaVar>("ar", "link");
 	NinjaVarPtr cc_var = std::make_shared<NinjaVar>("cc", "cl");
 	NinjaVarPtr cxx_var = std::make_shared<NinjaVar>("cxx", "cl");	
-	NinjaVarPtr cflags_var = std::make_shared<NinjaVar>("cflags",
-		"/nologo "  /* Supress banner */
-		"/Zi "      /* Enable Debug Information */
-		"/FS "      /* Write to program database */
-		"/Ox "      /* Maximum optimization */
-		"/GL "      /* Whole program optimization */
-		"/MT "      /* link with LIBCMT.LIB */
-		"/DNDEBUG"  /* Define NDEBUG */
-	);
 	NinjaVarPtr cxxflags_var = std::make_shared<NinjaVar>("cxxflags",
 		"/EHsc"     /* Enable C++ exception */
 	);
-	NinjaVarPtr ldflags_var = std::make_shared<NinjaVar>("ldflags",
-		"/DEBUG "   /* Creates debugging information */
-		"/OPT:REF " /* Eliminate unreferenced code and data */
-		"/OPT:ICF " /* Perform identical COMDAT folding */
-		"/LTCG"     /* Enable Link Time Code Generation */
-	);
 	NinjaRulePtr cc_rule = std::make_shared<NinjaRule>("cc", "$cxx $cflags -c $in /Fo$out", "CC $out");
 	cc_rule->properties["deps"] = "msvc";
 	NinjaRulePtr cxx_rule = std::make_shared<NinjaRule>("cxx", "$cxx $cflags $cxxflags -c $in /Fo$out", "CXX $out");
@@ -141,9 +169,7 @@ void Ninja::createEmptyBuild(project_root_ptr root, std::map<std::string,std::st
 	NinjaVarPtr ar_var = std::make_shared<NinjaVar>("ar", "ar");
 	NinjaVarPtr cc_var = std::make_shared<NinjaVar>("cc", "gcc");
 	NinjaVarPtr cxx_var = std::make_shared<NinjaVar>("cxx", "g++");	
-	NinjaVarPtr cflags_var = std::make_shared<NinjaVar>("cflags", "-Wall -Wpedantic");
 	NinjaVarPtr cxxflags_var = std::make_shared<NinjaVar>("cxxflags", "-std=c++11");
-	NinjaVarPtr ldflags_var = std::make_shared<NinjaVar>("ldflags", "-L$builddir");
 	NinjaRulePtr cc_rule = std::make_shared<NinjaRule>("cc", "$cc -MMD -MT $out -MF $out.d $cflags -c $in -o $out", "CC $out");
 	cc_rule->properties["depfile"] = "$out.d";
 	cc_rule->properties["deps"] = "gcc";
@@ -162,15 +188,88 @@ void Ninja::createEmptyBuild(project_root_ptr root, std::map<std::string,std::st
 	ninjaVarList.push_back(ar_var);
 	ninjaVarList.push_back(cc_var);
 	ninjaVarList.push_back(cxx_var);
-	ninjaVarList.push_back(cflags_var);
 	ninjaVarList.push_back(cxxflags_var);
-	ninjaVarList.push_back(ldflags_var);
 	ninjaRuleList.push_back(cc_rule);
 	ninjaRuleList.push_back(cxx_rule);
 	ninjaRuleList.push_back(ar_rule);
 	ninjaRuleList.push_back(link_rule);
 }
 
+/*
+ * Configuration flags come from the defines and optimization level of the
+ * configuration, and the build speed variables map to GCC flags where they
+ * are set: debug_info (none, embedded or separate), lto (none, thin or
+ * full) and dead_strip. The MSC flags always include debug information,
+ * and whole program optimization and reference elimination when optimizing
+ * for speed.
+ */
+void Ninja::createConfigBuild(project_root_ptr root, std::string config_name)
+{
+	auto config = root->get_config(config_name);
+	std::string optimizationLevel = build_var(config->vars, "optimization");
+#if defined (_WIN32)
+	std::string cflags =
+		"/nologo "  /* Supress banner */
+		"/Zi "      /* Enable Debug Information */
+		"/FS "      /* Write to program database */
+		"/MT";      /* link with LIBCMT.LIB */
+	std::string ldflags =
+		"/DEBUG";   /* Creates debugging information */
+	if (optimizationLevel == "0") {
+		cflags += " /Od";     /* Disable optimization */
+	} else if (optimizationLevel == "1" || optimizationLevel == "2") {
+		cflags += " /O" + optimizationLevel;
+	} else {
+		cflags += " /Ox";     /* Maximum optimization */
+		cflags += " /GL";     /* Whole program optimization */
+		ldflags += " /OPT:REF"; /* Eliminate unreferenced code and data */
+		ldflags += " /OPT:ICF"; /* Perform identical COMDAT folding */
+		ldflags += " /LTCG";    /* Enable Link Time Code Generation */
+	}
+	for (auto define : config->defines) {
+		cflags += " /D" + define;
+	}
+#else
+	std::string cflags = "-Wall -Wpedantic";
+	std::string ldflags = "-L$builddir";
+	if (optimizationLevel.size() > 0) {
+		cflags += " -O" + optimizationLevel;
+	}
+	for (auto define : config->defines) {
+		cflags += " -D" + define;
+	}
+	std::string debugInfo = build_var(config->vars, "debug_info");
+	std::string lto = build_var(config->vars, "lto");
+	if (debugInfo == "embedded") {
+		cflags += " -g";
+	} else if (debugInfo == "separate") {
+		cflags += " -g -gsplit-dwarf";
+	}
+	if (lto == "thin" || lto == "full") {
+		cflags += " -flto";
+		ldflags += " -flto";
+	}
+	if (build_var(config->vars, "dead_strip") == "yes") {
+		cflags += " -ffunction-sections -fdata-sections";
+#if defined (__APPLE__)
+		ldflags += " -Wl,-dead_strip";
+#else
+		ldflags += " -Wl,--gc-sections";
+#endif
+	}
+#endif
+	ninjaVarList.push_back(std::make_shared<NinjaVar>("configdir", "$builddir/" + config_name));
+	ninjaVarList.push_back(std::make_shared<NinjaVar>("cflags", cflags));
+	ninjaVarList.push_back(std::make_shared<NinjaVar>("ldflags", ldflags));
+}
+
+/* includes the build file of a target and adds its outputs to the configuration */
+void Ninja::addTarget(std::string target_file, NinjaPtr target_ninja)
+{
+	subninjaList.push_back(target_file);
+	outputList.insert(outputList.end(), target_ninja->outputList.begin(), target_ninja->outputList.end());
+}
+
 static std::pair<std::string,std::string> file_ext(std::string filename)
 {
 	size_t offset = filename.find_last_of(".");
@@ -181,7 +280,7 @@ static std::pair<std::string,std::string> file_ext(std::string filename)
 	}
 }
 
-void Ninja::createTarget(project_root_ptr root, std::map<std::string,std::string> vars,
+void Ninja::createTarget(project_root_ptr root,
 		std::string target_name, std::string target_type,
 		std::vector<std::string> depends,
 		std::vector<std::string> defines,
@@ -189,47 +288,50 @@ void Ninja::createTarget(project_root_ptr root, std::map<std::string,std::string
 		std::vector<std::string> lib_files,
 		std::vector<std::string> source)
 {
+	trace_scope trace("materialize", target_name);
+
 	std::string additionalIncludes;
 	for (auto dependency : depends) {
 		// NOTE - this works because the sushi convention is that the library
 		//        directory name is the same as the library name
 		// TODO - use export_includes
-		if (additionalIncludes.size() > 0) additionalIncludes.append(";");
+		if (additionalIncludes.size() > 0) additionalIncludes.append(" ");
 		additionalIncludes.append(format_string("-I%s", dependency.c_str()));
 	}
 
+	// target flags are bound in the scope of the target build file
+	if (additionalIncludes.size() > 0) {
+		ninjaVarList.push_back(std::make_shared<NinjaVar>("cflags", "$cflags " + additionalIncludes));
+	}
+
 	std::vector<std::string> objectFiles;
 	for (auto sourceFile : source) {
 		auto nameExt = file_ext(sourceFile);
 		if (nameExt.second == "c") {			
-			std::string outputFile = "$builddir/$arch/obj/" + nameExt.first + "$obj";
+			std::string outputFile = "$configdir/$arch/obj/" + nameExt.first + "$obj";
 			NinjaBuildPtr buildFile = std::make_shared<NinjaBuild>(outputFile, "cc", sourceFile);
-			if (additionalIncludes.size() > 0) {
-				buildFile->properties["cflags"] = "$cflags " + additionalIncludes;
-			}
 			ninjaBuildList.push_back(buildFile);
 			objectFiles.push_back(outputFile);
 		} else if (nameExt.second == "cc" || nameExt.second == "cpp") {
-			std::string outputFile = "$builddir/$arch/obj/" + nameExt.first + "$obj";
+			std::string outputFile = "$configdir/$arch/obj/" + nameExt.first + "$obj";
 			NinjaBuildPtr buildFile = std::make_shared<NinjaBuild>(outputFile, "cxx", sourceFile);
-			if (additionalIncludes.size() > 0) {
-				buildFile->properties["cflags"] = "$cflags " + additionalIncludes;
-			}
 			ninjaBuildList.push_back(buildFile);
 			objectFiles.push_back(outputFile);
 		}
 	}
 	if (target_type == "Application") {
 		for (std::string lib_file : lib_files) {
-			objectFiles.push_back(std::string("$builddir/$arch/lib/") + lib_file);
+			objectFiles.push_back(std::string("$configdir/$arch/lib/") + lib_file);
 		}
-		std::string outputFile = "$builddir/$arch/bin/" + target_name + "$exe";
+		std::string outputFile = "$configdir/$arch/bin/" + target_name + "$exe";
 		NinjaBuildPtr buildFile = std::make_shared<NinjaBuild>(outputFile, "link", util::join(objectFiles, " "));
 		ninjaBuildList.push_back(buildFile);
+		outputList.push_back(outputFile);
 	} else if (target_type == "StaticLibrary") {
-		std::string outputFile = std::string("$builddir/$arch/lib/") + std::string("lib") + target_name + "$lib";
+		std::string outputFile = std::string("$configdir/$arch/lib/") + std::string("lib") + target_name + "$lib";
 		NinjaBuildPtr buildFile = std::make_shared<NinjaBuild>(outputFile, "ar", util::join(objectFiles, " "));
 		ninjaBuildList.push_back(buildFile);
+		outputList.push_back(outputFile);
 	} else if (target_type == "DynamicLibrary") {
 		// TODO
 	}
@@ -242,11 +344,25 @@ void Ninja::write(project_root_ptr root)
 
 void Ninja::write(std::string build_file)
 {
-	std::ofstream out(build_file.c_str());
+	write(build_file, build_file);
+}
+
+/*
+ * Subninja paths are relative to the directory of the top level build
+ * file. Files are only rewritten when their contents change, so ninja
+ * only sees new timestamps on the fragments of targets that changed.
+ */
+void Ninja::write(std::string build_file, std::string root_file)
+{
+	trace_scope trace("write", build_file);
+
+	std::stringstream out;
 	for (auto var : ninjaVarList) {
 		out << var->name << " = " << var->value << '\n';
 	}
-	out << '\n';
+	if (ninjaVarList.size() > 0) {
+		out << '\n';
+	}
 	for (auto rule : ninjaRuleList) {
 		out << "rule " << rule->name << '\n';
 		for (auto ent : rule->properties) {
@@ -254,6 +370,12 @@ void Ninja::write(std::string build_file)
 		}
 		out << '\n';
 	}
+	for (auto subninja : subninjaList) {
+		out << "subninja " << subninja << '\n';
+	}
+	if (subninjaList.size() > 0) {
+		out << '\n';
+	}
 	for (auto build : ninjaBuildList) {
 		out << "build " << build->output << ": " << build->rule << " " << build->input << "\n";
 		if (build->properties.size() > 0) {
@@ -263,4 +385,11 @@ void Ninja::write(std::string build_file)
 		}
 		out << '\n';
 	}
-}
\ No newline at end of file
+	util::write_file_if_changed(build_file, out.str());
+
+	for (auto file : fileList) {
+		std::string sub_file = util::path_relative_to_path(file.first, root_file);
+		util::make_directories(sub_file);
+		file.second->write(sub_file, root_file);
+	}
+}
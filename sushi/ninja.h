@@ -46,10 +46,21 @@ struct Ninja
 	std::vector<NinjaRulePtr> ninjaRuleList;
 	std::vector<NinjaBuildPtr> ninjaBuildList;
 
+	/* build files included with subninja, relative to the top level build file */
+	std::vector<std::string> subninjaList;
+
+	/* configuration and target build files written with this one, by path */
+	std::vector<std::pair<std::string,NinjaPtr>> fileList;
+
+	/* linked and archived outputs, for the configuration all target */
+	std::vector<std::string> outputList;
+
 	static NinjaPtr createBuild(project_root_ptr root);
 
 	void createEmptyBuild(project_root_ptr root, std::map<std::string,std::string> vars);
-	void createTarget(project_root_ptr root, std::map<std::string,std::string> vars,
+	void createConfigBuild(project_root_ptr root, std::string config_name);
+	void addTarget(std::string target_file, NinjaPtr target_ninja);
+	void createTarget(project_root_ptr root,
 		std::string target_name, std::string target_type,
 		std::vector<std::string> depends,
 		std::vector<std::string> defines,
@@ -59,6 +70,7 @@ struct Ninja
 
 	void write(project_root_ptr root);
 	void write(std::string build_file);
+	void write(std::string build_file, std::string root_file);
 };
 
 #endif
\ No newline at end of file
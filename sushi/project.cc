@@ -17,6 +17,8 @@
 #include "sushi.h"
 
 #include "util.h"
+#include "stats.h"
+#include "trace.h"
 #include "project_parser.h"
 #include "project.h"
 
@@ -156,6 +158,7 @@ project::project() { init(); }
 
 void project::read(std::string project_file)
 {
+	trace_scope trace("parse", project_file);
 	std::vector<char> buf = util::read_file(project_file);
 	if (!parse(buf.data(), buf.size())) {
 		log_fatal_exit("project: parse error");
@@ -310,6 +313,7 @@ static void merge_target(project_target_ptr merged_target, project_target_ptr ta
 
 project_config_ptr project_root::get_config(std::string name, bool inherit)
 {
+	trace_scope trace("resolve", name);
 	project_config_ptr merged_config = std::make_shared<project_config>();
 	merged_config->config_name = name;
 	if (inherit) {
@@ -327,6 +331,7 @@ project_config_ptr project_root::get_config(std::string name, bool inherit)
 
 project_lib_ptr project_root::get_lib(std::string name, bool inherit)
 {
+	trace_scope trace("resolve", name);
 	project_lib_ptr merged_lib = std::make_shared<project_lib>();
 	merged_lib->lib_name = name;
 	if (inherit) {
@@ -346,6 +351,7 @@ project_lib_ptr project_root::get_lib(std::string name, bool inherit)
 
 project_tool_ptr project_root::get_tool(std::string name, bool inherit)
 {
+	trace_scope trace("resolve", name);
 	project_tool_ptr merged_tool = std::make_shared<project_tool>();
 	merged_tool->tool_name = name;
 	if (inherit) {
@@ -379,6 +385,7 @@ void project_root::resolve_target_libs(std::vector<std::string> &stack,
 
 std::vector<std::string> project_root::get_libs(project_target_ptr target)
 {
+	trace_scope trace("resolve", target->target_name());
 	std::vector<std::string> stack, libs;
 	resolve_target_libs(stack, libs, target);
 	return libs;
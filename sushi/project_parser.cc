@@ -118,7 +118,7 @@ bool project_parser::parse(const char *buffer, size_t len)
 	
 	const char *mark = NULL;
 	const char *p = buffer;
-	const char *pe = buffer + strlen(buffer);
+	const char *pe = buffer + len;
 	const char *eof = pe;
 
 	
@@ -0,0 +1,192 @@
+//
+//  stats.cc
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#include "sushi.h"
+
+#include "util.h"
+#include "stats.h"
+
+
+/* stats */
+
+bool stats::enabled = false;
+std::atomic<uint64_t> stats::allocs(0);
+std::atomic<uint64_t> stats::frees(0);
+std::atomic<uint64_t> stats::bytes(0);
+std::mutex stats::lock;
+stats_phase_list stats::phases;
+
+static thread_local uint64_t thread_allocs;
+static thread_local uint64_t thread_frees;
+static thread_local uint64_t thread_bytes;
+
+void stats::enable()
+{
+	enabled = true;
+}
+
+void stats::reset()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	allocs = 0;
+	frees = 0;
+	bytes = 0;
+	phases.clear();
+}
+
+stats_counters stats::counters()
+{
+	return stats_counters(allocs, frees, bytes);
+}
+
+stats_counters stats::thread_counters()
+{
+	return stats_counters(thread_allocs, thread_frees, thread_bytes);
+}
+
+size_t stats::peak_rss()
+{
+#if defined (_WIN32)
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+		return pmc.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) < 0) {
+		return 0;
+	}
+#if defined (__APPLE__)
+	return (size_t)usage.ru_maxrss;
+#else
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+void stats::record(const char *phase, stats_counters counters, uint64_t dur, size_t rss_growth)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	auto pi = std::find_if(phases.begin(), phases.end(),
+		[&](const stats_phase &p) { return p.name == phase; });
+	if (pi == phases.end()) {
+		phases.push_back(stats_phase(phase));
+		pi = phases.end() - 1;
+	}
+	pi->count++;
+	pi->dur += dur;
+	pi->counters.allocs += counters.allocs;
+	pi->counters.frees += counters.frees;
+	pi->counters.bytes += counters.bytes;
+	pi->rss_growth += rss_growth;
+}
+
+void stats::print(std::ostream &out, std::string backend)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	stats_counters total = counters();
+	out << "backend: " << backend << '\n';
+	out << std::left << std::setw(14) << "phase"
+		<< std::right << std::setw(8) << "spans"
+		<< std::setw(12) << "time(ms)"
+		<< std::setw(12) << "allocs"
+		<< std::setw(12) << "frees"
+		<< std::setw(14) << "bytes"
+		<< std::setw(14) << "rss grow(KB)" << '\n';
+	for (const stats_phase &phase : phases) {
+		out << std::left << std::setw(14) << phase.name
+			<< std::right << std::setw(8) << phase.count
+			<< std::setw(12) << std::fixed << std::setprecision(3) << phase.dur / 1000.0
+			<< std::setw(12) << phase.counters.allocs
+			<< std::setw(12) << phase.counters.frees
+			<< std::setw(14) << phase.counters.bytes
+			<< std::setw(14) << phase.rss_growth / 1024 << '\n';
+	}
+	out << std::left << std::setw(14) << "total"
+		<< std::right << std::setw(8) << ""
+		<< std::setw(12) << ""
+		<< std::setw(12) << total.allocs
+		<< std::setw(12) << total.frees
+		<< std::setw(14) << total.bytes << '\n';
+	out << "peak rss: " << peak_rss() / 1024 << " KB\n";
+}
+
+
+/* counting allocator */
+
+/*
+ * Replacing operator new inside a DLL only affects the DLL itself,
+ * so the counting allocator is only installed in static builds.
+ */
+
+#if !defined (_WINDLL)
+
+static void* stats_alloc(size_t size)
+{
+	void *ptr = malloc(size > 0 ? size : 1);
+	if (!ptr) throw std::bad_alloc();
+	if (stats::enabled) {
+		stats::allocs.fetch_add(1, std::memory_order_relaxed);
+		stats::bytes.fetch_add(size, std::memory_order_relaxed);
+		thread_allocs++;
+		thread_bytes += size;
+	}
+	return ptr;
+}
+
+static void* stats_alloc_nothrow(size_t size) noexcept
+{
+	void *ptr = malloc(size > 0 ? size : 1);
+	if (ptr && stats::enabled) {
+		stats::allocs.fetch_add(1, std::memory_order_relaxed);
+		stats::bytes.fetch_add(size, std::memory_order_relaxed);
+		thread_allocs++;
+		thread_bytes += size;
+	}
+	return ptr;
+}
+
+static void stats_free(void *ptr) noexcept
+{
+	if (!ptr) return;
+	if (stats::enabled) {
+		stats::frees.fetch_add(1, std::memory_order_relaxed);
+		thread_frees++;
+	}
+	free(ptr);
+}
+
+void* operator new(size_t size) { return stats_alloc(size); }
+void* operator new[](size_t size) { return stats_alloc(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return stats_alloc_nothrow(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return stats_alloc_nothrow(size); }
+void operator delete(void *ptr) noexcept { stats_free(ptr); }
+void operator delete[](void *ptr) noexcept { stats_free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t&) noexcept { stats_free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept { stats_free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { stats_free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { stats_free(ptr); }
+
+#endif
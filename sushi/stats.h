@@ -0,0 +1,65 @@
+//
+//  stats.h
+//
+
+#ifndef stats_h
+#define stats_h
+
+
+/* stats */
+
+struct stats_counters;
+struct stats_phase;
+typedef std::vector<stats_phase> stats_phase_list;
+
+struct SUSHI_LIB stats_counters
+{
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t bytes;
+
+	stats_counters() : allocs(0), frees(0), bytes(0) {}
+	stats_counters(uint64_t allocs, uint64_t frees, uint64_t bytes)
+		: allocs(allocs), frees(frees), bytes(bytes) {}
+};
+
+struct SUSHI_LIB stats_phase
+{
+	std::string name;
+	uint64_t count;
+	uint64_t dur;
+	stats_counters counters;
+	size_t rss_growth;
+
+	stats_phase(std::string name) : name(name), count(0), dur(0), rss_growth(0) {}
+};
+
+/*
+ * stats accumulates allocation counts and peak RSS growth for each phase
+ *
+ * libsushi replaces the global operator new and delete with counting
+ * versions that test stats::enabled, and keep process and per thread
+ * counts. Phases are the trace_scope categories. Each scope records what
+ * its own thread did less what its nested scopes recorded, so the phases
+ * are exclusive and add up to at most the process total.
+ */
+
+struct SUSHI_LIB stats
+{
+	static bool enabled;
+	static std::atomic<uint64_t> allocs;
+	static std::atomic<uint64_t> frees;
+	static std::atomic<uint64_t> bytes;
+	static std::mutex lock;
+	static stats_phase_list phases;
+
+	static void enable();
+	static void reset();
+	static stats_counters counters();
+	static stats_counters thread_counters();
+	static size_t peak_rss();
+	static void record(const char *phase, stats_counters counters, uint64_t dur, size_t rss_growth);
+	static void print(std::ostream &out, std::string backend);
+};
+
+#endif
@@ -28,11 +28,17 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <random>
 #include <functional>
+#include <chrono>
+#include <mutex>
+#include <atomic>
 
 #include "arch.h"
 #include "util.h"
+#include "stats.h"
+#include "trace.h"
 #include "project_parser.h"
 #include "project.h"
 #include "ninja.h"
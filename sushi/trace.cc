@@ -0,0 +1,151 @@
+//
+//  trace.cc
+//
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+#include "sushi.h"
+
+#include "util.h"
+#include "stats.h"
+#include "trace.h"
+
+
+/* trace */
+
+bool trace::enabled = false;
+std::mutex trace::lock;
+trace_event_list trace::events;
+
+static std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+void trace::enable()
+{
+	enabled = true;
+}
+
+uint64_t trace::now()
+{
+	auto elapsed = std::chrono::steady_clock::now() - trace_epoch;
+	return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+uint32_t trace::thread_id()
+{
+	static uint32_t next_thread_id = 1;
+	static thread_local uint32_t current_thread_id = 0;
+	if (current_thread_id == 0) {
+		std::lock_guard<std::mutex> guard(lock);
+		current_thread_id = next_thread_id++;
+	}
+	return current_thread_id;
+}
+
+void trace::record(const char *cat, const std::string &name, uint64_t ts, uint64_t dur)
+{
+	uint32_t tid = thread_id();
+	std::lock_guard<std::mutex> guard(lock);
+	events.push_back(trace_event(cat, name, ts, dur, tid));
+}
+
+
+/* trace_scope */
+
+/* innermost open scope on this thread, when stats are enabled */
+static thread_local trace_scope *trace_current_scope;
+
+void trace_scope::begin(const std::string &name)
+{
+	if (trace::enabled) {
+		this->name = name;
+	}
+	if (stats::enabled) {
+		parent = trace_current_scope;
+		trace_current_scope = this;
+		counters = stats::thread_counters();
+		rss = stats::peak_rss();
+	}
+	start = trace::now();
+}
+
+void trace_scope::end()
+{
+	uint64_t dur = trace::now() - start;
+	if (trace::enabled) {
+		trace::record(cat, name, start, dur);
+	}
+	if (stats::enabled) {
+		trace_current_scope = parent;
+		stats_counters end = stats::thread_counters();
+		stats_counters used(end.allocs - counters.allocs, end.frees - counters.frees,
+			end.bytes - counters.bytes);
+		size_t growth = stats::peak_rss() - rss;
+		if (parent) {
+			parent->child_counters.allocs += used.allocs;
+			parent->child_counters.frees += used.frees;
+			parent->child_counters.bytes += used.bytes;
+			parent->child_dur += dur;
+			parent->child_rss += growth;
+		}
+		stats::record(cat, stats_counters(used.allocs - child_counters.allocs,
+			used.frees - child_counters.frees, used.bytes - child_counters.bytes),
+			dur - child_dur, growth > child_rss ? growth - child_rss : 0);
+	}
+}
+
+
+/* trace JSON */
+
+static std::string json_escape(const std::string &str)
+{
+	std::stringstream ss;
+	for (char c : str) {
+		switch (c) {
+			case '"': ss << "\\\""; break;
+			case '\\': ss << "\\\\"; break;
+			case '\n': ss << "\\n"; break;
+			case '\r': ss << "\\r"; break;
+			case '\t': ss << "\\t"; break;
+			default:
+				if ((unsigned char)c < 0x20) {
+					ss << format_string("\\u%04x", c);
+				} else {
+					ss << c;
+				}
+		}
+	}
+	return ss.str();
+}
+
+void trace::write(std::string trace_file)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	std::ofstream out(trace_file.c_str());
+	if (!out) {
+		log_error("trace: error opening: %s: %s", trace_file.c_str(), strerror(errno));
+		return;
+	}
+	out << "{\"traceEvents\":[";
+	for (size_t i = 0; i < events.size(); i++) {
+		const trace_event &ev = events[i];
+		out << (i == 0 ? "\n" : ",\n");
+		out << "{\"name\":\"" << json_escape(ev.name) << "\""
+			<< ",\"cat\":\"" << json_escape(ev.cat) << "\""
+			<< ",\"ph\":\"X\""
+			<< ",\"ts\":" << ev.ts
+			<< ",\"dur\":" << ev.dur
+			<< ",\"pid\":1"
+			<< ",\"tid\":" << ev.tid << "}";
+	}
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
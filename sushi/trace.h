@@ -0,0 +1,80 @@
+//
+//  trace.h
+//
+
+#ifndef trace_h
+#define trace_h
+
+
+/* trace */
+
+struct trace_event;
+typedef std::vector<trace_event> trace_event_list;
+
+struct SUSHI_LIB trace_event
+{
+	std::string cat;
+	std::string name;
+	uint64_t ts;
+	uint64_t dur;
+	uint32_t tid;
+
+	trace_event(std::string cat, std::string name, uint64_t ts, uint64_t dur, uint32_t tid)
+		: cat(cat), name(name), ts(ts), dur(dur), tid(tid) {}
+};
+
+struct SUSHI_LIB trace
+{
+	static bool enabled;
+	static std::mutex lock;
+	static trace_event_list events;
+
+	static void enable();
+	static uint64_t now();
+	static uint32_t thread_id();
+	static void record(const char *cat, const std::string &name, uint64_t ts, uint64_t dur);
+	static void write(std::string trace_file);
+};
+
+/*
+ * trace_scope records a complete event spanning its lifetime
+ *
+ * The category is the generation phase (parse, glob, resolve, materialize,
+ * write) and the name is the target, expression or file being processed.
+ * When tracing and stats are disabled construction and destruction is a
+ * flag test. When stats are enabled the thread's allocation counters and
+ * the peak RSS are sampled at both ends of the scope, and the phase gets
+ * the difference less what the scopes nested in it on the same thread
+ * used.
+ */
+
+struct SUSHI_LIB trace_scope
+{
+	const char *cat;
+	std::string name;
+	uint64_t start;
+	stats_counters counters;
+	size_t rss;
+	trace_scope *parent;
+	stats_counters child_counters;
+	uint64_t child_dur;
+	size_t child_rss;
+	bool active;
+
+	trace_scope(const char *cat, const std::string &name) : cat(cat), start(0),
+		rss(0), parent(nullptr), child_dur(0), child_rss(0),
+		active(trace::enabled || stats::enabled)
+	{
+		if (active) begin(name);
+	}
+
+	~trace_scope()
+	{
+		if (active) end();
+	}
+
+	void begin(const std::string &name);
+	void end();
+};
+
+#endif
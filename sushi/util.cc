@@ -17,6 +17,8 @@
 #include <algorithm>
 #include <functional>
 #include <regex>
+#include <atomic>
+#include <thread>
 
 #include <sys/stat.h>
 
@@ -27,11 +29,16 @@
 #define mkdir(file,mode) _mkdir(file)
 #else
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #endif
 
 #include "sushi.h"
 
 #include "util.h"
+#include "stats.h"
+#include "trace.h"
 
 
 /* logging */
@@ -137,6 +144,114 @@ std::vector<char> util::read_file(std::string filename)
 	return buf;
 }
 
+void util::write_file(std::string filename, const std::string &data)
+{
+	FILE *file = fopen(filename.c_str(), "wb");
+	if (!file) {
+		log_fatal_exit("error fopen: %s: %s", filename.c_str(), strerror(errno));
+	}
+
+	/* unbuffered so the contents go out in a single write */
+	setvbuf(file, nullptr, _IONBF, 0);
+	size_t bytes_written = fwrite(data.data(), 1, data.size(), file);
+	if (bytes_written != data.size()) {
+		log_fatal_exit("error fwrite: %s: %s", filename.c_str(), strerror(errno));
+	}
+	fclose(file);
+}
+
+/* returns false and leaves the file untouched if it has the same contents */
+bool util::write_file_if_changed(std::string filename, const std::string &data)
+{
+	struct stat stat_buf;
+	if (stat(filename.c_str(), &stat_buf) == 0 && (size_t)stat_buf.st_size == data.size()) {
+		std::vector<char> buf = read_file(filename);
+		if (memcmp(buf.data(), data.data(), data.size()) == 0) {
+			return false;
+		}
+	}
+	write_file(filename, data);
+	return true;
+}
+
+bool util::file_exists(std::string filename)
+{
+	struct stat stat_buf;
+	return stat(filename.c_str(), &stat_buf) == 0;
+}
+
+#ifdef _WIN32
+
+mapped_file::mapped_file() : data(nullptr), size(0), file_handle(INVALID_HANDLE_VALUE), map_handle(NULL) {}
+
+mapped_file::~mapped_file()
+{
+	if (data) UnmapViewOfFile(data);
+	if (map_handle) CloseHandle(map_handle);
+	if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+}
+
+mapped_file_ptr util::map_file(std::string filename)
+{
+	mapped_file_ptr mf = std::make_shared<mapped_file>();
+	mf->file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mf->file_handle == INVALID_HANDLE_VALUE) {
+		log_fatal_exit("error CreateFile: %s", filename.c_str());
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(mf->file_handle, &file_size)) {
+		log_fatal_exit("error GetFileSizeEx: %s", filename.c_str());
+	}
+	mf->size = (size_t)file_size.QuadPart;
+	if (mf->size == 0) return mf;
+	mf->map_handle = CreateFileMappingA(mf->file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mf->map_handle) {
+		log_fatal_exit("error CreateFileMapping: %s", filename.c_str());
+	}
+	mf->data = (const char*)MapViewOfFile(mf->map_handle, FILE_MAP_READ, 0, 0, 0);
+	if (!mf->data) {
+		log_fatal_exit("error MapViewOfFile: %s", filename.c_str());
+	}
+	return mf;
+}
+
+#else
+
+mapped_file::mapped_file() : data(nullptr), size(0) {}
+
+mapped_file::~mapped_file()
+{
+	if (data) munmap((void*)data, size);
+}
+
+mapped_file_ptr util::map_file(std::string filename)
+{
+	mapped_file_ptr mf = std::make_shared<mapped_file>();
+	struct stat stat_buf;
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		log_fatal_exit("error open: %s: %s", filename.c_str(), strerror(errno));
+	}
+	if (fstat(fd, &stat_buf) < 0) {
+		log_fatal_exit("error fstat: %s: %s", filename.c_str(), strerror(errno));
+	}
+	mf->size = stat_buf.st_size;
+	if (mf->size > 0) {
+		void *addr = mmap(nullptr, mf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED) {
+			log_fatal_exit("error mmap: %s: %s", filename.c_str(), strerror(errno));
+		}
+		mf->data = (const char*)addr;
+	}
+	close(fd);
+
+	return mf;
+}
+
+#endif
+
 int util::canonicalize_path(char *path)
 {
 	char *r, *w;
@@ -402,9 +517,13 @@ struct globre_matcher
 		dir_comps.push_back(".");
 		std::string dir = util::join(dir_comps, "/");
 
-		// read directory contents
+		// read directory contents, sorted so results do not depend on
+		// the order entries happen to be stored in the directory
 		std::vector<directory_entry> dents;
 		util::list_files(dents, dir);
+		std::sort(dents.begin(), dents.end(), [](const directory_entry &a, const directory_entry &b) {
+			return a.name < b.name;
+		});
 
 		// check for matches in this directory
 		for (const directory_entry &dent : dents) {
@@ -479,6 +598,7 @@ struct globre_matcher
 
 std::vector<std::string> util::globre(std::string globre_expression)
 {
+	trace_scope trace("glob", globre_expression);
 	std::vector<std::string> results, prefix;
 	globre_matcher matcher(globre_expression);
 	matcher.accumlate_matches(prefix, 0, results);
@@ -596,6 +716,36 @@ void util::generate_uuid(uuid &u)
 	u.val.data3 = (u.val.data3 & 0x0FFF) | 0x4000; /* random uuid */
 }
 
+/* swaps the fields that format_uuid prints as integers between host and network order */
+static void uuid_swap_fields(unsigned char *data)
+{
+	if (host_endian.value != endian_little) return;
+	std::reverse(data, data + 4);
+	std::reverse(data + 4, data + 6);
+	std::reverse(data + 6, data + 8);
+	std::reverse(data + 8, data + 10);
+}
+
+/*
+ * Name based uuids (RFC 4122 version 5) are the SHA-1 of a namespace uuid
+ * followed by a name, so the same name in the same namespace always gives
+ * the same uuid. The namespace is in the format that format_uuid returns.
+ */
+void util::generate_name_uuid(uuid &u, std::string ns, std::string name)
+{
+	std::string ns_hex = ns;
+	ns_hex.erase(std::remove(ns_hex.begin(), ns_hex.end(), '-'), ns_hex.end());
+	std::vector<unsigned char> buf(16 + name.size());
+	hex_decode(ns_hex, buf.data(), 16, false);
+	std::copy(name.begin(), name.end(), buf.begin() + 16);
+	unsigned char digest[20];
+	sha1(buf.data(), buf.size(), digest);
+	memcpy(u.data, digest, 16);
+	u.data[6] = (u.data[6] & 0x0F) | 0x50; /* name based sha-1 uuid */
+	u.data[8] = (u.data[8] & 0x3F) | 0x80; /* RFC 4122 variant */
+	uuid_swap_fields(u.data);
+}
+
 std::string util::format_uuid(uuid &u)
 {
 	std::stringstream ss;
@@ -610,3 +760,80 @@ std::string util::format_uuid(uuid &u)
 	ss << hex_encode(&u.data[10], 6, false);
 	return ss.str();
 }
+
+
+/* sha1 */
+
+static inline uint32_t sha1_rol(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+static void sha1_block(uint32_t h[5], const unsigned char *p)
+{
+	uint32_t w[80];
+	for (int i = 0; i < 16; i++) {
+		w[i] = (uint32_t)p[i*4] << 24 | (uint32_t)p[i*4+1] << 16 | (uint32_t)p[i*4+2] << 8 | p[i*4+3];
+	}
+	for (int i = 16; i < 80; i++) {
+		w[i] = sha1_rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+	}
+	uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+	for (int i = 0; i < 80; i++) {
+		uint32_t f, k;
+		if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+		else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+		else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+		else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+		uint32_t t = sha1_rol(a, 5) + f + e + k + w[i];
+		e = d; d = c; c = sha1_rol(b, 30); b = a; a = t;
+	}
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+void util::sha1(const unsigned char *buf, size_t len, unsigned char digest[20])
+{
+	uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	size_t off = 0;
+	for (; off + 64 <= len; off += 64) {
+		sha1_block(h, buf + off);
+	}
+
+	/* pad the tail with 0x80, zeros and the bit length */
+	unsigned char tail[128] = { 0 };
+	size_t rem = len - off;
+	memcpy(tail, buf + off, rem);
+	tail[rem] = 0x80;
+	size_t tail_len = rem < 56 ? 64 : 128;
+	uint64_t bits = (uint64_t)len * 8;
+	for (int i = 0; i < 8; i++) {
+		tail[tail_len - 1 - i] = (unsigned char)(bits >> (i * 8));
+	}
+	for (size_t i = 0; i < tail_len; i += 64) {
+		sha1_block(h, tail + i);
+	}
+
+	for (int i = 0; i < 5; i++) {
+		digest[i*4] = (unsigned char)(h[i] >> 24);
+		digest[i*4+1] = (unsigned char)(h[i] >> 16);
+		digest[i*4+2] = (unsigned char)(h[i] >> 8);
+		digest[i*4+3] = (unsigned char)h[i];
+	}
+}
+
+/* runs fn for each index on a pool of up to one thread per core */
+void util::parallel_for(size_t count, std::function<void(size_t)> fn)
+{
+	size_t nthreads = std::min((size_t)std::max(1u, std::thread::hardware_concurrency()), count);
+	if (nthreads <= 1) {
+		for (size_t i = 0; i < count; i++) fn(i);
+		return;
+	}
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < nthreads; t++) {
+		threads.push_back(std::thread([&] {
+			for (size_t i; (i = next++) < count; ) fn(i);
+		}));
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
@@ -47,11 +47,31 @@ struct SUSHI_LIB directory_entry
 	directory_entry(std::string name, directory_entry_type type) : name(name), type(type) {}
 };
 
+struct mapped_file;
+typedef std::shared_ptr<mapped_file> mapped_file_ptr;
+
+struct SUSHI_LIB mapped_file
+{
+	const char *data;
+	size_t size;
+#ifdef _WIN32
+	void *file_handle;
+	void *map_handle;
+#endif
+
+	mapped_file();
+	~mapped_file();
+};
+
 struct SUSHI_LIB util
 {
 	static const char* HEX_DIGITS;
 
 	static std::vector<char> read_file(std::string filename);
+	static void write_file(std::string filename, const std::string &data);
+	static bool write_file_if_changed(std::string filename, const std::string &data);
+	static bool file_exists(std::string filename);
+	static mapped_file_ptr map_file(std::string filename);
 	static int canonicalize_path(char *path);
 	static std::vector<std::string> path_components(std::string path);
 	static void make_directories(std::string path);
@@ -69,7 +89,10 @@ struct SUSHI_LIB util
 	static void hex_decode(std::string hex, unsigned char *buf, size_t len, bool byte_swap);
 	static void generate_random(unsigned char *buf, size_t len);
 	static void generate_uuid(uuid &u);
+	static void generate_name_uuid(uuid &u, std::string ns, std::string name);
 	static std::string format_uuid(uuid &u);
+	static void sha1(const unsigned char *buf, size_t len, unsigned char digest[20]);
+	static void parallel_for(size_t count, std::function<void(size_t)> fn);
 };
 
 
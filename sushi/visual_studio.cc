@@ -25,6 +25,8 @@
 #include "sushi.h"
 
 #include "util.h"
+#include "stats.h"
+#include "trace.h"
 #include "project_parser.h"
 #include "project.h"
 #include "visual_studio_parser.h"
@@ -37,14 +39,19 @@ const bool VSSolution::debug = false;
 
 const std::string VSSolution::VisualCPPProjectGUID = "8BC9CEB8-8B4A-11D0-8D11-00A0C91BC942";
 
-VSSolution::VSSolution() {}
+VSSolution::VSSolution() : lazy(false) {}
 
-VSSolutionPtr VSSolution::createSolution(project_root_ptr root)
+VSSolutionPtr VSSolution::createSolution(project_root_ptr root, VSSolutionPtr existing)
 {
-	// construct empty solution
+	trace_scope trace("materialize", "vs");
+
+	// construct empty solution, keeping the project guids of an existing one
 	auto config = root->get_config("*");
 	VSSolutionPtr solution = std::make_shared<VSSolution>();
 	solution->createEmptySolution(root, config->vars);
+	if (existing) {
+		solution->guidIndex = existing->guidIndex;
+	}
 
 	// create library targets
 	for (auto lib_name : root->get_lib_list()) {
@@ -81,6 +88,20 @@ VSSolutionPtr VSSolution::createSolution(project_root_ptr root)
 	return solution;
 }
 
+VSSolutionPtr VSSolution::updateSolution(project_root_ptr root)
+{
+	std::string solution_file = root->project_name + ".vsproj/" + root->project_name + ".sln";
+	if (!util::file_exists(solution_file)) {
+		return createSolution(root);
+	}
+
+	/* only the project guids are needed so the projects are not loaded */
+	VSSolutionPtr existing = std::make_shared<VSSolution>();
+	existing->lazy = true;
+	existing->read(solution_file);
+	return createSolution(root, existing);
+}
+
 void VSSolution::createEmptySolution(project_root_ptr root, std::map<std::string,std::string> vars)
 {
 	format_version = "12.00";
@@ -101,6 +122,208 @@ void VSSolution::createEmptySolution(project_root_ptr root, std::map<std::string
 	hideSolutionNodeProperty->value = "FALSE";
 	properties.clear();
 	properties.push_back(hideSolutionNodeProperty);
+
+	propertySheets.clear();
+	auto propertySheetDir_i = vars.find("x_ms_property_sheets");
+	propertySheetDir = propertySheetDir_i != vars.end() ? propertySheetDir_i->second : std::string();
+	if (propertySheetDir.size() > 0) {
+		createPropertySheets(root, vars);
+	}
+}
+
+/* value of a solution variable, or the default if it is not set */
+static std::string solution_var(std::map<std::string,std::string> &vars, std::string name, std::string default_value)
+{
+	auto var_i = vars.find(name);
+	return var_i != vars.end() ? var_i->second : default_value;
+}
+
+/* value of a build speed variable of a configuration, or empty if it is not set */
+static std::string build_var(project_config_ptr config, std::string name)
+{
+	auto var_i = config->vars.find(name);
+	return var_i != config->vars.end() ? var_i->second : std::string();
+}
+
+/*
+ * Build speed variables map to MSBuild properties where they are set:
+ * parallel_build, debug_info (none, embedded or separate), lto (none,
+ * thin or full) and dead_strip. Precompiled headers need a source that
+ * creates them, so prefix_header is not mapped.
+ *
+ * The x_ms_ throughput variables are x_ms_incremental_link,
+ * x_ms_multi_tool_task, x_ms_cl_mp_count, x_ms_fast_link and
+ * x_ms_zc_inline. Where parallel_build, lto, x_ms_incremental_link and
+ * x_ms_zc_inline are not set, the defaults follow the optimization level.
+ */
+static void configuration_properties(VSPropertyGroupPtr propertyGroup, project_config_ptr config,
+	std::string platformToolset)
+{
+	std::string optimizationLevel = "3";
+	auto optimizationLevel_i = config->vars.find("optimization");
+	if (optimizationLevel_i != config->vars.end()) optimizationLevel = optimizationLevel_i->second;
+
+	propertyGroup->properties["PlatformToolset"] = platformToolset;
+	propertyGroup->properties["CharacterSet"] = "MultiByte";
+	if (optimizationLevel == "0") {
+		propertyGroup->properties["UseDebugLibraries"] = "true"; // TODO - use different property
+	} else if (optimizationLevel == "3") {
+		propertyGroup->properties["WholeProgramOptimization"] = "true";
+		propertyGroup->properties["UseDebugLibraries"] = "false"; // TODO - use different property
+	}
+	std::string lto = build_var(config, "lto");
+	if (lto.size() > 0) {
+		propertyGroup->properties["WholeProgramOptimization"] = lto == "thin" || lto == "full" ? "true" : "false";
+	}
+	std::string incrementalLink = build_var(config, "x_ms_incremental_link");
+	if (incrementalLink.size() > 0) {
+		propertyGroup->properties["LinkIncremental"] = incrementalLink == "yes" ? "true" : "false";
+	} else if (optimizationLevel == "0") {
+		propertyGroup->properties["LinkIncremental"] = "true";
+	} else if (optimizationLevel == "3") {
+		propertyGroup->properties["LinkIncremental"] = "false";
+	}
+	std::string multiToolTask = build_var(config, "x_ms_multi_tool_task");
+	if (multiToolTask.size() > 0) {
+		propertyGroup->properties["UseMultiToolTask"] = multiToolTask == "yes" ? "true" : "false";
+	}
+	std::string mpCount = build_var(config, "x_ms_cl_mp_count");
+	if (mpCount.size() > 0) {
+		propertyGroup->properties["CL_MPCount"] = mpCount;
+	}
+}
+
+static void compile_and_link_properties(VSClCompilePtr compile, VSLinkPtr link, project_config_ptr config)
+{
+	std::string optimizationLevel = "3";
+	auto optimizationLevel_i = config->vars.find("optimization");
+	if (optimizationLevel_i != config->vars.end()) optimizationLevel = optimizationLevel_i->second;
+
+	std::string preprocessorDefinitions;
+	for (auto define : config->defines) {
+		if (preprocessorDefinitions.size() > 0) preprocessorDefinitions.append(";");
+		preprocessorDefinitions.append(define);
+	}
+
+	// TODO - target specific defines
+
+	if (preprocessorDefinitions.size() > 0) {
+		compile->properties["PreprocessorDefinitions"] = preprocessorDefinitions + ";%(PreprocessorDefinitions)";
+	}
+	if (optimizationLevel == "0") {
+		compile->properties["Optimization"] = "Disabled";
+	} else if (optimizationLevel == "3") {
+		compile->properties["Optimization"] = "MaxSpeed";
+		compile->properties["IntrinsicFunctions"] = "true";
+	}
+	std::string debugInfo = build_var(config, "debug_info");
+	if (debugInfo == "none") {
+		compile->properties["DebugInformationFormat"] = "None";
+	} else if (debugInfo == "embedded") {
+		compile->properties["DebugInformationFormat"] = "OldStyle";
+	} else if (debugInfo == "separate") {
+		compile->properties["DebugInformationFormat"] = "ProgramDatabase";
+	}
+	std::string parallelBuild = build_var(config, "parallel_build");
+	compile->properties["MultiProcessorCompilation"] = parallelBuild == "no" ? "false" : "true";
+	std::string zcInline = build_var(config, "x_ms_zc_inline");
+	if (zcInline.size() > 0) {
+		compile->properties["RemoveUnreferencedCodeData"] = zcInline == "yes" ? "true" : "false";
+	} else if (optimizationLevel == "3") {
+		compile->properties["RemoveUnreferencedCodeData"] = "true";
+	}
+
+	std::string fastLink = build_var(config, "x_ms_fast_link");
+	if (debugInfo == "none") {
+		link->properties["GenerateDebugInformation"] = "false";
+	} else if (fastLink == "yes") {
+		link->properties["GenerateDebugInformation"] = "DebugFastLink";
+	} else {
+		link->properties["GenerateDebugInformation"] = "true";
+	}
+	if (optimizationLevel == "3") {
+		link->properties["EnableCOMDATFolding"] = "true";
+		link->properties["OptimizeReferences"] = "true";
+		link->properties["LinkTimeCodeGeneration"] = "UseLinkTimeCodeGeneration";
+	}
+	std::string lto = build_var(config, "lto");
+	if (lto == "full") {
+		link->properties["LinkTimeCodeGeneration"] = "UseLinkTimeCodeGeneration";
+	} else if (lto == "thin") {
+		link->properties["LinkTimeCodeGeneration"] = "UseFastLinkTimeCodeGeneration";
+	} else if (lto == "none") {
+		link->properties["LinkTimeCodeGeneration"] = "Default";
+	}
+	std::string deadStrip = build_var(config, "dead_strip");
+	if (deadStrip.size() > 0) {
+		link->properties["EnableCOMDATFolding"] = deadStrip == "yes" ? "true" : "false";
+		link->properties["OptimizeReferences"] = deadStrip == "yes" ? "true" : "false";
+	}
+}
+
+/* settings that depend on the dependencies and libraries of a project */
+static void project_compile_and_link_properties(VSClCompilePtr compile, VSLinkPtr link,
+	std::string additionalIncludes, std::string additionalLibraryDirectories, std::string additionalDependencies)
+{
+	if (additionalIncludes.size() > 0) {
+		compile->properties["AdditionalIncludeDirectories"] = additionalIncludes + ";%(AdditionalIncludeDirectories)";
+	}
+	if (additionalLibraryDirectories.size() > 0) {
+		link->properties["AdditionalLibraryDirectories"] = additionalLibraryDirectories + ";%(AdditionalLibraryDirectories)";
+	}
+	if (additionalDependencies.size() > 0) {
+		link->properties["AdditionalDependencies"] = additionalDependencies + ";%(AdditionalDependencies)";
+	}
+}
+
+/* import of the per user property sheet for the platform */
+static VSImportPtr user_props_import()
+{
+	VSImportPtr userConfigImport = std::make_shared<VSImport>();
+	userConfigImport->project = "$(UserRootDir)\\Microsoft.Cpp.$(Platform).user.props";
+	userConfigImport->condition = "exists('$(UserRootDir)\\Microsoft.Cpp.$(Platform).user.props')";
+	userConfigImport->label = "LocalAppDataPlatform";
+	return userConfigImport;
+}
+
+/*
+ * Settings that are the same for every project go into property sheets
+ * in the x_ms_property_sheets directory. Configuration.props holds the
+ * configuration properties, which must be set before Microsoft.Cpp.props,
+ * and <Config>.<Platform>.props holds the compile and link definitions,
+ * which are imported with the user property sheets.
+ */
+void VSSolution::createPropertySheets(project_root_ptr root, std::map<std::string,std::string> vars)
+{
+	std::string platformToolset = solution_var(vars, "x_ms_platform_toolset", "v110");
+
+	VSProjectPtr configurationSheet = std::make_shared<VSProject>();
+	configurationSheet->toolsVersion = "14.0";
+	propertySheets[propertySheetDir + "/Configuration.props"] = configurationSheet;
+
+	for (auto config_name : configurations) {
+		VSProjectConfigurationPtr projectConfig = legacyConfig(config_name);
+		auto config = root->get_config(projectConfig->configuration);
+
+		VSPropertyGroupPtr propertyGroup = std::make_shared<VSPropertyGroup>();
+		propertyGroup->label = "Configuration";
+		propertyGroup->condition = format_string("'$(Configuration)|$(Platform)'=='%s'", projectConfig->include.c_str());
+		configuration_properties(propertyGroup, config, platformToolset);
+		configurationSheet->objectList.push_back(propertyGroup);
+
+		VSItemDefinitionGroupPtr compileAndLink = std::make_shared<VSItemDefinitionGroup>();
+		VSClCompilePtr compile = std::make_shared<VSClCompile>();
+		VSLinkPtr link = std::make_shared<VSLink>();
+		compile_and_link_properties(compile, link, config);
+		compileAndLink->objectList.push_back(compile);
+		compileAndLink->objectList.push_back(link);
+
+		VSProjectPtr configSheet = std::make_shared<VSProject>();
+		configSheet->toolsVersion = "14.0";
+		configSheet->objectList.push_back(compileAndLink);
+		propertySheets[propertySheetDir + "/" + projectConfig->configuration + "." +
+			projectConfig->platform + ".props"] = configSheet;
+	}
 }
 
 VSProjectPtr VSSolution::createProject(project_root_ptr root, std::map<std::string,std::string> vars,
@@ -111,23 +334,21 @@ VSProjectPtr VSSolution::createProject(project_root_ptr root, std::map<std::stri
 	std::vector<std::string> lib_files,
 	std::vector<std::string> source)
 {
-	// find deployment target and sdk
-	std::string platformToolset = "v110";
-	std::string platformVersion = "8.1";
-	auto platformToolset_i = vars.find("x_ms_platform_toolset");
-	auto platformVersion_i = vars.find("x_ms_platform_version");
-	if (platformToolset_i != vars.end()) platformToolset = platformToolset_i->second;
-	if (platformVersion_i != vars.end()) platformVersion = platformVersion_i->second;
+	trace_scope trace("materialize", project_name);
 
-	VSSolutionProjectPtr solutionProject = std::make_shared<VSSolutionProject>();
+	// find deployment target and sdk
+	std::string platformToolset = solution_var(vars, "x_ms_platform_toolset", "v110");
+	std::string platformVersion = solution_var(vars, "x_ms_platform_version", "8.1");
 
-	uuid project_uuid;
-	util::generate_uuid(project_uuid);
+	// shared property sheets are imported relative to the project directory
+	bool sharedSheets = propertySheetDir.size() > 0;
+	std::string sheetDir = std::string("..\\") + util::join(util::path_components(propertySheetDir), "\\");
 
+	VSSolutionProjectPtr solutionProject = std::make_shared<VSSolutionProject>();
 	solutionProject->type_guid = VSSolution::VisualCPPProjectGUID;
 	solutionProject->name = project_name;
 	solutionProject->path = project_name + "\\" + project_name + ".vcxproj";
-	solutionProject->guid = util::format_uuid(project_uuid);
+	solutionProject->guid = guidForProject(project_name);
 	for (std::string dependency : depends) {
 		if (std::find(solutionProject->dependenciesToResolve.begin(), solutionProject->dependenciesToResolve.end(),
 				dependency) == solutionProject->dependenciesToResolve.end()) {
@@ -176,26 +397,27 @@ VSProjectPtr VSSolution::createProject(project_root_ptr root, std::map<std::stri
 	defaultsImport->project = "$(VCTargetsPath)\\Microsoft.Cpp.Default.props";
 	project->objectList.push_back(defaultsImport);
 
-	for (auto config_name : configurations) {
-		VSProjectConfigurationPtr projectConfig = legacyConfig(config_name);
-		auto config = root->get_config(projectConfig->configuration);
-		std::string optimizationLevel = "3";
-		auto optimizationLevel_i = config->vars.find("optimization");
-		if (optimizationLevel_i != config->vars.end()) optimizationLevel = optimizationLevel_i->second;
+	if (sharedSheets) {
+		VSImportPtr configurationImport = std::make_shared<VSImport>();
+		configurationImport->project = sheetDir + "\\Configuration.props";
+		project->objectList.push_back(configurationImport);
 
 		VSPropertyGroupPtr propertyGroup = std::make_shared<VSPropertyGroup>();
 		propertyGroup->label = "Configuration";
-		propertyGroup->condition = format_string("'$(Configuration)|$(Platform)'=='%s'", projectConfig->include.c_str());
 		propertyGroup->properties["ConfigurationType"] = project_type;
-		propertyGroup->properties["PlatformToolset"] = platformToolset;
-		propertyGroup->properties["CharacterSet"] = "MultiByte";
-		if (optimizationLevel == "0") {
-			propertyGroup->properties["UseDebugLibraries"] = "true"; // TODO - use different property
-		} else if (optimizationLevel == "3") {
-			propertyGroup->properties["WholeProgramOptimization"] = "true";
-			propertyGroup->properties["UseDebugLibraries"] = "false"; // TODO - use different property
-		}
 		project->objectList.push_back(propertyGroup);
+	} else {
+		for (auto config_name : configurations) {
+			VSProjectConfigurationPtr projectConfig = legacyConfig(config_name);
+			auto config = root->get_config(projectConfig->configuration);
+
+			VSPropertyGroupPtr propertyGroup = std::make_shared<VSPropertyGroup>();
+			propertyGroup->label = "Configuration";
+			propertyGroup->condition = format_string("'$(Configuration)|$(Platform)'=='%s'", projectConfig->include.c_str());
+			propertyGroup->properties["ConfigurationType"] = project_type;
+			configuration_properties(propertyGroup, config, platformToolset);
+			project->objectList.push_back(propertyGroup);
+		}
 	}
 
 	VSImportPtr cppImport = std::make_shared<VSImport>();
@@ -210,17 +432,23 @@ VSProjectPtr VSSolution::createProject(project_root_ptr root, std::map<std::stri
 	sharedImportGroup->label = "Shared";
 	project->objectList.push_back(sharedImportGroup);
 
-	for (auto config_name : configurations) {
-		VSProjectConfigurationPtr projectConfig = legacyConfig(config_name);
+	if (sharedSheets) {
 		VSImportGroupPtr userConfigImportGroup = std::make_shared<VSImportGroup>();
 		userConfigImportGroup->label = "PropertySheets";
-		userConfigImportGroup->condition = format_string("'$(Configuration)|$(Platform)'=='%s'", projectConfig->include.c_str());
-		VSImportPtr userConfigImport = std::make_shared<VSImport>();
-		userConfigImport->project = "$(UserRootDir)\\Microsoft.Cpp.$(Platform).user.props";
-		userConfigImport->condition = "exists('$(UserRootDir)\\Microsoft.Cpp.$(Platform).user.props')";
-		userConfigImport->label = "LocalAppDataPlatform";
-		userConfigImportGroup->objectList.push_back(userConfigImport);
+		userConfigImportGroup->objectList.push_back(user_props_import());
+		VSImportPtr configSheetImport = std::make_shared<VSImport>();
+		configSheetImport->project = sheetDir + "\\$(Configuration).$(Platform).props";
+		userConfigImportGroup->objectList.push_back(configSheetImport);
 		project->objectList.push_back(userConfigImportGroup);
+	} else {
+		for (auto config_name : configurations) {
+			VSProjectConfigurationPtr projectConfig = legacyConfig(config_name);
+			VSImportGroupPtr userConfigImportGroup = std::make_shared<VSImportGroup>();
+			userConfigImportGroup->label = "PropertySheets";
+			userConfigImportGroup->condition = format_string("'$(Configuration)|$(Platform)'=='%s'", projectConfig->include.c_str());
+			userConfigImportGroup->objectList.push_back(user_props_import());
+			project->objectList.push_back(userConfigImportGroup);
+		}
 	}
 
 	VSPropertyGroupPtr userMacros = std::make_shared<VSPropertyGroup>();
@@ -251,54 +479,37 @@ VSProjectPtr VSSolution::createProject(project_root_ptr root, std::map<std::stri
 		additionalDependencies.append(lib_file);
 	}
 
-	for (auto config_name : configurations) {
-		VSProjectConfigurationPtr projectConfig = legacyConfig(config_name);
-		auto config = root->get_config(projectConfig->configuration);
-		std::string optimizationLevel = "3";
-		auto optimizationLevel_i = config->vars.find("optimization");
-		if (optimizationLevel_i != config->vars.end()) optimizationLevel = optimizationLevel_i->second;
-
-		std::string preprocessorDefinitions;
-		for (auto define : config->defines) {
-			if (preprocessorDefinitions.size() > 0) preprocessorDefinitions.append(";");
-			preprocessorDefinitions.append(define);
-		}
-		
-		// TODO - target specific defines
-
+	if (sharedSheets) {
 		VSItemDefinitionGroupPtr compileAndLink = std::make_shared<VSItemDefinitionGroup>();
-		compileAndLink->condition = format_string("'$(Configuration)|$(Platform)'=='%s'", projectConfig->include.c_str());
-
 		VSClCompilePtr compile = std::make_shared<VSClCompile>();
-		if (preprocessorDefinitions.size() > 0) {
-			compile->properties["PreprocessorDefinitions"] = preprocessorDefinitions + ";%(PreprocessorDefinitions)";
-		}
-		if (additionalIncludes.size() > 0) {
-			compile->properties["AdditionalIncludeDirectories"] = additionalIncludes + ";%(AdditionalIncludeDirectories)";
-		}
-		if (optimizationLevel == "0") {
-			compile->properties["Optimization"] = "Disabled";
-		} else if (optimizationLevel == "3") {
-			compile->properties["Optimization"] = "MaxSpeed";
-			compile->properties["IntrinsicFunctions"] = "true";
-		}
-		compileAndLink->objectList.push_back(compile);
-
 		VSLinkPtr link = std::make_shared<VSLink>();
-		link->properties["GenerateDebugInformation"] = "true";
-		if (additionalLibraryDirectories.size() > 0) {
-			link->properties["AdditionalLibraryDirectories"] = additionalLibraryDirectories + ";%(AdditionalLibraryDirectories)";
+		project_compile_and_link_properties(compile, link, additionalIncludes,
+			additionalLibraryDirectories, additionalDependencies);
+		if (compile->properties.size() > 0) {
+			compileAndLink->objectList.push_back(compile);
 		}
-		if (additionalDependencies.size() > 0) {
-			link->properties["AdditionalDependencies"] = additionalDependencies + ";%(AdditionalDependencies)";
+		if (link->properties.size() > 0) {
+			compileAndLink->objectList.push_back(link);
 		}
-		if (optimizationLevel == "3") {
-			link->properties["EnableCOMDATFolding"] = "true";
-			link->properties["OptimizeReferences"] = "true";
+		if (compileAndLink->objectList.size() > 0) {
+			project->objectList.push_back(compileAndLink);
 		}
-		compileAndLink->objectList.push_back(link);
+	} else {
+		for (auto config_name : configurations) {
+			VSProjectConfigurationPtr projectConfig = legacyConfig(config_name);
+			auto config = root->get_config(projectConfig->configuration);
 
-		project->objectList.push_back(compileAndLink);
+			VSItemDefinitionGroupPtr compileAndLink = std::make_shared<VSItemDefinitionGroup>();
+			compileAndLink->condition = format_string("'$(Configuration)|$(Platform)'=='%s'", projectConfig->include.c_str());
+			VSClCompilePtr compile = std::make_shared<VSClCompile>();
+			VSLinkPtr link = std::make_shared<VSLink>();
+			compile_and_link_properties(compile, link, config);
+			project_compile_and_link_properties(compile, link, additionalIncludes,
+				additionalLibraryDirectories, additionalDependencies);
+			compileAndLink->objectList.push_back(compile);
+			compileAndLink->objectList.push_back(link);
+			project->objectList.push_back(compileAndLink);
+		}
 	}
 
 	// TODO - lookup file extension metadata
@@ -358,12 +569,28 @@ VSProjectConfigurationPtr VSSolution::legacyConfig(std::string config)
 	return projectConfig;
 }
 
-std::string VSSolution::findGuidForProject(std::string project_name)
+/*
+ * Project guids are name based uuids in the Visual C++ project type
+ * namespace, so they do not depend on the order projects are created in,
+ * unless the project had a guid in a solution that was read.
+ */
+std::string VSSolution::guidForProject(std::string project_name)
 {
-	for (auto solutionProject : projects) {
-		if (solutionProject->name == project_name) return solutionProject->guid;
+	auto gi = guidIndex.find(project_name);
+	if (gi != guidIndex.end()) {
+		return gi->second;
 	}
-	return "";
+	uuid project_uuid;
+	util::generate_name_uuid(project_uuid, VisualCPPProjectGUID, project_name);
+	std::string guid = util::format_uuid(project_uuid);
+	guidIndex[project_name] = guid;
+	return guid;
+}
+
+std::string VSSolution::findGuidForProject(std::string project_name)
+{
+	auto gi = guidIndex.find(project_name);
+	return gi != guidIndex.end() ? gi->second : std::string();
 }
 
 void VSSolution::resolveDependencies()
@@ -388,17 +615,29 @@ void VSSolution::resolveDependencies()
 
 void VSSolution::read(std::string solution_file)
 {
+	trace_scope trace("parse", solution_file);
+
 	std::vector<char> buf = util::read_file(solution_file);
 	if (!parse(buf.data(), buf.size())) {
 		log_fatal_exit("VSSolution: parse error");
 	}
 	for (auto project : projects) {
-		std::string project_file_path = util::path_relative_to_path(project->path, solution_file);
-		project->project = std::make_shared<VSProject>();
-		project->project->read(project_file_path);
+		project->file = util::path_relative_to_path(project->path, solution_file);
+	}
+	if (!lazy) {
+		loadProjects();
 	}
 }
 
+/* parses the project files that are not yet loaded on a thread pool */
+void VSSolution::loadProjects()
+{
+	VSProject::init();
+	util::parallel_for(projects.size(), [&](size_t i) {
+		projects[i]->getProject();
+	});
+}
+
 void VSSolution::write(project_root_ptr root)
 {
 	std::string solution_file = root->project_name + ".vsproj/" + root->project_name + ".sln";
@@ -409,17 +648,25 @@ void VSSolution::write(std::string solution_file)
 {
 	util::make_directories(solution_file);
 	write_solution(solution_file);
+	VSWriter writer;
+	for (auto sheet : propertySheets) {
+		std::string sheet_file_path = util::path_relative_to_path(sheet.first, solution_file);
+		util::make_directories(sheet_file_path);
+		sheet.second->write(sheet_file_path, writer);
+	}
 	for (auto project : projects) {
 		std::string project_file_path = util::path_relative_to_path(project->path, solution_file);
 		util::make_directories(project_file_path);
-		project->project->write(project_file_path);
+		project->getProject()->write(project_file_path, writer);
 	}
 }
 
 void VSSolution::write_solution(std::string solution_file)
 {
+	trace_scope trace("write", solution_file);
+
 	resolveDependencies();
-	std::ofstream out(solution_file.c_str());
+	std::stringstream out;
 	out << "\xef\xbb\xbf\r\n";
 	out << "Microsoft Visual Studio Solution File, Format Version " << format_version << "\r\n";
 	if (comment_version.size() > 0) {
@@ -461,6 +708,7 @@ void VSSolution::write_solution(std::string solution_file)
 	}
 	out << "\tEndGlobalSection\r\n";
 	out << "EndGlobal\r\n";
+	util::write_file_if_changed(solution_file, out.str());
 }
 
 void VSSolution::FormatVersion(const char *value, size_t length)
@@ -510,6 +758,7 @@ void VSSolution::ProjectGUID(const char *value, size_t length)
 {
 	if (debug) log_debug("ProjectGUID: %s", std::string(value, length).c_str());
 	projects.back()->guid = std::string(value, length);
+	guidIndex[projects.back()->name] = projects.back()->guid;
 }
 
 void VSSolution::ProjectDependsGUID(const char *value, size_t length)
@@ -568,6 +817,19 @@ void VSSolution::Done()
 }
 
 
+/* VSSolutionProject */
+
+VSProjectPtr VSSolutionProject::getProject()
+{
+	if (!project && file.size() > 0) {
+		VSProjectPtr loaded = std::make_shared<VSProject>();
+		loaded->read(file);
+		project = loaded;
+	}
+	return project;
+}
+
+
 /* VSProject */
 
 const std::string VSProject::xmlns = "http://schemas.microsoft.com/developer/msbuild/2003";
@@ -596,9 +858,11 @@ VSProject::VSProject() {}
 
 void VSProject::read(std::string project_file)
 {
-	tinyxml2::XMLDocument doc(false);
+	trace_scope trace("parse", project_file);
+
+	tinyxml2::XMLDocument doc(true);
 	std::vector<char> buf = util::read_file(project_file);
-	tinyxml2::XMLError err = doc.Parse(buf.data());
+	tinyxml2::XMLError err = doc.Parse(buf.data(), buf.size());
 	if (err != tinyxml2::XML_NO_ERROR) {
 		log_fatal_exit("VSProject: error reading: %s: xml_error=%d", project_file.c_str(), err);
 	}
@@ -607,13 +871,27 @@ void VSProject::read(std::string project_file)
 
 void VSProject::write(std::string project_file)
 {
-	tinyxml2::XMLDocument doc(false);
-	doc.SetBOM(true);
-	projectToXml(&doc);
-	tinyxml2::XMLError err = doc.SaveFile(project_file.c_str(), false);
-	if (err != tinyxml2::XML_NO_ERROR) {
-		log_fatal_exit("VSProject: error writing: xml_error=%d",  err);
+	VSWriter writer;
+	write(project_file, writer);
+}
+
+void VSProject::write(std::string project_file, VSWriter &writer)
+{
+	trace_scope trace("write", project_file);
+
+	writer.clear();
+	writer.write_declaration();
+	writer.begin_element("Project");
+	if (defaultTargets.size() > 0) {
+		writer.write_attribute("DefaultTargets", defaultTargets);
+	}
+	writer.write_attribute("ToolsVersion", toolsVersion);
+	writer.write_attribute("xmlns", xmlns);
+	for (auto obj : objectList) {
+		obj->write(writer);
 	}
+	writer.end_element("Project");
+	util::write_file_if_changed(project_file, writer.buf);
 }
 
 void VSProject::xmlToProject(tinyxml2::XMLDocument *doc)
@@ -639,20 +917,96 @@ void VSProject::xmlToProject(tinyxml2::XMLDocument *doc)
 	} while ((node = node->NextSibling()));
 }
 
-void VSProject::projectToXml(tinyxml2::XMLDocument *doc)
+
+/* VSWriter */
+
+VSWriter::VSWriter() : depth(0), open(false) {}
+
+void VSWriter::clear()
 {
-	tinyxml2::XMLDeclaration *decl = doc->NewDeclaration();
-	tinyxml2::XMLElement *root = doc->NewElement("Project");
-	doc->InsertFirstChild(root);
-	doc->InsertFirstChild(decl);
-	root->SetAttribute("DefaultTargets", defaultTargets.c_str());
-	root->SetAttribute("ToolsVersion", toolsVersion.c_str());
-	root->SetAttribute("xmlns", xmlns.c_str());
-	for (auto obj : objectList) {
-		obj->toXML(root);
+	buf.clear();
+	depth = 0;
+	open = false;
+}
+
+void VSWriter::write_indent()
+{
+	buf.append(depth * 4, ' ');
+}
+
+void VSWriter::write_escaped(const std::string &str, bool attribute)
+{
+	for (char c : str) {
+		switch (c) {
+			case '&': buf.append("&amp;"); break;
+			case '<': buf.append("&lt;"); break;
+			case '>': buf.append("&gt;"); break;
+			case '"':
+				if (attribute) buf.append("&quot;");
+				else buf.push_back(c);
+				break;
+			default: buf.push_back(c); break;
+		}
+	}
+}
+
+void VSWriter::write_declaration()
+{
+	buf.append("\xef\xbb\xbf<?xml version=\"1.0\" encoding=\"UTF-8\"?>");
+}
+
+void VSWriter::begin_element(const std::string &name)
+{
+	if (open) buf.push_back('>');
+	buf.push_back('\n');
+	write_indent();
+	buf.push_back('<');
+	buf.append(name);
+	open = true;
+	depth++;
+}
+
+void VSWriter::write_attribute(const char *name, const std::string &value)
+{
+	buf.push_back(' ');
+	buf.append(name);
+	buf.append("=\"");
+	write_escaped(value, true);
+	buf.push_back('"');
+}
+
+void VSWriter::write_text_element(const std::string &name, const std::string &text)
+{
+	if (open) buf.push_back('>');
+	open = false;
+	buf.push_back('\n');
+	write_indent();
+	buf.push_back('<');
+	buf.append(name);
+	buf.push_back('>');
+	write_escaped(text, false);
+	buf.append("</");
+	buf.append(name);
+	buf.push_back('>');
+}
+
+void VSWriter::end_element(const std::string &name)
+{
+	depth--;
+	if (open) {
+		buf.append("/>");
+		open = false;
+	} else {
+		buf.push_back('\n');
+		write_indent();
+		buf.append("</");
+		buf.append(name);
+		buf.push_back('>');
 	}
+	if (depth == 0) buf.push_back('\n');
 }
 
+
 /* VS classes */
 
 const std::string VSImport::type_name               = "Import";
@@ -679,20 +1033,19 @@ void VSImport::fromXML(tinyxml2::XMLElement *element)
 	if (label) this->label = label;
 }
 
-void VSImport::toXML(tinyxml2::XMLElement *parent)
+void VSImport::write(VSWriter &writer)
 {
-	tinyxml2::XMLElement *element = parent->GetDocument()->NewElement(type_name.c_str());
-	parent->InsertEndChild(element);
-
+	writer.begin_element(type_name);
 	if (project.length() > 0) {
-		element->SetAttribute("Project", project.c_str());
+		writer.write_attribute("Project", project);
 	}
 	if (condition.length() > 0) {
-		element->SetAttribute("Condition", condition.c_str());
+		writer.write_attribute("Condition", condition);
 	}
 	if (label.length() > 0) {
-		element->SetAttribute("Label", label.c_str());
+		writer.write_attribute("Label", label);
 	}
+	writer.end_element(type_name);
 }
 
 
@@ -717,20 +1070,19 @@ void VSImportGroup::fromXML(tinyxml2::XMLElement *element)
 	} while ((node = node->NextSibling()));
 }
 
-void VSImportGroup::toXML(tinyxml2::XMLElement *parent)
+void VSImportGroup::write(VSWriter &writer)
 {
-	tinyxml2::XMLElement *element = parent->GetDocument()->NewElement(type_name.c_str());
-	parent->InsertEndChild(element);
-
+	writer.begin_element(type_name);
 	if (label.length() > 0) {
-		element->SetAttribute("Label", label.c_str());
+		writer.write_attribute("Label", label);
 	}
 	if (condition.length() > 0) {
-		element->SetAttribute("Condition", condition.c_str());
+		writer.write_attribute("Condition", condition);
 	}
 	for (VSObjectPtr object : objectList) {
-		object->toXML(element);
+		object->write(writer);
 	}
+	writer.end_element(type_name);
 }
 
 
@@ -753,17 +1105,16 @@ void VSItemGroup::fromXML(tinyxml2::XMLElement *element)
 	} while ((node = node->NextSibling()));
 }
 
-void VSItemGroup::toXML(tinyxml2::XMLElement *parent)
+void VSItemGroup::write(VSWriter &writer)
 {
-	tinyxml2::XMLElement *element = parent->GetDocument()->NewElement(type_name.c_str());
-	parent->InsertEndChild(element);
-
+	writer.begin_element(type_name);
 	if (label.length() > 0) {
-		element->SetAttribute("Label", label.c_str());
+		writer.write_attribute("Label", label);
 	}
 	for (VSObjectPtr object : objectList) {
-		object->toXML(element);
+		object->write(writer);
 	}
+	writer.end_element(type_name);
 }
 
 
@@ -786,17 +1137,16 @@ void VSItemDefinitionGroup::fromXML(tinyxml2::XMLElement *element)
 	} while ((node = node->NextSibling()));
 }
 
-void VSItemDefinitionGroup::toXML(tinyxml2::XMLElement *parent)
+void VSItemDefinitionGroup::write(VSWriter &writer)
 {
-	tinyxml2::XMLElement *element = parent->GetDocument()->NewElement(type_name.c_str());
-	parent->InsertEndChild(element);
-
+	writer.begin_element(type_name);
 	if (condition.length() > 0) {
-		element->SetAttribute("Condition", condition.c_str());
+		writer.write_attribute("Condition", condition);
 	}
 	for (VSObjectPtr object : objectList) {
-		object->toXML(element);
+		object->write(writer);
 	}
+	writer.end_element(type_name);
 }
 
 
@@ -820,25 +1170,19 @@ void VSPropertyGroup::fromXML(tinyxml2::XMLElement *element)
 	} while ((node = node->NextSibling()));
 }
 
-void VSPropertyGroup::toXML(tinyxml2::XMLElement *parent)
+void VSPropertyGroup::write(VSWriter &writer)
 {
-	tinyxml2::XMLElement *element = parent->GetDocument()->NewElement(type_name.c_str());
-	parent->InsertEndChild(element);
-
+	writer.begin_element(type_name);
 	if (condition.length() > 0) {
-		element->SetAttribute("Condition", condition.c_str());
+		writer.write_attribute("Condition", condition);
 	}
 	if (label.length() > 0) {
-		element->SetAttribute("Label", label.c_str());
+		writer.write_attribute("Label", label);
 	}
-
-	for (auto ent : properties) {
-		const std::string &key = ent.first;
-		const std::string &value = ent.second;
-		tinyxml2::XMLElement *propertyElement = parent->GetDocument()->NewElement(key.c_str());
-		propertyElement->SetText(value.c_str());
-		element->InsertEndChild(propertyElement);
+	for (auto &ent : properties) {
+		writer.write_text_element(ent.first, ent.second);
 	}
+	writer.end_element(type_name);
 }
 
 
@@ -862,24 +1206,19 @@ void VSProjectConfiguration::fromXML(tinyxml2::XMLElement *element)
 	} while ((node = node->NextSibling()));
 }
 
-void VSProjectConfiguration::toXML(tinyxml2::XMLElement *parent)
+void VSProjectConfiguration::write(VSWriter &writer)
 {
-	tinyxml2::XMLElement *element = parent->GetDocument()->NewElement(type_name.c_str());
-	parent->InsertEndChild(element);
-
+	writer.begin_element(type_name);
 	if (include.length() > 0) {
-		element->SetAttribute("Include", include.c_str());
+		writer.write_attribute("Include", include);
 	}
 	if (configuration.length() > 0) {
-		tinyxml2::XMLElement *configurationElement = parent->GetDocument()->NewElement("Configuration");
-		configurationElement->SetText(configuration.c_str());
-		element->InsertEndChild(configurationElement);
+		writer.write_text_element("Configuration", configuration);
 	}
 	if (platform.length() > 0) {
-		tinyxml2::XMLElement *platformElement = parent->GetDocument()->NewElement("Platform");
-		platformElement->SetText(platform.c_str());
-		element->InsertEndChild(platformElement);
+		writer.write_text_element("Platform", platform);
 	}
+	writer.end_element(type_name);
 }
 
 
@@ -901,22 +1240,16 @@ void VSProjectReference::fromXML(tinyxml2::XMLElement *element)
 	} while ((node = node->NextSibling()));
 }
 
-void VSProjectReference::toXML(tinyxml2::XMLElement *parent)
+void VSProjectReference::write(VSWriter &writer)
 {
-	tinyxml2::XMLElement *element = parent->GetDocument()->NewElement(type_name.c_str());
-	parent->InsertEndChild(element);
-
+	writer.begin_element(type_name);
 	if (include.length() > 0) {
-		element->SetAttribute("Include", include.c_str());
+		writer.write_attribute("Include", include);
 	}
-
-	for (auto ent : properties) {
-		const std::string &key = ent.first;
-		const std::string &value = ent.second;
-		tinyxml2::XMLElement *propertyElement = parent->GetDocument()->NewElement(key.c_str());
-		propertyElement->SetText(value.c_str());
-		element->InsertEndChild(propertyElement);
+	for (auto &ent : properties) {
+		writer.write_text_element(ent.first, ent.second);
 	}
+	writer.end_element(type_name);
 }
 
 
@@ -938,22 +1271,16 @@ void VSClCompile::fromXML(tinyxml2::XMLElement *element)
 	} while ((node = node->NextSibling()));
 }
 
-void VSClCompile::toXML(tinyxml2::XMLElement *parent)
+void VSClCompile::write(VSWriter &writer)
 {
-	tinyxml2::XMLElement *element = parent->GetDocument()->NewElement(type_name.c_str());
-	parent->InsertEndChild(element);
-
+	writer.begin_element(type_name);
 	if (include.length() > 0) {
-		element->SetAttribute("Include", include.c_str());
+		writer.write_attribute("Include", include);
 	}
-
-	for (auto ent : properties) {
-		const std::string &key = ent.first;
-		const std::string &value = ent.second;
-		tinyxml2::XMLElement *propertyElement = parent->GetDocument()->NewElement(key.c_str());
-		propertyElement->SetText(value.c_str());
-		element->InsertEndChild(propertyElement);
+	for (auto &ent : properties) {
+		writer.write_text_element(ent.first, ent.second);
 	}
+	writer.end_element(type_name);
 }
 
 
@@ -965,14 +1292,13 @@ void VSClInclude::fromXML(tinyxml2::XMLElement *element)
 	if (include) this->include = include;
 }
 
-void VSClInclude::toXML(tinyxml2::XMLElement *parent)
+void VSClInclude::write(VSWriter &writer)
 {
-	tinyxml2::XMLElement *element = parent->GetDocument()->NewElement(type_name.c_str());
-	parent->InsertEndChild(element);
-
+	writer.begin_element(type_name);
 	if (include.length() > 0) {
-		element->SetAttribute("Include", include.c_str());
+		writer.write_attribute("Include", include);
 	}
+	writer.end_element(type_name);
 }
 
 
@@ -991,16 +1317,11 @@ void VSLink::fromXML(tinyxml2::XMLElement *element)
 	} while ((node = node->NextSibling()));
 }
 
-void VSLink::toXML(tinyxml2::XMLElement *parent)
+void VSLink::write(VSWriter &writer)
 {
-	tinyxml2::XMLElement *element = parent->GetDocument()->NewElement(type_name.c_str());
-	parent->InsertEndChild(element);
-
-	for (auto ent : properties) {
-		const std::string &key = ent.first;
-		const std::string &value = ent.second;
-		tinyxml2::XMLElement *propertyElement = parent->GetDocument()->NewElement(key.c_str());
-		propertyElement->SetText(value.c_str());
-		element->InsertEndChild(propertyElement);
+	writer.begin_element(type_name);
+	for (auto &ent : properties) {
+		writer.write_text_element(ent.first, ent.second);
 	}
+	writer.end_element(type_name);
 }
@@ -16,6 +16,7 @@ struct VSSolutionProject;
 struct VSSolutionProjectConfiguration;
 
 struct VSProject;
+struct VSWriter;
 struct VSObject;
 struct VSImport;
 struct VSImportGroup;
@@ -55,7 +56,12 @@ struct SUSHI_LIB VSSolutionProject
 	std::vector<std::string> dependencies;
 	VSProjectPtr project;
 
+	/* project file read from a solution, loaded on the first getProject() */
+	std::string file;
+
 	std::vector<std::string> dependenciesToResolve;
+
+	VSProjectPtr getProject();
 };
 
 struct SUSHI_LIB VSSolutionProjectConfiguration
@@ -78,6 +84,9 @@ struct SUSHI_LIB VSSolution : VisualStudioParser
 
 	static const bool debug;
 
+	/* in lazy mode read() leaves projects to be loaded on first access */
+	bool lazy;
+
 	std::string format_version;
 	std::string comment_version;
 	std::string visual_studio_version;
@@ -88,11 +97,20 @@ struct SUSHI_LIB VSSolution : VisualStudioParser
 	std::vector<VSSolutionProjectConfigurationPtr> projectConfigurations;
 	std::vector<VSSolutionPropertyPtr> properties;
 
+	/* project guids by name, kept from a solution that was read or derived from the name */
+	std::unordered_map<std::string,std::string> guidIndex;
+
+	/* generated property sheets by path, when settings are not in each project */
+	std::string propertySheetDir;
+	std::map<std::string,VSProjectPtr> propertySheets;
+
 	VSSolution();
 
-	static VSSolutionPtr createSolution(project_root_ptr root);
+	static VSSolutionPtr createSolution(project_root_ptr root, VSSolutionPtr existing = VSSolutionPtr());
+	static VSSolutionPtr updateSolution(project_root_ptr root);
 
 	void createEmptySolution(project_root_ptr root, std::map<std::string,std::string> vars);
+	void createPropertySheets(project_root_ptr root, std::map<std::string,std::string> vars);
 	VSProjectPtr createProject(project_root_ptr root, std::map<std::string,std::string> vars,
 		std::string project_name, std::string project_type,
 		std::vector<std::string> depends,
@@ -102,10 +120,12 @@ struct SUSHI_LIB VSSolution : VisualStudioParser
 		std::vector<std::string> source);
 
 	VSProjectConfigurationPtr legacyConfig(std::string config);
+	std::string guidForProject(std::string project_name);
 	std::string findGuidForProject(std::string project_name);
 	void resolveDependencies();
 
 	void read(std::string solution_file);
+	void loadProjects();
 	void write(project_root_ptr root);
 	void write(std::string solution_file);
 	void write_solution(std::string solution_file);
@@ -146,12 +166,36 @@ struct VSObjectFactoryImpl : VSObjectFactory
 	VSObjectPtr create() { return std::make_shared<T>(); }
 };
 
+/*
+ * VSWriter streams project XML into a buffer in document order, laid out
+ * like the tinyxml2 printer: four space indentation, text elements on one
+ * line and empty elements closed with "/>". The buffer keeps its capacity
+ * across clear() so one writer can be reused for every project.
+ */
+struct SUSHI_LIB VSWriter
+{
+	std::string buf;
+	int depth;
+	bool open;
+
+	VSWriter();
+
+	void clear();
+	void write_indent();
+	void write_escaped(const std::string &str, bool attribute);
+	void write_declaration();
+	void begin_element(const std::string &name);
+	void write_attribute(const char *name, const std::string &value);
+	void write_text_element(const std::string &name, const std::string &text);
+	void end_element(const std::string &name);
+};
+
 struct SUSHI_LIB VSObject
 {
 	virtual ~VSObject() {}
 
 	virtual void fromXML(tinyxml2::XMLElement *element) = 0;
-	virtual void toXML(tinyxml2::XMLElement *parent) = 0;
+	virtual void write(VSWriter &writer) = 0;
 };
 
 template <typename T> struct VSObjectImpl : VSObject
@@ -191,9 +235,9 @@ struct SUSHI_LIB VSProject
 
 	void read(std::string project_file);
 	void write(std::string project_file);
+	void write(std::string project_file, VSWriter &writer);
 
 	void xmlToProject(tinyxml2::XMLDocument *doc);
-	void projectToXml(tinyxml2::XMLDocument *doc);
 };
 
 struct SUSHI_LIB VSImport : VSObjectImpl<VSImport>
@@ -205,7 +249,7 @@ struct SUSHI_LIB VSImport : VSObjectImpl<VSImport>
 	std::string label;
 
 	void fromXML(tinyxml2::XMLElement *element);
-	void toXML(tinyxml2::XMLElement *parent);
+	void write(VSWriter &writer);
 };
 
 struct SUSHI_LIB VSImportGroup : VSObjectImpl<VSImportGroup>
@@ -217,7 +261,7 @@ struct SUSHI_LIB VSImportGroup : VSObjectImpl<VSImportGroup>
 	std::vector<VSObjectPtr> objectList;
 
 	void fromXML(tinyxml2::XMLElement *element);
-	void toXML(tinyxml2::XMLElement *parent);
+	void write(VSWriter &writer);
 };
 
 struct SUSHI_LIB VSItemGroup : VSObjectImpl<VSItemGroup>
@@ -228,7 +272,7 @@ struct SUSHI_LIB VSItemGroup : VSObjectImpl<VSItemGroup>
 	std::vector<VSObjectPtr> objectList;
 
 	void fromXML(tinyxml2::XMLElement *element);
-	void toXML(tinyxml2::XMLElement *parent);
+	void write(VSWriter &writer);
 };
 
 struct SUSHI_LIB VSItemDefinitionGroup : VSObjectImpl<VSItemDefinitionGroup>
@@ -239,7 +283,7 @@ struct SUSHI_LIB VSItemDefinitionGroup : VSObjectImpl<VSItemDefinitionGroup>
 	std::vector<VSObjectPtr> objectList;
 
 	void fromXML(tinyxml2::XMLElement *element);
-	void toXML(tinyxml2::XMLElement *parent);
+	void write(VSWriter &writer);
 };
 
 struct SUSHI_LIB VSPropertyGroup : VSObjectImpl<VSPropertyGroup>
@@ -251,7 +295,7 @@ struct SUSHI_LIB VSPropertyGroup : VSObjectImpl<VSPropertyGroup>
 	std::map<std::string,std::string> properties;
 
 	void fromXML(tinyxml2::XMLElement *element);
-	void toXML(tinyxml2::XMLElement *parent);
+	void write(VSWriter &writer);
 };
 
 struct SUSHI_LIB VSProjectConfiguration : VSObjectImpl<VSProjectConfiguration>
@@ -263,7 +307,7 @@ struct SUSHI_LIB VSProjectConfiguration : VSObjectImpl<VSProjectConfiguration>
 	std::string platform;
 
 	void fromXML(tinyxml2::XMLElement *element);
-	void toXML(tinyxml2::XMLElement *parent);
+	void write(VSWriter &writer);
 };
 
 struct SUSHI_LIB VSProjectReference : VSObjectImpl<VSProjectReference>
@@ -274,7 +318,7 @@ struct SUSHI_LIB VSProjectReference : VSObjectImpl<VSProjectReference>
 	std::map<std::string,std::string> properties;
 
 	void fromXML(tinyxml2::XMLElement *element);
-	void toXML(tinyxml2::XMLElement *parent);
+	void write(VSWriter &writer);
 };
 
 struct SUSHI_LIB VSClCompile : VSObjectImpl<VSClCompile>
@@ -285,7 +329,7 @@ struct SUSHI_LIB VSClCompile : VSObjectImpl<VSClCompile>
 	std::map<std::string,std::string> properties;
 
 	void fromXML(tinyxml2::XMLElement *element);
-	void toXML(tinyxml2::XMLElement *parent);
+	void write(VSWriter &writer);
 };
 
 struct SUSHI_LIB VSClInclude : VSObjectImpl<VSClInclude>
@@ -295,7 +339,7 @@ struct SUSHI_LIB VSClInclude : VSObjectImpl<VSClInclude>
 	std::string include;
 
 	void fromXML(tinyxml2::XMLElement *element);
-	void toXML(tinyxml2::XMLElement *parent);
+	void write(VSWriter &writer);
 };
 
 struct SUSHI_LIB VSLink : VSObjectImpl<VSLink>
@@ -305,7 +349,7 @@ struct SUSHI_LIB VSLink : VSObjectImpl<VSLink>
 	std::map<std::string,std::string> properties;
 
 	void fromXML(tinyxml2::XMLElement *element);
-	void toXML(tinyxml2::XMLElement *parent);
+	void write(VSWriter &writer);
 };
 
 #endif
@@ -17,10 +17,14 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <mutex>
 
 #include "sushi.h"
 
 #include "util.h"
+#include "stats.h"
+#include "trace.h"
 #include "project_parser.h"
 #include "project.h"
 #include "xcode.h"
@@ -31,25 +35,95 @@
 const std::string pbxproj_slash_bang = "// !$*UTF8*$!";
 
 
-/* PBXId */
+/* PBXAtom */
 
-uint32_t PBXId::next_id = 0;
+/*
+ * The pool is an open addressed table of hashes and string pointers that
+ * is never trimmed, so atoms live for the process. Each thread keeps a
+ * direct mapped cache in front of the locked pool, which catches the
+ * attribute names, comments and types that dominate a project file.
+ */
 
-PBXId PBXId::createRootId()
+struct PBXAtomSlot
 {
-	PBXId newid;
-	util::generate_random(newid.id.id_comp.id_project, sizeof(newid.id.id_comp.id_project));
-	uint32_t id = htobe32(next_id++);
-	memcpy(newid.id.id_comp.id_local, &id, 4);
-	return newid;
+	size_t hash;
+	const std::string *s;
+};
+
+const std::string PBXAtom::empty;
+
+static std::mutex pbx_atom_lock;
+static std::vector<PBXAtomSlot> pbx_atom_table(65536);
+static size_t pbx_atom_count = 0;
+
+static const size_t pbx_atom_cache_size = 8192;
+static thread_local const std::string* pbx_atom_cache[pbx_atom_cache_size];
+
+size_t PBXAtom::hash(const char *str, size_t len)
+{
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ len, w;
+	for (; len >= 8; str += 8, len -= 8) {
+		memcpy(&w, str, 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+	w = 0;
+	memcpy(&w, str, len);
+	h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+	return (size_t)(h ^ (h >> 29));
+}
+
+static void pbx_atom_grow()
+{
+	std::vector<PBXAtomSlot> table(pbx_atom_table.size() * 2);
+	size_t mask = table.size() - 1;
+	for (const PBXAtomSlot &slot : pbx_atom_table) {
+		if (!slot.s) continue;
+		size_t i = slot.hash & mask;
+		while (table[i].s) i = (i + 1) & mask;
+		table[i] = slot;
+	}
+	pbx_atom_table.swap(table);
+}
+
+const std::string* PBXAtom::intern(const char *str, size_t len)
+{
+	if (len == 0) return &empty;
+	size_t h = hash(str, len);
+	const std::string *&cached = pbx_atom_cache[(h >> 16) & (pbx_atom_cache_size - 1)];
+	if (cached && cached->size() == len && memcmp(cached->data(), str, len) == 0) {
+		return cached;
+	}
+	std::lock_guard<std::mutex> guard(pbx_atom_lock);
+	size_t mask = pbx_atom_table.size() - 1;
+	size_t i = h & mask;
+	for (; pbx_atom_table[i].s; i = (i + 1) & mask) {
+		const PBXAtomSlot &slot = pbx_atom_table[i];
+		if (slot.hash == h && slot.s->size() == len && memcmp(slot.s->data(), str, len) == 0) {
+			return (cached = slot.s);
+		}
+	}
+	pbx_atom_table[i].hash = h;
+	pbx_atom_table[i].s = cached = new std::string(str, len);
+	if (++pbx_atom_count * 2 > pbx_atom_table.size()) {
+		pbx_atom_grow();
+	}
+	return cached;
 }
 
-PBXId PBXId::createId(const PBXId &o)
+
+/* PBXId */
+
+/*
+ * Ids are the leading 12 bytes of the SHA-1 of a key naming the object,
+ * so a regenerated project keeps the ids of objects that still exist.
+ */
+PBXId PBXId::createId(const std::string &key)
 {
 	PBXId newid;
-	memcpy(newid.id.id_comp.id_project, o.id.id_comp.id_project, sizeof(newid.id.id_comp.id_project));;
-	uint32_t id = htobe32(next_id++);
-	memcpy(newid.id.id_comp.id_local, &id, 4);
+	unsigned char digest[20];
+	util::sha1((const unsigned char*)key.data(), key.size(), digest);
+	memcpy(newid.id.id_val, digest, sizeof(newid.id.id_val));
 	return newid;
 }
 
@@ -60,7 +134,7 @@ PBXId::PBXId(std::string id_str) : comment()
 	util::hex_decode(id_str, id.id_val, sizeof(id.id_val), false);
 }
 
-PBXId::PBXId(std::string id_str, std::string comment) : comment(comment)
+PBXId::PBXId(std::string id_str, PBXAtom comment) : comment(comment)
 {
 	util::hex_decode(id_str, id.id_val, sizeof(id.id_val), false);
 }
@@ -85,19 +159,84 @@ bool PBXId::operator==(const PBXId &o) { return this->id == o.id; }
 
 PBXType PBXMap::type() { return PBXTypeMap; }
 
+/* returns the index slot holding key, or the empty slot where it belongs */
+size_t PBXMap::probe(const std::string &key, uint32_t hash)
+{
+	const std::vector<PBXIndexSlot> &slots = *index;
+	size_t mask = slots.size() - 1;
+	size_t i = hash & mask;
+	for (; slots[i].pos; i = (i + 1) & mask) {
+		if (slots[i].hash != hash) continue;
+		const PBXEntry &entry = entries[slots[i].pos - 1];
+		if (entry.key.s == &key || *entry.key.s == key) break;
+	}
+	return i;
+}
+
+void PBXMap::reindex(size_t size)
+{
+	index.reset(new std::vector<PBXIndexSlot>(size));
+	for (size_t pos = 0; pos < entries.size(); pos++) {
+		const std::string &key = entries[pos].key;
+		uint32_t hash = (uint32_t)PBXAtom::hash(key.data(), key.size());
+		PBXIndexSlot &slot = (*index)[probe(key, hash)];
+		slot.hash = hash;
+		slot.pos = (uint32_t)pos + 1;
+	}
+}
+
+PBXEntry* PBXMap::find(const std::string &key)
+{
+	if (index) {
+		const PBXIndexSlot &slot = (*index)[probe(key, (uint32_t)PBXAtom::hash(key.data(), key.size()))];
+		return slot.pos ? &entries[slot.pos - 1] : nullptr;
+	}
+	for (PBXEntry &entry : entries) {
+		if (entry.key.s == &key || *entry.key.s == key) return &entry;
+	}
+	return nullptr;
+}
+
+PBXValuePtr PBXMap::get(const std::string &key)
+{
+	PBXEntry *entry = find(key);
+	return entry ? entry->val : PBXValuePtr();
+}
+
 void PBXMap::clear()
 {
-	object_val.clear();
-	key_order.clear();
+	entries.clear();
+	index.reset();
 }
 
-void PBXMap::put(std::string key, std::string comment, PBXValuePtr val)
+void PBXMap::swap(PBXMap &o)
 {
-	if (object_val.find(key) == object_val.end()) {
-		object_val[key] = val;
-		key_order.push_back(PBXKey(key, comment));
+	entries.swap(o.entries);
+	index.swap(o.index);
+}
+
+void PBXMap::put(PBXAtom key, PBXAtom comment, PBXValuePtr val)
+{
+	if (index) {
+		uint32_t hash = (uint32_t)PBXAtom::hash(key.c_str(), key.size());
+		PBXIndexSlot &slot = (*index)[probe(key, hash)];
+		if (slot.pos) {
+			log_fatal_exit("duplicate key \"%s\" in object", key.c_str());
+		}
+		entries.push_back(PBXEntry(key, comment, val));
+		slot.hash = hash;
+		slot.pos = (uint32_t)entries.size();
+		if (entries.size() * 2 > index->size()) {
+			reindex(index->size() * 2);
+		}
 	} else {
-		log_fatal_exit("duplicate key \"%s\" in object", key.c_str());
+		if (find(key)) {
+			log_fatal_exit("duplicate key \"%s\" in object", key.c_str());
+		}
+		entries.push_back(PBXEntry(key, comment, val));
+		if (entries.size() >= index_threshold) {
+			reindex(index_threshold * 4);
+		}
 	}
 }
 
@@ -106,22 +245,40 @@ void PBXMap::putObject(PBXObjectPtr obj)
 	put(obj->id.str(), obj->id.comment, obj);
 }
 
-void PBXMap::replace(std::string key, PBXValuePtr val)
+void PBXMap::replace(const std::string &key, PBXValuePtr val)
 {
-	if (object_val.find(key) != object_val.end()) {
-		object_val[key] = val;
+	PBXEntry *entry = find(key);
+	if (entry) {
+		entry->val = val;
 	} else {
 		log_fatal_exit("missing key \"%s\" in object", key.c_str());
 	}
 }
 
+void PBXMap::erase(const std::set<std::string> &keys)
+{
+	entries.erase(std::remove_if(entries.begin(), entries.end(),
+		[&](PBXEntry &entry) { return keys.count(entry.key) > 0; }), entries.end());
+	if (index) {
+		reindex(index->size());
+	}
+}
+
+void PBXMap::set(PBXAtom key, PBXValuePtr val)
+{
+	PBXEntry *entry = find(key);
+	if (entry) {
+		entry->val = val;
+	} else {
+		put(key, PBXAtom(), val);
+	}
+}
+
 PBXId PBXMap::getId(std::string key)
 {
-	auto i = object_val.find(key);
-	if (i == object_val.end()) {
-		return PBXId();
-	} else if (i->second->type() == PBXTypeId) {
-		return static_cast<const PBXId&>(*i->second);
+	PBXValuePtr val = get(key);
+	if (val && val->type() == PBXTypeId) {
+		return static_cast<const PBXId&>(*val);
 	} else {
 		return PBXId();
 	}
@@ -129,11 +286,11 @@ PBXId PBXMap::getId(std::string key)
 
 std::string PBXMap::getString(std::string key, std::string default_str)
 {
-	auto i = object_val.find(key);
-	if (i == object_val.end()) {
+	PBXValuePtr val = get(key);
+	if (!val) {
 		return default_str;
-	} else if (i->second->type() == PBXTypeLiteral) {
-		return static_cast<const PBXLiteral&>(*i->second).literal_val;
+	} else if (val->type() == PBXTypeLiteral) {
+		return static_cast<const PBXLiteral&>(*val).literal_val;
 	} else {
 		return std::string();
 	}
@@ -141,11 +298,11 @@ std::string PBXMap::getString(std::string key, std::string default_str)
 
 int PBXMap::getInteger(std::string key, int default_int)
 {
-	auto i = object_val.find(key);
-	if (i == object_val.end()) {
+	PBXValuePtr val = get(key);
+	if (!val) {
 		return default_int;
-	} else if (i->second->type() == PBXTypeLiteral) {
-		return (int)strtoul(static_cast<const PBXLiteral&>(*i->second).literal_val.c_str(), nullptr, 10);
+	} else if (val->type() == PBXTypeLiteral) {
+		return (int)strtoul(static_cast<const PBXLiteral&>(*val).literal_val.c_str(), nullptr, 10);
 	} else {
 		log_fatal_exit("value is not a literal");
 		return 0;
@@ -154,12 +311,12 @@ int PBXMap::getInteger(std::string key, int default_int)
 
 bool PBXMap::getBoolean(std::string key, bool default_bool)
 {
-	auto i = object_val.find(key);
-	if (i == object_val.end()) {
+	PBXValuePtr val = get(key);
+	if (!val) {
 		return default_bool;
-	} else if (i->second->type() == PBXTypeLiteral) {
-		std::string val = static_cast<const PBXLiteral&>(*i->second).literal_val;
-		return (val == "0" || val == "NO") ? false : true;
+	} else if (val->type() == PBXTypeLiteral) {
+		const std::string &str = static_cast<const PBXLiteral&>(*val).literal_val;
+		return (str == "0" || str == "NO") ? false : true;
 	} else {
 		return false;
 	}
@@ -167,16 +324,16 @@ bool PBXMap::getBoolean(std::string key, bool default_bool)
 
 PBXArrayPtr PBXMap::getArray(std::string key, bool default_create)
 {
-	auto i = object_val.find(key);
-	if (i == object_val.end()) {
+	PBXValuePtr val = get(key);
+	if (!val) {
 		if (default_create) {
 			auto valptr = std::make_shared<PBXArray>();
-			put(key, "", valptr);
+			put(key, PBXAtom(), valptr);
 			return valptr;
 		}
 		return PBXArrayPtr();
-	} else if (i->second->type() == PBXTypeArray) {
-		return std::static_pointer_cast<PBXArray>(i->second);
+	} else if (val->type() == PBXTypeArray) {
+		return std::static_pointer_cast<PBXArray>(val);
 	} else {
 		return PBXArrayPtr();
 	}
@@ -184,16 +341,16 @@ PBXArrayPtr PBXMap::getArray(std::string key, bool default_create)
 
 PBXMapPtr PBXMap::getMap(std::string key, bool default_create)
 {
-	auto i = object_val.find(key);
-	if (i == object_val.end()) {
+	PBXValuePtr val = get(key);
+	if (!val) {
 		if (default_create) {
 			auto valptr = std::make_shared<PBXMap>();
-			put(key, "", valptr);
+			put(key, PBXAtom(), valptr);
 			return valptr;
 		}
 		return PBXMapPtr();
-	} else if (i->second->type() == PBXTypeMap) {
-		return std::static_pointer_cast<PBXMap>(i->second);
+	} else if (val->type() == PBXTypeMap) {
+		return std::static_pointer_cast<PBXMap>(val);
 	} else {
 		return PBXMapPtr();
 	}
@@ -201,11 +358,9 @@ PBXMapPtr PBXMap::getMap(std::string key, bool default_create)
 
 PBXObjectPtr PBXMap::getObject(PBXId id)
 {
-	auto i = object_val.find(id.str());
-	if (i == object_val.end()) {
-		return PBXObjectPtr();
-	} else if (i->second->type() == PBXTypeObject) {
-		return std::static_pointer_cast<PBXObject>(i->second);
+	PBXValuePtr val = get(id.str());
+	if (val && val->type() == PBXTypeObject) {
+		return std::static_pointer_cast<PBXObject>(val);
 	} else {
 		return PBXObjectPtr();
 	}
@@ -214,58 +369,34 @@ PBXObjectPtr PBXMap::getObject(PBXId id)
 
 void PBXMap::setId(std::string key, PBXId id)
 {
-	auto i = object_val.find(key);
-	if (i == object_val.end()) {
-		key_order.push_back(PBXKey(key));
-	}
-	object_val[key] = PBXValuePtr(new PBXId(id.str(), id.comment));
+	set(key, std::make_shared<PBXId>(id));
 }
 
 void PBXMap::setString(std::string key, std::string str_val)
 {
-	auto i = object_val.find(key);
-	if (i == object_val.end()) {
-		key_order.push_back(PBXKey(key));
-	}
-	object_val[key] = PBXValuePtr(new PBXLiteral(str_val));
+	set(key, std::make_shared<PBXLiteral>(str_val));
 }
 
 void PBXMap::setInteger(std::string key, int int_val)
 {
-	auto i = object_val.find(key);
-	if (i == object_val.end()) {
-		key_order.push_back(PBXKey(key));
-	}
 	std::stringstream ss;
 	ss << int_val;
-	object_val[key] = PBXValuePtr(new PBXLiteral(ss.str()));
+	set(key, std::make_shared<PBXLiteral>(ss.str()));
 }
 
 void PBXMap::setBoolean(std::string key, bool bool_val)
 {
-	auto i = object_val.find(key);
-	if (i == object_val.end()) {
-		key_order.push_back(PBXKey(key));
-	}
-	object_val[key] = PBXValuePtr(new PBXLiteral(bool_val ? "YES" : "NO"));
+	set(key, std::make_shared<PBXLiteral>(bool_val ? "YES" : "NO"));
 }
 
 void PBXMap::setArray(std::string key, PBXArrayPtr arr)
 {
-	auto i = object_val.find(key);
-	if (i == object_val.end()) {
-		key_order.push_back(PBXKey(key));
-	}
-	object_val[key] = arr;
+	set(key, arr);
 }
 
 void PBXMap::setMap(std::string key, PBXMapPtr map)
 {
-	auto i = object_val.find(key);
-	if (i == object_val.end()) {
-		key_order.push_back(PBXKey(key));
-	}
-	object_val[key] = map;
+	set(key, map);
 }
 
 
@@ -286,7 +417,7 @@ void PBXArray::addIdRef(PBXObjectPtr obj)
 
 /* PBXLiteral */
 
-PBXLiteral::PBXLiteral(std::string literal_val) : literal_val(literal_val) {}
+PBXLiteral::PBXLiteral(PBXAtom literal_val) : literal_val(literal_val) {}
 
 PBXType PBXLiteral::type() { return PBXTypeLiteral; }
 
@@ -299,6 +430,80 @@ PBXType PBXObject::type() { return PBXTypeObject; }
 
 const std::string& PBXObject::type_name() { return default_type_name; }
 
+void PBXObject::syncFromMap()
+{
+	size_t count = fieldCount();
+	if (count == 0) return;
+	uint64_t found = 0;
+	for (const PBXEntry &entry : entries) {
+		size_t i = fieldIndex(entry.key);
+		if (i < count) {
+			field(i).read(entry.val);
+			found |= 1ULL << i;
+		}
+	}
+	for (size_t i = 0; i < count; i++) {
+		if (!(found & (1ULL << i))) field(i).read(PBXValuePtr());
+	}
+}
+
+
+/* PBXFieldValue */
+
+void PBXFieldValue::read(PBXValuePtr val)
+{
+	switch (kind) {
+		case PBXFieldString:
+			*string_val = val && val->type() == PBXTypeLiteral ?
+				static_cast<const PBXLiteral&>(*val).literal_val : PBXAtom();
+			break;
+		case PBXFieldInteger:
+			if (!val) {
+				*int_val = default_int;
+			} else if (val->type() == PBXTypeLiteral) {
+				*int_val = (int)strtoul(static_cast<const PBXLiteral&>(*val).literal_val.c_str(), nullptr, 10);
+			} else {
+				log_fatal_exit("value is not a literal");
+			}
+			break;
+		case PBXFieldId:
+			*id_val = val && val->type() == PBXTypeId ? static_cast<const PBXId&>(*val) : PBXId();
+			break;
+		case PBXFieldArray:
+			if (!val) {
+				*array_val = std::make_shared<PBXArray>();
+			} else {
+				*array_val = val->type() == PBXTypeArray ? std::static_pointer_cast<PBXArray>(val) : PBXArrayPtr();
+			}
+			break;
+		case PBXFieldMap:
+			if (!val) {
+				*map_val = std::make_shared<PBXMap>();
+			} else {
+				*map_val = val->type() == PBXTypeMap ? std::static_pointer_cast<PBXMap>(val) : PBXMapPtr();
+			}
+			break;
+	}
+}
+
+/* array and map members are null when the parsed value had another type */
+bool PBXFieldValue::is_null() const
+{
+	return (kind == PBXFieldArray && !*array_val) || (kind == PBXFieldMap && !*map_val);
+}
+
+bool PBXFieldValue::omitted() const
+{
+	switch (kind) {
+		case PBXFieldString: return (flags & PBXFieldOmitEmpty) && string_val->length() == 0;
+		case PBXFieldInteger: return ((flags & PBXFieldOmitNonZero) && *int_val != 0) ||
+			((flags & PBXFieldOmitZero) && *int_val == 0);
+		case PBXFieldId: return (flags & PBXFieldOmitEmpty) && id_val->id == PBXIdUnion();
+		case PBXFieldArray: return is_null() || ((flags & PBXFieldOmitEmpty) && (*array_val)->array_val.size() == 0);
+		default: return is_null();
+	}
+}
+
 
 /* PBX classes */
 
@@ -311,6 +516,8 @@ const std::string PBXBuildStyle::type_name =                 "PBXBuildStyle";
 const std::string PBXContainerItemProxy::type_name =         "PBXContainerItemProxy";
 const std::string PBXCopyFilesBuildPhase::type_name =        "PBXCopyFilesBuildPhase";
 const std::string PBXFileReference::type_name =              "PBXFileReference";
+const std::string PBXFileSystemSynchronizedBuildFileExceptionSet::type_name = "PBXFileSystemSynchronizedBuildFileExceptionSet";
+const std::string PBXFileSystemSynchronizedRootGroup::type_name = "PBXFileSystemSynchronizedRootGroup";
 const std::string PBXFrameworksBuildPhase::type_name =       "PBXFrameworksBuildPhase";
 const std::string PBXGroup::type_name =                      "PBXGroup";
 const std::string PBXHeadersBuildPhase::type_name =          "PBXHeadersBuildPhase";
@@ -339,6 +546,7 @@ Xcodeproj::Xcodeproj()
 	classes = std::make_shared<PBXMap>();
 	objectVersion = 46;
 	objects = std::make_shared<PBXMap>();
+	lazyCount = 0;
 }
 
 void Xcodeproj::init()
@@ -352,6 +560,8 @@ void Xcodeproj::init()
 		registerFactory<PBXContainerItemProxy>();
 		registerFactory<PBXCopyFilesBuildPhase>();
 		registerFactory<PBXFileReference>();
+		registerFactory<PBXFileSystemSynchronizedBuildFileExceptionSet>();
+		registerFactory<PBXFileSystemSynchronizedRootGroup>();
 		registerFactory<PBXFrameworksBuildPhase>();
 		registerFactory<PBXGroup>();
 		registerFactory<PBXHeadersBuildPhase>();
@@ -370,6 +580,64 @@ void Xcodeproj::init()
 	};
 }
 
+static std::string childKey(PBXGroupPtr &group, const std::string &isa, const std::string &path)
+{
+	std::string key = group->id.str();
+	key.append("/");
+	key.append(isa);
+	key.append("/");
+	key.append(path);
+	return key;
+}
+
+void Xcodeproj::indexObject(PBXObjectPtr obj)
+{
+	isaIndex[obj->type_name()].push_back(obj);
+}
+
+void Xcodeproj::indexChild(PBXGroupPtr group, PBXObjectPtr child, std::string path)
+{
+	childIndex.insert(std::make_pair(childKey(group, child->type_name(), path), child));
+}
+
+PBXObjectPtr Xcodeproj::findChild(PBXGroupPtr group, std::string isa, std::string path)
+{
+	auto ci = childIndex.find(childKey(group, isa, path));
+	return ci != childIndex.end() ? ci->second : PBXObjectPtr();
+}
+
+void Xcodeproj::rebuildIndexes()
+{
+	isaIndex.clear();
+	buildFileIndex.clear();
+	childIndex.clear();
+	if (!objects) return;
+
+	for (auto &entry : objects->entries) {
+		if (!entry.val || entry.val->type() != PBXTypeObject) continue;
+		indexObject(std::static_pointer_cast<PBXObject>(entry.val));
+	}
+	for (auto &obj : getObjectsOfType(PBXBuildFile::type_name)) {
+		auto buildFile = std::static_pointer_cast<PBXBuildFile>(obj);
+		buildFileIndex.insert(std::make_pair(buildFile->fileRef.str(), buildFile));
+	}
+	for (auto &obj : getObjectsOfType(PBXGroup::type_name)) {
+		auto group = std::static_pointer_cast<PBXGroup>(obj);
+		for (auto child : group->children->array_val) {
+			if (child->type() != PBXTypeId) continue;
+			auto childObject = getObject<PBXObject>(*std::static_pointer_cast<PBXId>(child));
+			if (!childObject) continue;
+			if (childObject->type_name() == PBXGroup::type_name) {
+				indexChild(group, childObject, std::static_pointer_cast<PBXGroup>(childObject)->path);
+			} else if (childObject->type_name() == PBXFileReference::type_name) {
+				indexChild(group, childObject, std::static_pointer_cast<PBXFileReference>(childObject)->path);
+			} else if (childObject->type_name() == PBXFileSystemSynchronizedRootGroup::type_name) {
+				indexChild(group, childObject, std::static_pointer_cast<PBXFileSystemSynchronizedRootGroup>(childObject)->path);
+			}
+		}
+	}
+}
+
 PBXFileReferencePtr Xcodeproj::getFileReferenceForPath(std::string path, bool create)
 {
 	auto project = getProject();
@@ -381,52 +649,36 @@ PBXFileReferencePtr Xcodeproj::getFileReferenceForPath(std::string path, bool cr
 
 	// find or create group
 	auto currentGroup = mainGroup;
+	std::string groupPath;
 	for (size_t i = 0; i < pathComponents.size() - 1; i++) {
-		PBXGroupPtr foundGroup;
-		for (auto child : currentGroup->children->array_val) {
-			if (child->type() != PBXTypeId) continue;
-			auto childId = std::static_pointer_cast<PBXId>(child);
-			auto childObject = getObject<PBXObject>(*childId);
-			if (childObject->type_name() != PBXGroup::type_name) continue;
-			auto group = std::static_pointer_cast<PBXGroup>(childObject);
-			if (group->path == pathComponents[i]) {
-				foundGroup = group;
-				break;
-			}
-		}
+		groupPath += pathComponents[i] + "/";
+		auto foundGroup = std::static_pointer_cast<PBXGroup>
+			(findChild(currentGroup, PBXGroup::type_name, pathComponents[i]));
 		if (!foundGroup && !create) {
 			return PBXFileReferencePtr();
 		}
 		if (!foundGroup) {
-			foundGroup = createObject<PBXGroup>(pathComponents[i]);
+			foundGroup = createObject<PBXGroup>(pathComponents[i], groupPath);
 			foundGroup->name = foundGroup->path = pathComponents[i];
 			foundGroup->sourceTree = "<group>";
 			currentGroup->children->addIdRef(foundGroup);
+			indexChild(currentGroup, foundGroup, foundGroup->path);
 		}
 		currentGroup = foundGroup;
 	}
 
 	// find or create file reference
-	PBXFileReferencePtr foundFileRef;
-	for (auto child : currentGroup->children->array_val) {
-		if (child->type() != PBXTypeId) continue;
-		auto childId = std::static_pointer_cast<PBXId>(child);
-		auto childObject = getObject<PBXObject>(*childId);
-		if (childObject->type_name() != PBXFileReference::type_name) continue;
-		auto fileRef = std::static_pointer_cast<PBXFileReference>(childObject);
-		if (fileRef->path == pathComponents.back()) {
-			foundFileRef = fileRef;
-			break;
-		}
-	}
+	auto foundFileRef = std::static_pointer_cast<PBXFileReference>
+		(findChild(currentGroup, PBXFileReference::type_name, pathComponents.back()));
 	if (!foundFileRef && !create) {
 		return PBXFileReferencePtr();
 	}
 	if (!foundFileRef) {
-		foundFileRef = createObject<PBXFileReference>(pathComponents.back());
+		foundFileRef = createObject<PBXFileReference>(pathComponents.back(), path);
 		foundFileRef->path = pathComponents.back();
 		foundFileRef->sourceTree = "<group>";
 		currentGroup->children->addIdRef(foundFileRef);
+		indexChild(currentGroup, foundFileRef, foundFileRef->path);
 	}
 	return foundFileRef;
 }
@@ -435,34 +687,19 @@ PBXFileReferencePtr Xcodeproj::getProductReference(std::string path)
 {
 	auto project = getProject();
 	auto productsGroup = getObject<PBXGroup>(project->productRefGroup);
-	for (auto child : productsGroup->children->array_val) {
-		if (child->type() != PBXTypeId) continue;
-		auto childId = std::static_pointer_cast<PBXId>(child);
-		auto childObject = getObject<PBXObject>(*childId);
-		if (childObject->type_name() != PBXFileReference::type_name) continue;
-		auto fileRef = std::static_pointer_cast<PBXFileReference>(childObject);
-		if (fileRef->path == path) {
-			return fileRef;
-		}
-	}
-	return PBXFileReferencePtr();
+	return std::static_pointer_cast<PBXFileReference>
+		(findChild(productsGroup, PBXFileReference::type_name, path));
 }
 
 PBXBuildFilePtr Xcodeproj::getBuildFile(PBXFileReferencePtr &fileRef, std::string comment)
 {
-	// TODO - we shouldn't use a linear scan
-	for (auto &keyval : objects->object_val) {
-		auto &val = keyval.second;
-		if (val->type() != PBXTypeObject) continue;
-		auto obj = std::static_pointer_cast<PBXObject>(val);
-		if (obj->type_name() != PBXBuildFile::type_name) continue;
-		auto buildFile = std::static_pointer_cast<PBXBuildFile>(obj);
-		if (buildFile->fileRef == fileRef->id) {
-			return buildFile;
-		}
+	auto bi = buildFileIndex.find(fileRef->id.str());
+	if (bi != buildFileIndex.end()) {
+		return bi->second;
 	}
-	auto buildFile = createObject<PBXBuildFile>(comment);
+	auto buildFile = createObject<PBXBuildFile>(comment, fileRef->id.str());
 	buildFile->fileRef = fileRef->id;
+	buildFileIndex.insert(std::make_pair(fileRef->id.str(), buildFile));
 	return buildFile;
 }
 
@@ -476,117 +713,351 @@ static std::vector<std::string> lib_deps(project_root_ptr root, std::vector<std:
 	return lib_deps;
 }
 
+/* value of a build speed variable of a configuration, or empty if it is not set */
+static std::string build_var(project_config_ptr config, std::string name)
+{
+	auto var_i = config->vars.find(name);
+	return var_i != config->vars.end() ? var_i->second : std::string();
+}
+
+/* directory that all source globs of a target match files in, or empty */
+static std::string glob_directory(const std::vector<std::string> &globs)
+{
+	static const char *globre_chars = "()[]{}*?\\";
+	std::string dir;
+	for (auto &glob : globs) {
+		size_t slash = glob.rfind('/');
+		if (slash == std::string::npos || glob.find_first_of(globre_chars, slash + 1) == std::string::npos) {
+			return std::string();
+		}
+		std::string globDir = glob.substr(0, slash);
+		if (globDir.find_first_of(globre_chars) != std::string::npos || (dir.size() > 0 && dir != globDir)) {
+			return std::string();
+		}
+		for (auto &comp : util::path_components(globDir)) {
+			if (comp == "." || comp == "..") return std::string();
+		}
+		dir = globDir;
+	}
+	return dir;
+}
+
+/* name, product, link libraries and source of a library or tool target */
+
+struct XcodeTargetSpec
+{
+	std::string name;
+	std::string product;
+	std::string fileType;
+	std::string productType;
+	std::vector<std::string> libraries;
+	std::vector<std::string> source;
+	std::string sourceDir;
+};
+
+static std::vector<XcodeTargetSpec> target_specs(project_root_ptr root, bool tools)
+{
+	std::vector<XcodeTargetSpec> specs;
+	if (!tools) {
+		for (auto lib_name : root->get_lib_list()) {
+			auto lib = root->get_lib(lib_name);
+			bool is_static = lib->lib_type == "static";
+			XcodeTargetSpec spec;
+			spec.name = lib->lib_name;
+			spec.product = is_static ? std::string("lib") + lib->lib_name + ".a" : lib->lib_name + ".dylib";
+			spec.fileType = is_static ? PBXFileReference::type_library_archive : PBXFileReference::type_library_dylib;
+			spec.productType = is_static ? PBXNativeTarget::type_library_static : PBXNativeTarget::type_library_dynamic;
+			if (!is_static) spec.libraries = lib_deps(root, root->get_libs(lib));
+			spec.source = util::globre_list(lib->source);
+			spec.sourceDir = glob_directory(lib->source);
+			specs.push_back(spec);
+		}
+	} else {
+		for (auto tool_name : root->get_tool_list()) {
+			auto tool = root->get_tool(tool_name);
+			XcodeTargetSpec spec;
+			spec.name = tool->tool_name;
+			spec.product = tool->tool_name;
+			spec.fileType = PBXFileReference::type_executable;
+			spec.productType = PBXNativeTarget::type_tool;
+			spec.libraries = lib_deps(root, root->get_libs(tool));
+			spec.source = util::globre_list(tool->source);
+			spec.sourceDir = glob_directory(tool->source);
+			specs.push_back(spec);
+		}
+	}
+	return specs;
+}
+
 XcodeprojPtr Xcodeproj::createProject(project_root_ptr root)
 {
+	trace_scope trace("materialize", "xcode");
+
 	// construct empty Xcode project
 	auto config = root->get_config("*");
 	XcodeprojPtr xcodeproj = std::make_shared<Xcodeproj>();
 	xcodeproj->createEmptyProject(root, root->project_name);
 
-	// create library targets
-	std::map<std::string,PBXNativeTargetPtr> libTargets;
-	for (auto lib_name : root->get_lib_list()) {
-		auto lib = root->get_lib(lib_name);
-		libTargets[lib_name] = xcodeproj->createNativeTarget(
-			root,
-			config->vars,
-			lib->lib_name,
-			lib->lib_type == "static" ? std::string("lib") + lib->lib_name + ".a" : lib->lib_name + ".dylib",
-			lib->lib_type == "static" ? PBXFileReference::type_library_archive : PBXFileReference::type_library_dylib,
-			lib->lib_type == "static" ? PBXNativeTarget::type_library_static : PBXNativeTarget::type_library_dynamic,
-			lib->lib_type == "static" ? std::vector<std::string>() : lib_deps(root, root->get_libs(lib)),
-			util::globre_list(lib->source)
-		);
-	}
-	// link library targets
-	for (auto lib_name : root->get_lib_list()) {
-		auto lib = root->get_lib(lib_name);
-		xcodeproj->linkNativeTarget(libTargets[lib_name], lib->lib_type == "static" ?
-			std::vector<std::string>() : lib_deps(root, root->get_libs(lib)));
-	}
-
-	// create tool targets
-	std::map<std::string,PBXNativeTargetPtr> toolTargets;
-	for (auto tool_name : root->get_tool_list()) {
-		auto tool = root->get_tool(tool_name);
-		toolTargets[tool_name] = xcodeproj->createNativeTarget(
-			root,
-			config->vars,
-			tool->tool_name,
-			tool->tool_name,
-			PBXFileReference::type_executable,
-			PBXNativeTarget::type_tool,
-			lib_deps(root, root->get_libs(tool)),
-			util::globre_list(tool->source)
-		);
-	}
-	// link tool targets
-	for (auto tool_name : root->get_tool_list()) {
-		auto tool = root->get_tool(tool_name);
-		xcodeproj->linkNativeTarget(toolTargets[tool_name], lib_deps(root, root->get_libs(tool)));
+	// create then link library targets followed by tool targets
+	for (bool tools : { false, true }) {
+		auto specs = target_specs(root, tools);
+		std::vector<PBXNativeTargetPtr> targets;
+		for (auto &spec : specs) {
+			targets.push_back(xcodeproj->createNativeTarget(root, config->vars,
+				spec.name, spec.product, spec.fileType, spec.productType,
+				spec.libraries, spec.source, spec.sourceDir));
+		}
+		for (size_t i = 0; i < specs.size(); i++) {
+			xcodeproj->linkNativeTarget(targets[i], specs[i].libraries);
+		}
 	}
 
 	return xcodeproj;
 }
 
+
 void Xcodeproj::createEmptyProject(project_root_ptr root, std::string projectName)
 {
 	// Create Project
-	rootObject = PBXId::createRootId();
-	auto project = createObject<PBXProject>("Project Object");
+	this->projectName = projectName;
+	this->configDir = getConfigDir(root);
+	auto project = createObject<PBXProject>("Project Object", "");
 	rootObject = project->id;
+	setObjectVersion(root);
+	setParallelBuild(root);
 
 	// Create Build Configuration List
 	auto configurationList = createObject<XCConfigurationList>
-		("Build configuration list for PBXProject \"" + projectName + "\"");
+		("Build configuration list for PBXProject \"" + projectName + "\"", "");
 	project->buildConfigurationList = configurationList->id;
 
 	// Create configurations
 	for (auto config_name : root->get_config_list()) {
-		auto config = root->get_config(config_name);
-
-		// Find deployment target, sdk and optimization level
-		std::string sdkroot = "macosx";
-		std::string target = "10.10";
-		std::string optimizationLevel = "3";
-		auto sdkroot_i = config->vars.find("x_apple_sdkroot");
-		auto target_i = config->vars.find("x_apple_target");
-		auto optimizationLevel_i = config->vars.find("optimization");
-		if (sdkroot_i != config->vars.end()) sdkroot = sdkroot_i->second;
-		if (target_i != config->vars.end()) target = target_i->second;
-		if (optimizationLevel_i != config->vars.end()) optimizationLevel = optimizationLevel_i->second;
-
-		// Create configuration
-		auto configuration = createObject<XCBuildConfiguration>(config_name);
-		configuration->name = config_name;
-		configuration->buildSettings->setString("CLANG_CXX_LANGUAGE_STANDARD", "gnu++0x");
-		configuration->buildSettings->setString("GCC_C_LANGUAGE_STANDARD", "gnu11");
-		configuration->buildSettings->setString("GCC_OPTIMIZATION_LEVEL", optimizationLevel);
-		if (config->defines.size() == 1) {
-			configuration->buildSettings->setString("GCC_PREPROCESSOR_DEFINITIONS", config->defines[0]);
-		} else if (config->defines.size() > 1) {
-			PBXArrayPtr preprocessorDefinitions = std::make_shared<PBXArray>();
-			for (std::string definition : config->defines) {
-				preprocessorDefinitions->add(std::make_shared<PBXLiteral>(definition));
-			}
-			configuration->buildSettings->setArray("GCC_PREPROCESSOR_DEFINITIONS", preprocessorDefinitions);
-		}
-		configuration->buildSettings->setString("MACOSX_DEPLOYMENT_TARGET", target);
-		configuration->buildSettings->setString("SDKROOT", sdkroot);
-		configurationList->buildConfigurations->addIdRef(configuration);
+		configurationList->buildConfigurations->addIdRef(createProjectConfiguration(root, config_name));
 	}
 
 	// Create main group
-	auto mainGroup = createObject<PBXGroup>("");
+	auto mainGroup = createObject<PBXGroup>("", "@main");
 	mainGroup->sourceTree = "<group>";
 	project->mainGroup = mainGroup->id;
 
 	// Create products group
-	auto productsGroup = createObject<PBXGroup>("Products");
+	auto productsGroup = createObject<PBXGroup>("Products", "@products");
 	productsGroup->sourceTree = "<group>";
 	productsGroup->name = "Products";
 	mainGroup->children->addIdRef(productsGroup);
+	indexChild(mainGroup, productsGroup, productsGroup->path);
 	project->productRefGroup = productsGroup->id;
+
+	// Reference generated xcconfig files from the main group
+	for (auto &val : configurationList->buildConfigurations->array_val) {
+		setBaseConfiguration(getObject<XCBuildConfiguration>(static_cast<PBXId&>(*val)));
+	}
+}
+
+/* objectVersion of projects that do not set x_apple_object_version */
+static const int default_object_version = 46;
+
+/* objectVersion from which source directories can be synchronized groups */
+static const int synchronized_groups_version = 77;
+
+/*
+ * Sets the objectVersion in x_apple_object_version, or the default when it
+ * is not set so that updated projects match created ones, and the project
+ * attributes of that format.
+ */
+void Xcodeproj::setObjectVersion(project_root_ptr root)
+{
+	auto config = root->get_config("*");
+	auto objectVersion_i = config->vars.find("x_apple_object_version");
+	objectVersion = objectVersion_i != config->vars.end() ?
+		atoi(objectVersion_i->second.c_str()) : default_object_version;
+	auto project = getProject();
+	if (objectVersion >= synchronized_groups_version) {
+		project->compatibilityVersion = PBXAtom();
+		project->preferredProjectObjectVersion = objectVersion;
+		project->erase({ "compatibilityVersion" });
+	} else {
+		if (project->compatibilityVersion.length() == 0) project->compatibilityVersion = "Xcode 3.2";
+		project->preferredProjectObjectVersion = 0;
+		project->erase({ "preferredProjectObjectVersion" });
+	}
+}
+
+/* builds targets that do not depend on each other in parallel when parallel_build is set */
+void Xcodeproj::setParallelBuild(project_root_ptr root)
+{
+	std::string parallelBuild = build_var(root->get_config("*"), "parallel_build");
+	if (parallelBuild.size() > 0) {
+		getProject()->attributes->setString("BuildIndependentTargetsInParallel", parallelBuild == "yes" ? "1" : "0");
+	}
+}
+
+/* directory for generated xcconfig files, or empty for inline build settings */
+std::string Xcodeproj::getConfigDir(project_root_ptr root)
+{
+	auto config = root->get_config("*");
+	auto configDir_i = config->vars.find("x_apple_xcconfig");
+	return configDir_i != config->vars.end() ? configDir_i->second : std::string();
+}
+
+/*
+ * Build speed variables map to Xcode settings where they are set:
+ * active_arch_only, index_store, debug_info (none, embedded or separate),
+ * prefix_header, lto (none, thin or full) and dead_strip.
+ */
+void Xcodeproj::projectBuildSettings(project_root_ptr root, std::string config_name, PBXMapPtr buildSettings)
+{
+	auto config = root->get_config(config_name);
+
+	// Find deployment target, sdk and optimization level
+	std::string sdkroot = "macosx";
+	std::string target = "10.10";
+	std::string optimizationLevel = "3";
+	auto sdkroot_i = config->vars.find("x_apple_sdkroot");
+	auto target_i = config->vars.find("x_apple_target");
+	auto optimizationLevel_i = config->vars.find("optimization");
+	if (sdkroot_i != config->vars.end()) sdkroot = sdkroot_i->second;
+	if (target_i != config->vars.end()) target = target_i->second;
+	if (optimizationLevel_i != config->vars.end()) optimizationLevel = optimizationLevel_i->second;
+
+	std::string activeArchOnly = build_var(config, "active_arch_only");
+	std::string indexStore = build_var(config, "index_store");
+	std::string debugInfo = build_var(config, "debug_info");
+	std::string prefixHeader = build_var(config, "prefix_header");
+	std::string lto = build_var(config, "lto");
+	std::string deadStrip = build_var(config, "dead_strip");
+
+	buildSettings->setString("CLANG_CXX_LANGUAGE_STANDARD", "gnu++0x");
+	if (indexStore.size() > 0) {
+		buildSettings->setString("COMPILER_INDEX_STORE_ENABLE", indexStore == "yes" ? "YES" : "NO");
+	}
+	if (deadStrip.size() > 0) {
+		buildSettings->setString("DEAD_CODE_STRIPPING", deadStrip == "yes" ? "YES" : "NO");
+	}
+	if (debugInfo == "embedded" || debugInfo == "separate") {
+		buildSettings->setString("DEBUG_INFORMATION_FORMAT", debugInfo == "separate" ? "dwarf-with-dsym" : "dwarf");
+	}
+	buildSettings->setString("GCC_C_LANGUAGE_STANDARD", "gnu11");
+	if (debugInfo == "none") {
+		buildSettings->setString("GCC_GENERATE_DEBUGGING_SYMBOLS", "NO");
+	}
+	buildSettings->setString("GCC_OPTIMIZATION_LEVEL", optimizationLevel);
+	if (prefixHeader.size() > 0) {
+		buildSettings->setString("GCC_PRECOMPILE_PREFIX_HEADER", "YES");
+		buildSettings->setString("GCC_PREFIX_HEADER", prefixHeader);
+	}
+	if (config->defines.size() == 1) {
+		buildSettings->setString("GCC_PREPROCESSOR_DEFINITIONS", config->defines[0]);
+	} else if (config->defines.size() > 1) {
+		PBXArrayPtr preprocessorDefinitions = std::make_shared<PBXArray>();
+		for (std::string definition : config->defines) {
+			preprocessorDefinitions->add(std::make_shared<PBXLiteral>(definition));
+		}
+		buildSettings->setArray("GCC_PREPROCESSOR_DEFINITIONS", preprocessorDefinitions);
+	}
+	if (lto.size() > 0) {
+		buildSettings->setString("LLVM_LTO", lto == "thin" ? "YES_THIN" : lto == "full" ? "YES" : "NO");
+	}
+	buildSettings->setString("MACOSX_DEPLOYMENT_TARGET", target);
+	if (activeArchOnly.size() > 0) {
+		buildSettings->setString("ONLY_ACTIVE_ARCH", activeArchOnly == "yes" ? "YES" : "NO");
+	}
+	buildSettings->setString("SDKROOT", sdkroot);
+	if (configDir.size() > 0) {
+		buildSettings->setString("PRODUCT_NAME", "$(TARGET_NAME)");
+	}
+}
+
+/*
+ * Project configurations hold the settings of each model configuration
+ * inline, or when x_apple_xcconfig names a directory, in an xcconfig file
+ * there that every project of a workspace shares. Target configurations
+ * are then empty, as PRODUCT_NAME resolves in the context of each target.
+ */
+XCBuildConfigurationPtr Xcodeproj::createProjectConfiguration(project_root_ptr root, std::string config_name)
+{
+	auto configuration = createObject<XCBuildConfiguration>(config_name, config_name);
+	configuration->name = config_name;
+	if (configDir.size() > 0) {
+		addConfigFile(root, config_name);
+	} else {
+		projectBuildSettings(root, config_name, configuration->buildSettings);
+	}
+	return configuration;
+}
+
+static std::string xcconfig_value(PBXValuePtr val)
+{
+	if (val->type() == PBXTypeLiteral) {
+		std::string str = static_cast<PBXLiteral&>(*val).literal_val;
+		return str.find(' ') == std::string::npos ? str : "\"" + str + "\"";
+	} else if (val->type() == PBXTypeArray) {
+		std::vector<std::string> list;
+		for (auto &item : static_cast<PBXArray&>(*val).array_val) {
+			list.push_back(xcconfig_value(item));
+		}
+		return util::join(list, " ");
+	}
+	return std::string();
+}
+
+void Xcodeproj::addConfigFile(project_root_ptr root, std::string config_name)
+{
+	PBXMapPtr buildSettings = std::make_shared<PBXMap>();
+	projectBuildSettings(root, config_name, buildSettings);
+	std::string buf = "// " + config_name + ".xcconfig\n\n";
+	for (auto &entry : buildSettings->entries) {
+		buf += entry.key.str() + " = " + xcconfig_value(entry.val) + "\n";
+	}
+	configFiles[configFilePath(config_name)] = buf;
+}
+
+std::string Xcodeproj::configFilePath(std::string config_name)
+{
+	return configDir + "/" + config_name + ".xcconfig";
+}
+
+void Xcodeproj::setBaseConfiguration(XCBuildConfigurationPtr configuration)
+{
+	if (configDir.size() == 0 || !configuration) return;
+	auto configFileRef = getFileReferenceForPath(configFilePath(configuration->name));
+	configFileRef->lastKnownFileType = PBXFileReference::type_xcconfig;
+	configuration->baseConfigurationReference = configFileRef->id;
+}
+
+void Xcodeproj::writeConfigFiles()
+{
+	for (auto &ent : configFiles) {
+		trace_scope trace("write", ent.first);
+		util::make_directories(ent.first);
+		util::write_file_if_changed(ent.first, ent.second);
+	}
+}
+
+XCBuildConfigurationPtr Xcodeproj::createTargetConfiguration(std::string targetName, std::string config_name)
+{
+	auto configuration = createObject<XCBuildConfiguration>(config_name, targetName + "/" + config_name);
+	configuration->name = config_name;
+	if (configDir.size() == 0) {
+		configuration->buildSettings->setString("PRODUCT_NAME", "$(TARGET_NAME)");
+	}
+	return configuration;
+}
+
+/* returns the build file for a source, or null if it is not compiled */
+PBXBuildFilePtr Xcodeproj::getSourceBuildFile(std::string sourceFile)
+{
+	FileTypeMetaData *meta = PBXFileReference::getFileMetaForPath(sourceFile);
+	auto sourceFileRef = getFileReferenceForPath(sourceFile);
+	if (sourceFileRef->lastKnownFileType.size() == 0 && sourceFileRef->explicitFileType.size() == 0) {
+		sourceFileRef->lastKnownFileType = meta ? meta->xcodeType : PBXFileReference::type_text;
+		sourceFileRef->includeInIndex = 1;
+	}
+	if (!meta || !(meta->flags & FileTypeCompiler)) {
+		return PBXBuildFilePtr();
+	}
+	return getBuildFile(sourceFileRef, sourceFileRef->id.comment.str() + " in Sources");
 }
 
 PBXNativeTargetPtr Xcodeproj::createNativeTarget(project_root_ptr root, 
@@ -594,53 +1065,52 @@ PBXNativeTargetPtr Xcodeproj::createNativeTarget(project_root_ptr root,
 	std::string targetName, std::string targetProduct,
 	std::string targetType, std::string targetProductType,
 	std::vector<std::string> libraries,
-	std::vector<std::string> source)
+	std::vector<std::string> source,
+	std::string sourceDir)
 {
+	trace_scope trace("materialize", targetName);
+
 	auto project = getProject();
 	auto mainGroup = getObject<PBXGroup>(project->mainGroup);
 	auto productsGroup = getObject<PBXGroup>(project->productRefGroup);
 
 	// Create Build Configuration List
 	auto configurationList = createObject<XCConfigurationList>
-		("Build configuration list for PBXNativeTarget \"" + targetName + "\"");
+		("Build configuration list for PBXNativeTarget \"" + targetName + "\"", targetName);
 
 	// Create Build Configurations
 	for (auto config_name : root->get_config_list()) {
-		auto config = root->get_config(config_name);
-		auto configuration = createObject<XCBuildConfiguration>(config_name);
-		configuration->name = config_name;
-		configuration->buildSettings->setString("PRODUCT_NAME", "$(TARGET_NAME)");
-		configurationList->buildConfigurations->addIdRef(configuration);
+		configurationList->buildConfigurations->addIdRef(createTargetConfiguration(targetName, config_name));
 
 		// TODO - target specific defines
 	}
 
 	// Create PBXSourcesBuildPhase
-	auto sourceBuildPhase = createObject<PBXSourcesBuildPhase>("Sources");
+	auto sourceBuildPhase = createObject<PBXSourcesBuildPhase>("Sources", targetName);
 	sourceBuildPhase->buildActionMask = 2147483647;
 	sourceBuildPhase->runOnlyForDeploymentPostprocessing = 0;
 
-	// Create PBXFileReferences for target source
-	for (auto sourceFile : source) {
-		FileTypeMetaData *meta = PBXFileReference::getFileMetaForPath(sourceFile);
-		auto sourceFileRef = getFileReferenceForPath(sourceFile);
-		sourceFileRef->lastKnownFileType = meta ? meta->xcodeType : PBXFileReference::type_text;
-		sourceFileRef->includeInIndex = 1;
-		if (!meta || !(meta->flags & FileTypeCompiler)) continue;
-		auto sourceBuildFileRef = getBuildFile(sourceFileRef, sourceFileRef->id.comment + " in Sources");
-		sourceBuildPhase->files->addIdRef(sourceBuildFileRef);
+	// Create a synchronized group for the source directory, or PBXFileReferences for target source
+	auto syncGroup = sourceDir.size() > 0 && objectVersion >= synchronized_groups_version ?
+		getSynchronizedGroup(sourceDir) : PBXFileSystemSynchronizedRootGroupPtr();
+	for (auto sourceFile : syncGroup ? std::vector<std::string>() : source) {
+		auto sourceBuildFileRef = getSourceBuildFile(sourceFile);
+		if (sourceBuildFileRef) {
+			sourceBuildPhase->files->addIdRef(sourceBuildFileRef);
+		}
 	}
 
 	// Create PBXFileReference for target output and add to Products
-	auto targetProductFileRef = createObject<PBXFileReference>(targetProduct);
+	auto targetProductFileRef = createObject<PBXFileReference>(targetProduct, "@products/" + targetProduct);
 	targetProductFileRef->explicitFileType = targetType;
 	targetProductFileRef->includeInIndex = 0;
 	targetProductFileRef->path = targetProduct;
 	targetProductFileRef->sourceTree = "BUILT_PRODUCTS_DIR";
 	productsGroup->children->addIdRef(targetProductFileRef);
+	indexChild(productsGroup, targetProductFileRef, targetProductFileRef->path);
 
 	// Create PBXNativeTarget
-	auto nativeTarget = createObject<PBXNativeTarget>(targetName);
+	auto nativeTarget = createObject<PBXNativeTarget>(targetName, targetName);
 	nativeTarget->name = targetName;
 	nativeTarget->productName = targetName;
 	nativeTarget->productReference = targetProductFileRef->id;
@@ -648,270 +1118,1111 @@ PBXNativeTargetPtr Xcodeproj::createNativeTarget(project_root_ptr root,
 	nativeTarget->buildConfigurationList = configurationList->id;
 	nativeTarget->buildPhases->addIdRef(sourceBuildPhase);
 	project->targets->addIdRef(nativeTarget);
+	if (syncGroup) {
+		std::set<std::string> removed;
+		syncSynchronizedGroup(nativeTarget, sourceDir, source, removed);
+	}
 
 	return nativeTarget;
 }
 
-void Xcodeproj::linkNativeTarget(PBXNativeTargetPtr nativeTarget, std::vector<std::string> libraries)
+PBXFrameworksBuildPhasePtr Xcodeproj::linkNativeTarget(PBXNativeTargetPtr nativeTarget, std::vector<std::string> libraries)
 {
 	// Create PBXFrameworksBuildPhase
-	auto frameworkBuildPhase = createObject<PBXFrameworksBuildPhase>("Frameworks");
+	auto frameworkBuildPhase = createObject<PBXFrameworksBuildPhase>("Frameworks", nativeTarget->name);
 	frameworkBuildPhase->buildActionMask = 2147483647;
 	frameworkBuildPhase->runOnlyForDeploymentPostprocessing = 0;
 
-	// Create PBXBuildFiles for target link libraries
+	// Create PBXBuildFiles and PBXTargetDependencies for target link libraries
 	for (std::string library : libraries) {
 		auto libraryFileRef = getProductReference(library);
 		if (libraryFileRef) {
-			auto libraryBuildFileRef = getBuildFile(libraryFileRef, libraryFileRef->id.comment + " in Frameworks");
+			auto libraryBuildFileRef = getBuildFile(libraryFileRef, libraryFileRef->id.comment.str() + " in Frameworks");
 			frameworkBuildPhase->files->addIdRef(libraryBuildFileRef);
+			auto libraryTarget = getTargetForProduct(libraryFileRef);
+			if (libraryTarget) {
+				addTargetDependency(nativeTarget, libraryTarget);
+			}
 		}
 	}
 
 	nativeTarget->buildPhases->addIdRef(frameworkBuildPhase);
+
+	return frameworkBuildPhase;
 }
 
-void Xcodeproj::write(project_root_ptr root)
+PBXNativeTargetPtr Xcodeproj::getTargetForProduct(PBXFileReferencePtr &productRef)
 {
-	std::string project_file = root->project_name + ".xcodeproj/project.pbxproj";
-	write(project_file);
+	for (auto &obj : getObjectsOfType(PBXNativeTarget::type_name)) {
+		auto nativeTarget = std::static_pointer_cast<PBXNativeTarget>(obj);
+		if (nativeTarget->productReference == productRef->id) {
+			return nativeTarget;
+		}
+	}
+	return PBXNativeTargetPtr();
 }
 
-void Xcodeproj::write(std::string project_file)
+/*
+ * Explicit dependency edges let Xcode order targets from the graph rather
+ * than by implicit discovery, and build independent libraries in parallel.
+ * Only targets that link have edges, as archiving a static library does
+ * not need the products of the libraries it uses.
+ */
+void Xcodeproj::addTargetDependency(PBXNativeTargetPtr nativeTarget, PBXNativeTargetPtr dependency)
 {
-	syncToMap();
-	util::make_directories(project_file);
-	std::ofstream out(project_file.c_str());
-	out << pbxproj_slash_bang << '\n';
-	out << "{" << '\n';
-	PBXMap &map = static_cast<PBXMap&>(*this);
-	for (const PBXKey &key : map.key_order) {
-		PBXValuePtr &val = map.object_val[key.str];
-		out << "\t";
-		out << key.str;
-		if (key.comment.length() > 0) {
-			out << " /* " << key.comment << " */";
+	for (auto &val : nativeTarget->dependencies->array_val) {
+		if (val->type() != PBXTypeId) continue;
+		auto obj = getObject<PBXObject>(static_cast<PBXId&>(*val));
+		if (obj && obj->type_name() == PBXTargetDependency::type_name &&
+			std::static_pointer_cast<PBXTargetDependency>(obj)->target == dependency->id) {
+			return;
 		}
-		out << " = ";
-		PBXWriter::write(val, out, 1);
-		out << ";" << '\n';
 	}
-	out << "}\n";
+
+	// Create PBXContainerItemProxy referring to the target in this project
+	std::string identity = nativeTarget->name.str() + "/" + dependency->name.str();
+	auto targetProxy = createObject<PBXContainerItemProxy>("PBXContainerItemProxy", identity);
+	targetProxy->containerPortal = rootObject;
+	targetProxy->proxyType = 1;
+	targetProxy->remoteGlobalIDString = PBXId(dependency->id.str());
+	targetProxy->remoteInfo = dependency->name;
+
+	// Create PBXTargetDependency
+	auto targetDependency = createObject<PBXTargetDependency>("PBXTargetDependency", identity);
+	targetDependency->target = dependency->id;
+	targetDependency->targetProxy = targetProxy->id;
+	nativeTarget->dependencies->addIdRef(targetDependency);
 }
 
-void Xcodeproj::syncFromMap()
+/*
+ * Links the product of a target in another project of the workspace. The
+ * project is referenced from the main group with a products group holding
+ * a PBXReferenceProxy for the product, and the target depends on the
+ * remote target through a PBXContainerItemProxy. Remote ids are derived
+ * from the name of the other project as its createObject would.
+ */
+void Xcodeproj::linkProjectReference(PBXNativeTargetPtr nativeTarget, PBXFrameworksBuildPhasePtr frameworkBuildPhase,
+	std::string projectPath, std::string targetName, std::string targetProduct, std::string targetType)
 {
-	archiveVersion = getInteger("archiveVersion");
-	classes = getMap("classes");
-	objectVersion = getInteger("objectVersion");
-	objects = getMap("objects");
-	rootObject = getId("rootObject");
+	auto project = getProject();
+	std::string remoteProjectName = targetName;
+	std::string remoteProductId = PBXId::createId(objectKey(remoteProjectName,
+		PBXFileReference::type_name, "@products/" + targetProduct)).str();
+	std::string remoteTargetId = PBXId::createId(objectKey(remoteProjectName,
+		PBXNativeTarget::type_name, targetName)).str();
+
+	// Create PBXFileReference for the project and its products group
+	auto projectFileRef = getFileReferenceForPath(projectPath);
+	projectFileRef->lastKnownFileType = PBXFileReference::type_project;
+	PBXGroupPtr productGroup;
+	for (auto &val : project->projectReferences->array_val) {
+		if (val->type() != PBXTypeMap) continue;
+		auto projectReference = std::static_pointer_cast<PBXMap>(val);
+		if (projectReference->getId("ProjectRef") == projectFileRef->id) {
+			productGroup = getObject<PBXGroup>(projectReference->getId("ProductGroup"));
+		}
+	}
+	if (!productGroup) {
+		productGroup = createObject<PBXGroup>("Products", "@products/" + projectPath);
+		productGroup->name = "Products";
+		productGroup->sourceTree = "<group>";
+		PBXMapPtr projectReference = std::make_shared<PBXMap>();
+		projectReference->setId("ProductGroup", productGroup->id);
+		projectReference->setId("ProjectRef", projectFileRef->id);
+		project->projectReferences->add(projectReference);
+	}
+
+	// Create PBXReferenceProxy for the product
+	std::string identity = "@products/" + projectPath + "/" + targetProduct;
+	auto productProxy = createObject<PBXContainerItemProxy>("PBXContainerItemProxy", identity);
+	productProxy->containerPortal = projectFileRef->id;
+	productProxy->proxyType = 2;
+	productProxy->remoteGlobalIDString = PBXId(remoteProductId);
+	productProxy->remoteInfo = targetName;
+	auto referenceProxy = createObject<PBXReferenceProxy>(targetProduct, identity);
+	referenceProxy->fileType = targetType;
+	referenceProxy->path = targetProduct;
+	referenceProxy->remoteRef = productProxy->id;
+	referenceProxy->sourceTree = "BUILT_PRODUCTS_DIR";
+	productGroup->children->addIdRef(referenceProxy);
+
+	// Create PBXBuildFile for the product
+	auto buildFile = createObject<PBXBuildFile>(targetProduct + " in Frameworks", referenceProxy->id.str());
+	buildFile->fileRef = referenceProxy->id;
+	frameworkBuildPhase->files->addIdRef(buildFile);
+
+	// Create PBXTargetDependency on the remote target
+	identity = nativeTarget->name.str() + "/" + projectPath;
+	auto targetProxy = createObject<PBXContainerItemProxy>("PBXContainerItemProxy", identity);
+	targetProxy->containerPortal = projectFileRef->id;
+	targetProxy->proxyType = 1;
+	targetProxy->remoteGlobalIDString = PBXId(remoteTargetId);
+	targetProxy->remoteInfo = targetName;
+	auto targetDependency = createObject<PBXTargetDependency>("PBXTargetDependency", identity);
+	targetDependency->name = targetName;
+	targetDependency->targetProxy = targetProxy->id;
+	nativeTarget->dependencies->addIdRef(targetDependency);
+}
+
+PBXObjectPtr Xcodeproj::materializeObject(std::string id_str)
+{
+	PBXEntry *entry = objects->find(id_str);
+	if (!entry) {
+		return PBXObjectPtr();
+	}
+	materializeEntry(entry - objects->entries.data());
+	return entry->val && entry->val->type() == PBXTypeObject ?
+		std::static_pointer_cast<PBXObject>(entry->val) : PBXObjectPtr();
 }
 
-void Xcodeproj::syncToMap()
+void Xcodeproj::materializeEntry(size_t i)
 {
-	setInteger("archiveVersion", archiveVersion);
-	setMap("classes", classes);
-	setInteger("objectVersion", objectVersion);
-	setMap("objects", objects);
-	setId("rootObject", rootObject);
-}
+	if (i >= lazyObjects.size() || lazyObjects[i].length == 0) {
+		return;
+	}
+	PBXLazyObject range = lazyObjects[i];
+	lazyObjects[i] = PBXLazyObject();
 
+	// parse the object value into a container keyed by its id
+	PBXEntry &entry = objects->entries[i];
+	PBXParserImpl parser;
+	auto container = std::make_shared<PBXMap>();
+	parser.xcodeproj = XcodeprojPtr(this, [](Xcodeproj*) {});
+	parser.value_stack.push_back(container);
+	parser.current_attr_name = entry.key;
+	parser.current_attr_comment = entry.comment;
+	PBXParseError error = parser.parseValue(lazySource->data + range.offset, range.length);
+	if (error != PBXParseErrorNone) {
+		log_fatal_exit("error parsing object %s: %d", entry.key.c_str(), error);
+	}
+	entry.val = container->entries.front().val;
 
-/* PBXAggregateTarget */
+	if (--lazyCount == 0) {
+		lazyObjects.clear();
+		lazySource.reset();
+	}
+}
 
-PBXAggregateTarget::PBXAggregateTarget()
+void Xcodeproj::materializeAll()
 {
-	buildPhases = std::make_shared<PBXArray>();
-	dependencies = std::make_shared<PBXArray>();
+	if (lazyCount == 0) return;
+	for (size_t i = 0; i < lazyObjects.size() && lazyCount > 0; i++) {
+		materializeEntry(i);
+	}
+	rebuildIndexes();
 }
 
-void PBXAggregateTarget::syncFromMap()
+void Xcodeproj::write(project_root_ptr root)
 {
-	PBXObject::syncFromMap();
-
-	buildConfigurationList = getId("buildConfigurationList");
-	buildPhases = getArray("buildPhases");
-	dependencies = getArray("dependencies");
-	name = getString("name");
-	productName = getString("productName");
+	std::string project_file = root->project_name + ".xcodeproj/project.pbxproj";
+	write(project_file);
+	writeSchemes(root->project_name + ".xcodeproj");
+	writeConfigFiles();
 }
 
-void PBXAggregateTarget::syncToMap()
+void Xcodeproj::write(std::string project_file)
 {
-	PBXObject::syncToMap();
+	trace_scope trace("write", project_file);
 
-	setId("buildConfigurationList", buildConfigurationList);
-	setArray("buildPhases", buildPhases);
-	setArray("dependencies", dependencies);
-	setString("name", name);
-	setString("productName", productName);
+	PBXWriter writer;
+	writer.write(*this, 0);
+	writer.buf.push_back('\n');
+	util::make_directories(project_file);
+	util::write_file_if_changed(project_file, writer.buf);
 }
 
+static constexpr PBXField<Xcodeproj> xcodeproj_fields[] = {
+	{ "archiveVersion", &Xcodeproj::archiveVersion },
+	{ "classes", &Xcodeproj::classes },
+	{ "objectVersion", &Xcodeproj::objectVersion },
+	{ "objects", &Xcodeproj::objects },
+	{ "rootObject", &Xcodeproj::rootObject },
+};
 
-/* PBXAppleScriptBuildPhase */
+const PBXFieldTable<Xcodeproj> Xcodeproj::fields(xcodeproj_fields);
 
-PBXAppleScriptBuildPhase::PBXAppleScriptBuildPhase()
+void Xcodeproj::syncFromMap()
 {
-	files = std::make_shared<PBXArray>();
+	PBXObject::syncFromMap();
+	if (lazyCount == 0) {
+		rebuildIndexes();
+	}
 }
 
-void PBXAppleScriptBuildPhase::syncFromMap()
+void Xcodeproj::prepareWrite()
 {
-	PBXObject::syncFromMap();
+	materializeAll();
+}
 
-	buildActionMask = getInteger("buildActionMask");
-	files = getArray("files");
-	runOnlyForDeploymentPostprocessing = getInteger("runOnlyForDeploymentPostprocessing");
+
+/* Xcodeproj merge */
+
+static bool isRemoved(PBXValuePtr val, const std::set<std::string> &removed)
+{
+	return val->type() == PBXTypeId && removed.count(static_cast<PBXId&>(*val).str()) > 0;
 }
 
-void PBXAppleScriptBuildPhase::syncToMap()
+static void removeIds(PBXArrayPtr array, const std::set<std::string> &removed)
 {
-	PBXObject::syncToMap();
+	auto &vals = array->array_val;
+	vals.erase(std::remove_if(vals.begin(), vals.end(),
+		[&](PBXValuePtr &val) { return isRemoved(val, removed); }), vals.end());
+}
 
-	setInteger("buildActionMask", buildActionMask);
-	setArray("files", files);
-	setInteger("runOnlyForDeploymentPostprocessing", runOnlyForDeploymentPostprocessing);
+/* returns an array member of any class by key, such as the files of a build phase */
+static PBXArrayPtr objectArray(PBXObjectPtr obj, const char *key)
+{
+	size_t i = obj->fieldIndex(PBXAtom(key));
+	if (i == obj->fieldCount()) return PBXArrayPtr();
+	PBXFieldValue field = obj->field(i);
+	return field.kind == PBXFieldArray ? *field.array_val : PBXArrayPtr();
 }
 
+/* keeps the build files of a phase in place, dropping stale ones and appending new ones */
+static void syncBuildFiles(PBXArrayPtr files, const std::vector<PBXBuildFilePtr> &buildFiles)
+{
+	std::set<std::string> wanted, present;
+	for (auto &buildFile : buildFiles) {
+		wanted.insert(buildFile->id.str());
+	}
+	auto &vals = files->array_val;
+	vals.erase(std::remove_if(vals.begin(), vals.end(), [&](PBXValuePtr &val) {
+		if (val->type() != PBXTypeId) return false;
+		std::string id = static_cast<PBXId&>(*val).str();
+		if (!wanted.count(id)) return true;
+		present.insert(id);
+		return false;
+	}), vals.end());
+	for (auto &buildFile : buildFiles) {
+		if (present.insert(buildFile->id.str()).second) {
+			files->addIdRef(buildFile);
+		}
+	}
+}
 
-/* PBXBuildFile */
+void Xcodeproj::syncConfigurations(PBXId listId, project_root_ptr root, std::set<std::string> &removed,
+	std::function<XCBuildConfigurationPtr(std::string)> create)
+{
+	auto configurationList = getObject<XCConfigurationList>(listId);
+	if (!configurationList) return;
 
-PBXBuildFile::PBXBuildFile()
+	std::set<std::string> present;
+	auto config_list = root->get_config_list();
+	for (auto &val : configurationList->buildConfigurations->array_val) {
+		if (val->type() != PBXTypeId) continue;
+		auto configuration = getObject<XCBuildConfiguration>(static_cast<PBXId&>(*val));
+		if (!configuration) continue;
+		if (std::find(config_list.begin(), config_list.end(), configuration->name.str()) == config_list.end()) {
+			removed.insert(configuration->id.str());
+		} else {
+			present.insert(configuration->name);
+		}
+	}
+	removeIds(configurationList->buildConfigurations, removed);
+	for (auto config_name : config_list) {
+		if (!present.count(config_name)) {
+			configurationList->buildConfigurations->addIdRef(create(config_name));
+		}
+	}
+}
+
+/*
+ * Moves the settings of a project configuration into its xcconfig file
+ * when x_apple_xcconfig is set and back inline when it is not, returning
+ * true if the configuration was switched. Only a base configuration that
+ * names an xcconfig file of the same configuration is treated as ours.
+ */
+bool Xcodeproj::rebaseProjectConfiguration(project_root_ptr root, XCBuildConfigurationPtr configuration)
+{
+	auto baseRef = getObject<PBXFileReference>(configuration->baseConfigurationReference);
+	bool based = baseRef && baseRef->lastKnownFileType.str() == PBXFileReference::type_xcconfig &&
+		baseRef->path.str() == configuration->name.str() + ".xcconfig";
+	if (configDir.size() > 0) {
+		if (!based) {
+			PBXMapPtr buildSettings = std::make_shared<PBXMap>();
+			projectBuildSettings(root, configuration->name, buildSettings);
+			std::set<std::string> keys;
+			for (auto &entry : buildSettings->entries) keys.insert(entry.key.str());
+			configuration->buildSettings->erase(keys);
+		}
+		setBaseConfiguration(configuration);
+		return !based;
+	} else if (based) {
+		configuration->baseConfigurationReference = PBXId();
+		configuration->erase({ "baseConfigurationReference" });
+		projectBuildSettings(root, configuration->name, configuration->buildSettings);
+		return true;
+	}
+	return false;
+}
+
+/* adds or removes the PRODUCT_NAME that target configurations hold without an xcconfig file */
+void Xcodeproj::rebaseTargetConfigurations(PBXId listId)
 {
+	auto configurationList = getObject<XCConfigurationList>(listId);
+	if (!configurationList) return;
+	for (auto &val : configurationList->buildConfigurations->array_val) {
+		if (val->type() != PBXTypeId) continue;
+		auto configuration = getObject<XCBuildConfiguration>(static_cast<PBXId&>(*val));
+		if (!configuration) continue;
+		if (configDir.size() > 0) {
+			if (configuration->buildSettings->getString("PRODUCT_NAME") == "$(TARGET_NAME)") {
+				configuration->buildSettings->erase({ "PRODUCT_NAME" });
+			}
+		} else if (!configuration->buildSettings->find("PRODUCT_NAME")) {
+			configuration->buildSettings->setString("PRODUCT_NAME", "$(TARGET_NAME)");
+		}
+	}
+}
 
+void Xcodeproj::removeNativeTarget(PBXNativeTargetPtr nativeTarget, std::set<std::string> &removed)
+{
+	removed.insert(nativeTarget->id.str());
+	removed.insert(nativeTarget->productReference.str());
+	auto configurationList = getObject<XCConfigurationList>(nativeTarget->buildConfigurationList);
+	if (configurationList) {
+		removed.insert(configurationList->id.str());
+		for (auto &val : configurationList->buildConfigurations->array_val) {
+			if (val->type() == PBXTypeId) removed.insert(static_cast<PBXId&>(*val).str());
+		}
+	}
+	for (auto &val : nativeTarget->buildPhases->array_val) {
+		if (val->type() == PBXTypeId) removed.insert(static_cast<PBXId&>(*val).str());
+	}
+	syncTargetDependencies(nativeTarget, std::vector<PBXNativeTargetPtr>(), removed);
+	syncSynchronizedGroup(nativeTarget, std::string(), std::vector<std::string>(), removed);
+}
+
+/* removes dependencies on native targets that are missing or not in the list, then adds the rest */
+void Xcodeproj::syncTargetDependencies(PBXNativeTargetPtr nativeTarget,
+	const std::vector<PBXNativeTargetPtr> &dependencies, std::set<std::string> &removed)
+{
+	for (auto &val : nativeTarget->dependencies->array_val) {
+		if (val->type() != PBXTypeId) continue;
+		auto obj = getObject<PBXObject>(static_cast<PBXId&>(*val));
+		if (!obj || obj->type_name() != PBXTargetDependency::type_name) continue;
+		auto targetDependency = std::static_pointer_cast<PBXTargetDependency>(obj);
+		auto target = getObject<PBXObject>(targetDependency->target);
+		if (target && target->type_name() != PBXNativeTarget::type_name) continue;
+		bool wanted = target && std::find_if(dependencies.begin(), dependencies.end(),
+			[&](const PBXNativeTargetPtr &dependency) { return dependency->id == target->id; }) != dependencies.end();
+		if (!wanted) {
+			removed.insert(targetDependency->id.str());
+			removed.insert(targetDependency->targetProxy.str());
+		}
+	}
+	removeIds(nativeTarget->dependencies, removed);
+	for (auto &dependency : dependencies) {
+		addTargetDependency(nativeTarget, dependency);
+	}
 }
 
-void PBXBuildFile::syncFromMap()
+/* removes file references and synchronized groups under group that are not kept, then empty groups */
+bool Xcodeproj::pruneGroup(PBXGroupPtr group, std::string prefix,
+	const std::set<std::string> &keep, std::set<std::string> &removed)
 {
-	PBXObject::syncFromMap();
+	for (auto &val : group->children->array_val) {
+		if (val->type() != PBXTypeId) continue;
+		auto child = getObject<PBXObject>(static_cast<PBXId&>(*val));
+		if (!child || child->id == getProject()->productRefGroup) continue;
+		if (child->type_name() == PBXGroup::type_name) {
+			auto childGroup = std::static_pointer_cast<PBXGroup>(child);
+			if (pruneGroup(childGroup, prefix + childGroup->path.str() + "/", keep, removed)) {
+				removed.insert(childGroup->id.str());
+			}
+		} else if (child->type_name() == PBXFileReference::type_name) {
+			auto fileRef = std::static_pointer_cast<PBXFileReference>(child);
+			if (!keep.count(prefix + fileRef->path.str()) && !keep.count(fileRef->id.str())) {
+				removed.insert(fileRef->id.str());
+			}
+		} else if (child->type_name() == PBXFileSystemSynchronizedRootGroup::type_name) {
+			auto syncGroup = std::static_pointer_cast<PBXFileSystemSynchronizedRootGroup>(child);
+			if (!keep.count(syncGroup->id.str())) {
+				removed.insert(syncGroup->id.str());
+				for (auto &exceptionVal : syncGroup->exceptions->array_val) {
+					if (exceptionVal->type() == PBXTypeId) removed.insert(static_cast<PBXId&>(*exceptionVal).str());
+				}
+			}
+		}
+	}
+	removeIds(group->children, removed);
+	return group->children->array_val.size() == 0;
+}
 
-	fileRef = getId("fileRef");
+XcodeprojPtr Xcodeproj::updateProject(project_root_ptr root)
+{
+	std::string project_file = root->project_name + ".xcodeproj/project.pbxproj";
+	if (!util::file_exists(project_file)) {
+		return createProject(root);
+	}
+
+	trace_scope trace("materialize", "xcode");
+
+	PBXParserImpl parser;
+	PBXParseError error = parser.read(project_file);
+	if (error != PBXParseErrorNone) {
+		log_fatal_exit("error parsing project: %s: %d", project_file.c_str(), error);
+	}
+	XcodeprojPtr xcodeproj = parser.xcodeproj;
+	xcodeproj->mergeProject(root);
+	return xcodeproj;
 }
 
-void PBXBuildFile::syncToMap()
+/*
+ * Applies the targets, configurations and source of the model to a parsed
+ * project. Objects are matched by logical identity: targets by name,
+ * configurations by name and file references by path. Matched objects
+ * keep their ids and user edits, missing ones are created with the same
+ * ids createProject would give them, and objects the model no longer
+ * implies are removed along with build files, file references and groups
+ * left unreferenced. File references under the main group are owned by
+ * the model, while the Products group and other targets are left alone.
+ */
+void Xcodeproj::mergeProject(project_root_ptr root)
 {
-	PBXObject::syncToMap();
+	projectName = root->project_name;
+	configDir = getConfigDir(root);
+	setObjectVersion(root);
+	setParallelBuild(root);
 
-	setId("fileRef", fileRef);
+	auto config = root->get_config("*");
+	auto project = getProject();
+	auto mainGroup = getObject<PBXGroup>(project->mainGroup);
+	auto productsGroup = getObject<PBXGroup>(project->productRefGroup);
+	std::set<std::string> removed;
+
+	// add and remove project configurations
+	syncConfigurations(project->buildConfigurationList, root, removed, [&](std::string config_name) {
+		auto configuration = createProjectConfiguration(root, config_name);
+		setBaseConfiguration(configuration);
+		return configuration;
+	});
+	if (configDir.size() > 0) {
+		for (auto config_name : root->get_config_list()) {
+			addConfigFile(root, config_name);
+		}
+	}
+	bool rebased = false;
+	auto projectConfigurationList = getObject<XCConfigurationList>(project->buildConfigurationList);
+	if (projectConfigurationList) {
+		for (auto &val : projectConfigurationList->buildConfigurations->array_val) {
+			if (val->type() != PBXTypeId) continue;
+			auto configuration = getObject<XCBuildConfiguration>(static_cast<PBXId&>(*val));
+			if (configuration && rebaseProjectConfiguration(root, configuration)) rebased = true;
+		}
+	}
+
+	// match native targets by name and remove those no longer in the model
+	std::vector<XcodeTargetSpec> specs[2] = { target_specs(root, false), target_specs(root, true) };
+	std::map<std::string,XcodeTargetSpec*> specsByName;
+	for (auto &list : specs) {
+		for (auto &spec : list) specsByName[spec.name] = &spec;
+	}
+	std::map<std::string,PBXNativeTargetPtr> existing;
+	for (auto &val : project->targets->array_val) {
+		if (val->type() != PBXTypeId) continue;
+		auto target = getObject<PBXObject>(static_cast<PBXId&>(*val));
+		if (!target || target->type_name() != PBXNativeTarget::type_name) continue;
+		auto nativeTarget = std::static_pointer_cast<PBXNativeTarget>(target);
+		auto si = specsByName.find(nativeTarget->name);
+		auto productRef = getObject<PBXFileReference>(nativeTarget->productReference);
+		if (si != specsByName.end() && productRef && productRef->path.str() == si->second->product) {
+			existing[nativeTarget->name] = nativeTarget;
+		} else {
+			removeNativeTarget(nativeTarget, removed);
+		}
+	}
+	removeIds(project->targets, removed);
+	if (productsGroup) removeIds(productsGroup->children, removed);
+	objects->erase(removed);
+	rebuildIndexes();
+
+	// update or create then link library targets followed by tool targets
+	std::set<std::string> sources;
+	for (auto &list : specs) {
+		std::vector<PBXNativeTargetPtr> targets;
+		std::vector<bool> created;
+		for (auto &spec : list) {
+			auto ti = existing.find(spec.name);
+			if (ti == existing.end()) {
+				auto nativeTarget = createNativeTarget(root, config->vars,
+					spec.name, spec.product, spec.fileType, spec.productType,
+					spec.libraries, spec.source, spec.sourceDir);
+				if (nativeTarget->fileSystemSynchronizedGroups->array_val.size() == 0) {
+					sources.insert(spec.source.begin(), spec.source.end());
+				}
+				targets.push_back(nativeTarget);
+				created.push_back(true);
+				continue;
+			}
+			auto nativeTarget = ti->second;
+			syncConfigurations(nativeTarget->buildConfigurationList, root, removed,
+				[&](std::string config_name) { return createTargetConfiguration(spec.name, config_name); });
+			if (rebased) rebaseTargetConfigurations(nativeTarget->buildConfigurationList);
+			bool synchronized = spec.sourceDir.size() > 0 && objectVersion >= synchronized_groups_version &&
+				syncSynchronizedGroup(nativeTarget, spec.sourceDir, spec.source, removed);
+			if (!synchronized) {
+				syncSynchronizedGroup(nativeTarget, std::string(), spec.source, removed);
+				sources.insert(spec.source.begin(), spec.source.end());
+			}
+			for (auto &val : nativeTarget->buildPhases->array_val) {
+				if (val->type() != PBXTypeId) continue;
+				auto obj = getObject<PBXObject>(static_cast<PBXId&>(*val));
+				if (!obj || obj->type_name() != PBXSourcesBuildPhase::type_name) continue;
+				auto phase = std::static_pointer_cast<PBXSourcesBuildPhase>(obj);
+				std::vector<PBXBuildFilePtr> buildFiles;
+				for (auto sourceFile : synchronized ? std::vector<std::string>() : spec.source) {
+					auto buildFile = getSourceBuildFile(sourceFile);
+					if (buildFile) buildFiles.push_back(buildFile);
+				}
+				syncBuildFiles(phase->files, buildFiles);
+			}
+			targets.push_back(nativeTarget);
+			created.push_back(false);
+		}
+		for (size_t i = 0; i < list.size(); i++) {
+			if (created[i]) {
+				linkNativeTarget(targets[i], list[i].libraries);
+				continue;
+			}
+			std::vector<PBXBuildFilePtr> buildFiles;
+			std::vector<PBXNativeTargetPtr> dependencies;
+			for (std::string library : list[i].libraries) {
+				auto libraryFileRef = getProductReference(library);
+				if (libraryFileRef) {
+					buildFiles.push_back(getBuildFile(libraryFileRef, libraryFileRef->id.comment.str() + " in Frameworks"));
+					auto libraryTarget = getTargetForProduct(libraryFileRef);
+					if (libraryTarget) dependencies.push_back(libraryTarget);
+				}
+			}
+			syncTargetDependencies(targets[i], dependencies, removed);
+			bool linked = false;
+			for (auto &val : targets[i]->buildPhases->array_val) {
+				if (val->type() != PBXTypeId) continue;
+				auto obj = getObject<PBXObject>(static_cast<PBXId&>(*val));
+				if (!obj || obj->type_name() != PBXFrameworksBuildPhase::type_name) continue;
+				auto phase = std::static_pointer_cast<PBXFrameworksBuildPhase>(obj);
+				syncBuildFiles(phase->files, buildFiles);
+				linked = true;
+			}
+			if (!linked) {
+				linkNativeTarget(targets[i], list[i].libraries);
+			}
+		}
+	}
+
+	// remove build files no longer in any phase of any target
+	std::set<std::string> keep, keepGroups;
+	for (auto &val : project->targets->array_val) {
+		if (val->type() != PBXTypeId) continue;
+		auto target = getObject<PBXObject>(static_cast<PBXId&>(*val));
+		PBXArrayPtr syncGroups = target ? objectArray(target, "fileSystemSynchronizedGroups") : PBXArrayPtr();
+		if (syncGroups) {
+			for (auto &groupVal : syncGroups->array_val) {
+				if (groupVal->type() == PBXTypeId) keepGroups.insert(static_cast<PBXId&>(*groupVal).str());
+			}
+		}
+		PBXArrayPtr buildPhases = target ? objectArray(target, "buildPhases") : PBXArrayPtr();
+		if (!buildPhases) continue;
+		for (auto &phaseVal : buildPhases->array_val) {
+			if (phaseVal->type() != PBXTypeId) continue;
+			auto phase = getObject<PBXObject>(static_cast<PBXId&>(*phaseVal));
+			PBXArrayPtr files = phase ? objectArray(phase, "files") : PBXArrayPtr();
+			if (!files) continue;
+			for (auto &fileVal : files->array_val) {
+				if (fileVal->type() == PBXTypeId) keep.insert(static_cast<PBXId&>(*fileVal).str());
+			}
+		}
+	}
+	std::set<std::string> keepRefs(sources);
+	keepRefs.insert(keepGroups.begin(), keepGroups.end());
+	for (auto &obj : getObjectsOfType(PBXBuildFile::type_name)) {
+		auto buildFile = std::static_pointer_cast<PBXBuildFile>(obj);
+		if (keep.count(buildFile->id.str())) {
+			keepRefs.insert(buildFile->fileRef.str());
+		} else {
+			removed.insert(buildFile->id.str());
+		}
+	}
+
+	// keep xcconfig files that configurations are based on
+	for (auto &obj : getObjectsOfType(XCBuildConfiguration::type_name)) {
+		auto configuration = std::static_pointer_cast<XCBuildConfiguration>(obj);
+		if (!(configuration->baseConfigurationReference.id == PBXIdUnion())) {
+			keepRefs.insert(configuration->baseConfigurationReference.str());
+		}
+	}
+
+	// remove file references the model no longer implies and empty groups
+	pruneGroup(mainGroup, "", keepRefs, removed);
+
+	objects->erase(removed);
+	rebuildIndexes();
 }
 
 
-/* PBXBuildRule */
+/* Xcodeproj synchronized groups */
 
-PBXBuildRule::PBXBuildRule()
+/* returns true if path is dir or is under it */
+static bool path_within(const std::string &dir, const std::string &path)
 {
-	outputFiles = std::make_shared<PBXArray>();
+	return path.compare(0, dir.size(), dir) == 0 && (path.size() == dir.size() || path[dir.size()] == '/');
 }
 
-void PBXBuildRule::syncFromMap()
+/* appends the paths of the files under dir relative to it, skipping hidden entries */
+static void list_tree(std::string dir, std::string prefix, std::vector<std::string> &files)
 {
-	PBXObject::syncFromMap();
+	std::vector<directory_entry> entries;
+	util::list_files(entries, dir);
+	for (auto &entry : entries) {
+		if (entry.name.size() == 0 || entry.name[0] == '.') continue;
+		if (entry.type == directory_entry_type_dir) {
+			list_tree(dir + "/" + entry.name, prefix + entry.name + "/", files);
+		} else {
+			files.push_back(prefix + entry.name);
+		}
+	}
+}
 
-	compilerSpec = getString("compilerSpec");
-	filePatterns = getString("filePatterns");
-	type = getString("type");
-	isEditable = getInteger("isEditable");
-	outputFiles = getArray("outputFiles");
-	script = getString("script");
+/*
+ * Synchronized root groups make a source directory one object that Xcode
+ * expands from the file system, in place of a group, file reference and
+ * build file for each source. Targets sharing a directory share its group.
+ * Returns null if the directory nests in or contains another root group,
+ * as a file can only be synchronized by one of them.
+ */
+PBXFileSystemSynchronizedRootGroupPtr Xcodeproj::getSynchronizedGroup(std::string dir)
+{
+	auto project = getProject();
+	auto mainGroup = getObject<PBXGroup>(project->mainGroup);
+	auto group = std::static_pointer_cast<PBXFileSystemSynchronizedRootGroup>
+		(findChild(mainGroup, PBXFileSystemSynchronizedRootGroup::type_name, dir));
+	if (group) {
+		return group;
+	}
+	for (auto &obj : getObjectsOfType(PBXFileSystemSynchronizedRootGroup::type_name)) {
+		std::string path = std::static_pointer_cast<PBXFileSystemSynchronizedRootGroup>(obj)->path;
+		if (path_within(path, dir) || path_within(dir, path)) {
+			return PBXFileSystemSynchronizedRootGroupPtr();
+		}
+	}
+	group = createObject<PBXFileSystemSynchronizedRootGroup>(dir, dir);
+	group->path = dir;
+	group->sourceTree = "<group>";
+	mainGroup->children->addIdRef(group);
+	indexChild(mainGroup, group, group->path);
+	return group;
 }
 
-void PBXBuildRule::syncToMap()
+PBXFileSystemSynchronizedBuildFileExceptionSetPtr Xcodeproj::getExceptionSet(PBXFileSystemSynchronizedRootGroupPtr group,
+	PBXNativeTargetPtr nativeTarget)
 {
-	PBXObject::syncToMap();
+	for (auto &val : group->exceptions->array_val) {
+		if (val->type() != PBXTypeId) continue;
+		auto obj = getObject<PBXObject>(static_cast<PBXId&>(*val));
+		if (obj && obj->type_name() == PBXFileSystemSynchronizedBuildFileExceptionSet::type_name &&
+			std::static_pointer_cast<PBXFileSystemSynchronizedBuildFileExceptionSet>(obj)->target == nativeTarget->id) {
+			return std::static_pointer_cast<PBXFileSystemSynchronizedBuildFileExceptionSet>(obj);
+		}
+	}
+	return PBXFileSystemSynchronizedBuildFileExceptionSetPtr();
+}
+
+/*
+ * Makes the root group of dir the only one of a target, or removes the
+ * target from all root groups when dir is empty. Files under dir that are
+ * not sources of the target are listed in its exception set for the group.
+ */
+bool Xcodeproj::syncSynchronizedGroup(PBXNativeTargetPtr nativeTarget, std::string dir,
+	const std::vector<std::string> &source, std::set<std::string> &removed)
+{
+	PBXFileSystemSynchronizedRootGroupPtr group;
+	if (dir.size() > 0 && !(group = getSynchronizedGroup(dir))) {
+		return false;
+	}
+
+	// remove the target and its exceptions from the root groups of other directories
+	bool present = false;
+	auto &groups = nativeTarget->fileSystemSynchronizedGroups->array_val;
+	groups.erase(std::remove_if(groups.begin(), groups.end(), [&](PBXValuePtr &val) {
+		if (val->type() != PBXTypeId) return false;
+		if (group && static_cast<PBXId&>(*val) == group->id) {
+			present = true;
+			return false;
+		}
+		auto obj = getObject<PBXObject>(static_cast<PBXId&>(*val));
+		if (obj && obj->type_name() == PBXFileSystemSynchronizedRootGroup::type_name) {
+			auto other = std::static_pointer_cast<PBXFileSystemSynchronizedRootGroup>(obj);
+			auto exceptionSet = getExceptionSet(other, nativeTarget);
+			if (exceptionSet) {
+				removed.insert(exceptionSet->id.str());
+				removeIds(other->exceptions, removed);
+				if (other->exceptions->array_val.size() == 0) other->erase({ "exceptions" });
+			}
+		}
+		return true;
+	}), groups.end());
+	if (!group) {
+		if (groups.size() == 0) nativeTarget->erase({ "fileSystemSynchronizedGroups" });
+		return true;
+	}
+	if (!present) {
+		nativeTarget->fileSystemSynchronizedGroups->addIdRef(group);
+	}
+
+	// list files under the directory that are not sources of the target
+	std::set<std::string> members(source.begin(), source.end());
+	std::vector<std::string> files;
+	list_tree(dir, "", files);
+	std::sort(files.begin(), files.end());
+	auto membershipExceptions = std::make_shared<PBXArray>();
+	for (auto &file : files) {
+		if (!members.count(dir + "/" + file)) {
+			membershipExceptions->add(std::make_shared<PBXLiteral>(file));
+		}
+	}
 
-	setString("compilerSpec", compilerSpec);
-	setString("filePatterns", filePatterns);
-	setString("type", type);
-	setInteger("isEditable", isEditable);
-	setArray("outputFiles", outputFiles);
-	setString("script", script);
+	auto exceptionSet = getExceptionSet(group, nativeTarget);
+	if (membershipExceptions->array_val.size() == 0) {
+		if (exceptionSet) {
+			removed.insert(exceptionSet->id.str());
+			removeIds(group->exceptions, removed);
+			if (group->exceptions->array_val.size() == 0) group->erase({ "exceptions" });
+		}
+		return true;
+	}
+	if (!exceptionSet) {
+		exceptionSet = createObject<PBXFileSystemSynchronizedBuildFileExceptionSet>
+			("Exceptions for \"" + dir + "\" folder in \"" + nativeTarget->name.str() + "\" target",
+			nativeTarget->name.str() + "/" + dir);
+		exceptionSet->target = nativeTarget->id;
+		group->exceptions->addIdRef(exceptionSet);
+	}
+	exceptionSet->membershipExceptions = membershipExceptions;
+	return true;
 }
 
 
-/* PBXBuildStyle */
+/* Xcode schemes */
 
-PBXBuildStyle::PBXBuildStyle()
+static std::string xml_escape(const std::string &str)
 {
-	buildSettings = std::make_shared<PBXMap>();
+	std::string out;
+	for (char c : str) {
+		switch (c) {
+			case '&': out += "&amp;"; break;
+			case '<': out += "&lt;"; break;
+			case '>': out += "&gt;"; break;
+			case '"': out += "&quot;"; break;
+			default: out += c; break;
+		}
+	}
+	return out;
+}
+
+static void append_buildable_reference(std::string &buf, const std::string &indent,
+	PBXNativeTargetPtr nativeTarget, const std::string &product, const std::string &container)
+{
+	buf += indent + "<BuildableReference\n";
+	buf += indent + "   BuildableIdentifier = \"primary\"\n";
+	buf += indent + "   BlueprintIdentifier = \"" + nativeTarget->id.str() + "\"\n";
+	buf += indent + "   BuildableName = \"" + xml_escape(product) + "\"\n";
+	buf += indent + "   BlueprintName = \"" + xml_escape(nativeTarget->name) + "\"\n";
+	buf += indent + "   ReferencedContainer = \"container:" + xml_escape(container) + "\">\n";
+	buf += indent + "</BuildableReference>\n";
+}
+
+/*
+ * A shared scheme for each native target. Builds are parallelized and
+ * implicit dependency discovery is off, as every edge between targets in
+ * the project is explicit.
+ */
+static std::string xcscheme(PBXNativeTargetPtr nativeTarget, const std::string &product, const std::string &container)
+{
+	bool runnable = nativeTarget->productType.str() == PBXNativeTarget::type_tool ||
+		nativeTarget->productType.str() == PBXNativeTarget::type_application;
+	std::string buf;
+	buf += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+	buf += "<Scheme\n";
+	buf += "   LastUpgradeVersion = \"0700\"\n";
+	buf += "   version = \"1.3\">\n";
+	buf += "   <BuildAction\n";
+	buf += "      parallelizeBuildables = \"YES\"\n";
+	buf += "      buildImplicitDependencies = \"NO\">\n";
+	buf += "      <BuildActionEntries>\n";
+	buf += "         <BuildActionEntry\n";
+	buf += "            buildForTesting = \"YES\"\n";
+	buf += "            buildForRunning = \"YES\"\n";
+	buf += "            buildForProfiling = \"YES\"\n";
+	buf += "            buildForArchiving = \"YES\"\n";
+	buf += "            buildForAnalyzing = \"YES\">\n";
+	append_buildable_reference(buf, "            ", nativeTarget, product, container);
+	buf += "         </BuildActionEntry>\n";
+	buf += "      </BuildActionEntries>\n";
+	buf += "   </BuildAction>\n";
+	buf += "   <TestAction\n";
+	buf += "      buildConfiguration = \"Debug\"\n";
+	buf += "      selectedDebuggerIdentifier = \"Xcode.DebuggerFoundation.Debugger.LLDB\"\n";
+	buf += "      selectedLauncherIdentifier = \"Xcode.DebuggerFoundation.Launcher.LLDB\"\n";
+	buf += "      shouldUseLaunchSchemeArgsEnv = \"YES\">\n";
+	buf += "      <Testables>\n";
+	buf += "      </Testables>\n";
+	buf += "   </TestAction>\n";
+	buf += "   <LaunchAction\n";
+	buf += "      buildConfiguration = \"Debug\"\n";
+	buf += "      selectedDebuggerIdentifier = \"Xcode.DebuggerFoundation.Debugger.LLDB\"\n";
+	buf += "      selectedLauncherIdentifier = \"Xcode.DebuggerFoundation.Launcher.LLDB\"\n";
+	buf += "      launchStyle = \"0\"\n";
+	buf += "      useCustomWorkingDirectory = \"NO\"\n";
+	buf += "      ignoresPersistentStateOnLaunch = \"NO\"\n";
+	buf += "      debugDocumentVersioning = \"YES\"\n";
+	buf += "      allowLocationSimulation = \"YES\">\n";
+	if (runnable) {
+		buf += "      <BuildableProductRunnable\n";
+		buf += "         runnableDebuggingMode = \"0\">\n";
+		append_buildable_reference(buf, "         ", nativeTarget, product, container);
+		buf += "      </BuildableProductRunnable>\n";
+	}
+	buf += "   </LaunchAction>\n";
+	buf += "   <ProfileAction\n";
+	buf += "      buildConfiguration = \"Release\"\n";
+	buf += "      shouldUseLaunchSchemeArgsEnv = \"YES\"\n";
+	buf += "      useCustomWorkingDirectory = \"NO\"\n";
+	buf += "      debugDocumentVersioning = \"YES\">\n";
+	if (runnable) {
+		buf += "      <BuildableProductRunnable\n";
+		buf += "         runnableDebuggingMode = \"0\">\n";
+		append_buildable_reference(buf, "         ", nativeTarget, product, container);
+		buf += "      </BuildableProductRunnable>\n";
+	}
+	buf += "   </ProfileAction>\n";
+	buf += "   <AnalyzeAction\n";
+	buf += "      buildConfiguration = \"Debug\">\n";
+	buf += "   </AnalyzeAction>\n";
+	buf += "   <ArchiveAction\n";
+	buf += "      buildConfiguration = \"Release\"\n";
+	buf += "      revealArchiveInOrganizer = \"YES\">\n";
+	buf += "   </ArchiveAction>\n";
+	buf += "</Scheme>\n";
+	return buf;
+}
+
+void Xcodeproj::writeSchemes(std::string project_dir)
+{
+	std::string container = util::path_components(project_dir).back();
+	auto project = getProject();
+	for (auto &val : project->targets->array_val) {
+		if (val->type() != PBXTypeId) continue;
+		auto obj = getObject<PBXObject>(static_cast<PBXId&>(*val));
+		if (!obj || obj->type_name() != PBXNativeTarget::type_name) continue;
+		auto nativeTarget = std::static_pointer_cast<PBXNativeTarget>(obj);
+		auto productRef = getObject<PBXFileReference>(nativeTarget->productReference);
+		std::string product = productRef ? productRef->path.str() : nativeTarget->name.str();
+		std::string scheme_file = project_dir + "/xcshareddata/xcschemes/" + nativeTarget->name.str() + ".xcscheme";
+		trace_scope trace("write", scheme_file);
+		util::make_directories(scheme_file);
+		util::write_file_if_changed(scheme_file, xcscheme(nativeTarget, product, container));
+	}
 }
 
-void PBXBuildStyle::syncFromMap()
+
+/* Xcworkspace */
+
+const std::string Xcworkspace::projects_dir = "xcode";
+
+XcworkspacePtr Xcworkspace::createWorkspace(project_root_ptr root)
 {
-	PBXObject::syncFromMap();
+	trace_scope trace("materialize", "xcworkspace");
 
-	buildSettings = getMap("buildSettings");
-	name = getString("name");
+	// collect the library and tool targets
+	auto config = root->get_config("*");
+	std::vector<XcodeTargetSpec> specs = target_specs(root, false);
+	std::vector<XcodeTargetSpec> tool_specs = target_specs(root, true);
+	specs.insert(specs.end(), tool_specs.begin(), tool_specs.end());
+	std::map<std::string,const XcodeTargetSpec*> productSpecs;
+	std::set<std::string> names;
+	for (auto &spec : specs) {
+		if (!names.insert(spec.name).second) {
+			log_fatal_exit("duplicate target name in workspace: %s", spec.name.c_str());
+		}
+		productSpecs[spec.product] = &spec;
+	}
+
+	// create a project for each target
+	XcworkspacePtr workspace = std::make_shared<Xcworkspace>();
+	workspace->projects.resize(specs.size());
+	util::parallel_for(specs.size(), [&](size_t i) {
+		const XcodeTargetSpec &spec = specs[i];
+		XcodeprojPtr xcodeproj = std::make_shared<Xcodeproj>();
+		xcodeproj->createEmptyProject(root, spec.name);
+		xcodeproj->getProject()->projectDirPath = "..";
+		auto nativeTarget = xcodeproj->createNativeTarget(root, config->vars,
+			spec.name, spec.product, spec.fileType, spec.productType,
+			spec.libraries, spec.source, spec.sourceDir);
+		auto frameworkBuildPhase = xcodeproj->linkNativeTarget(nativeTarget, std::vector<std::string>());
+		for (auto library : spec.libraries) {
+			auto pi = productSpecs.find(library);
+			if (pi == productSpecs.end()) continue;
+			const XcodeTargetSpec &lib = *pi->second;
+			xcodeproj->linkProjectReference(nativeTarget, frameworkBuildPhase,
+				projects_dir + "/" + lib.name + ".xcodeproj", lib.name, lib.product, lib.fileType);
+		}
+		workspace->projects[i] = xcodeproj;
+	});
+
+	return workspace;
 }
 
-void PBXBuildStyle::syncToMap()
+void Xcworkspace::write(project_root_ptr root)
 {
-	PBXObject::syncToMap();
+	std::string workspace_file = root->project_name + ".xcworkspace/contents.xcworkspacedata";
+	trace_scope trace("write", workspace_file);
+
+	// write the projects, leaving unchanged files untouched
+	util::parallel_for(projects.size(), [&](size_t i) {
+		std::string project_dir = projects_dir + "/" + projects[i]->projectName + ".xcodeproj";
+		projects[i]->write(project_dir + "/project.pbxproj");
+		projects[i]->writeSchemes(project_dir);
+	});
 
-	setMap("buildSettings", buildSettings);
-	setString("name", name);
+	// the xcconfig files are the same for every project
+	if (projects.size() > 0) {
+		projects[0]->writeConfigFiles();
+	}
+
+	// write the workspace
+	std::string buf;
+	buf += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+	buf += "<Workspace\n";
+	buf += "   version = \"1.0\">\n";
+	for (auto &xcodeproj : projects) {
+		buf += "   <FileRef\n";
+		buf += "      location = \"group:" + xml_escape(projects_dir + "/" + xcodeproj->projectName + ".xcodeproj") + "\">\n";
+		buf += "   </FileRef>\n";
+	}
+	buf += "</Workspace>\n";
+	util::make_directories(workspace_file);
+	util::write_file_if_changed(workspace_file, buf);
 }
 
 
-/* PBXContainerItemProxy */
+/* PBXAggregateTarget */
 
-PBXContainerItemProxy::PBXContainerItemProxy()
+PBXAggregateTarget::PBXAggregateTarget()
 {
+	buildPhases = std::make_shared<PBXArray>();
+	dependencies = std::make_shared<PBXArray>();
+}
+
+static constexpr PBXField<PBXAggregateTarget> pbx_aggregate_target_fields[] = {
+	{ "buildConfigurationList", &PBXAggregateTarget::buildConfigurationList },
+	{ "buildPhases", &PBXAggregateTarget::buildPhases },
+	{ "dependencies", &PBXAggregateTarget::dependencies },
+	{ "name", &PBXAggregateTarget::name },
+	{ "productName", &PBXAggregateTarget::productName },
+};
+
+const PBXFieldTable<PBXAggregateTarget> PBXAggregateTarget::fields(pbx_aggregate_target_fields);
+
 
+/* PBXAppleScriptBuildPhase */
+
+PBXAppleScriptBuildPhase::PBXAppleScriptBuildPhase()
+{
+	files = std::make_shared<PBXArray>();
 }
 
-void PBXContainerItemProxy::syncFromMap()
+static constexpr PBXField<PBXAppleScriptBuildPhase> pbx_apple_script_build_phase_fields[] = {
+	{ "buildActionMask", &PBXAppleScriptBuildPhase::buildActionMask },
+	{ "files", &PBXAppleScriptBuildPhase::files },
+	{ "runOnlyForDeploymentPostprocessing", &PBXAppleScriptBuildPhase::runOnlyForDeploymentPostprocessing },
+};
+
+const PBXFieldTable<PBXAppleScriptBuildPhase> PBXAppleScriptBuildPhase::fields(pbx_apple_script_build_phase_fields);
+
+
+/* PBXBuildFile */
+
+PBXBuildFile::PBXBuildFile()
 {
-	PBXObject::syncFromMap();
 
-	containerPortal = getId("containerPortal");
-	proxyType = getInteger("proxyType");
-	remoteGlobalIDString = getId("remoteGlobalIDString");
-	remoteInfo = getString("remoteInfo");
 }
 
-void PBXContainerItemProxy::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<PBXBuildFile> pbx_build_file_fields[] = {
+	{ "fileRef", &PBXBuildFile::fileRef },
+};
+
+const PBXFieldTable<PBXBuildFile> PBXBuildFile::fields(pbx_build_file_fields);
+
 
-	setId("containerPortal", containerPortal);
-	setInteger("proxyType", proxyType);
-	setId("remoteGlobalIDString", remoteGlobalIDString);
-	setString("remoteInfo", remoteInfo);
+/* PBXBuildRule */
+
+PBXBuildRule::PBXBuildRule()
+{
+	outputFiles = std::make_shared<PBXArray>();
 }
 
+static constexpr PBXField<PBXBuildRule> pbx_build_rule_fields[] = {
+	{ "compilerSpec", &PBXBuildRule::compilerSpec },
+	{ "filePatterns", &PBXBuildRule::filePatterns },
+	{ "type", &PBXBuildRule::type },
+	{ "isEditable", &PBXBuildRule::isEditable },
+	{ "outputFiles", &PBXBuildRule::outputFiles },
+	{ "script", &PBXBuildRule::script },
+};
 
-/* PBXCopyFilesBuildPhase */
+const PBXFieldTable<PBXBuildRule> PBXBuildRule::fields(pbx_build_rule_fields);
 
-PBXCopyFilesBuildPhase::PBXCopyFilesBuildPhase()
+
+/* PBXBuildStyle */
+
+PBXBuildStyle::PBXBuildStyle()
 {
-	files = std::make_shared<PBXArray>();
+	buildSettings = std::make_shared<PBXMap>();
 }
 
-void PBXCopyFilesBuildPhase::syncFromMap()
+static constexpr PBXField<PBXBuildStyle> pbx_build_style_fields[] = {
+	{ "buildSettings", &PBXBuildStyle::buildSettings },
+	{ "name", &PBXBuildStyle::name },
+};
+
+const PBXFieldTable<PBXBuildStyle> PBXBuildStyle::fields(pbx_build_style_fields);
+
+
+/* PBXContainerItemProxy */
+
+PBXContainerItemProxy::PBXContainerItemProxy()
 {
-	PBXObject::syncFromMap();
 
-	buildActionMask = getInteger("buildActionMask");
-	dstPath = getString("dstPath");
-	dstSubfolderSpec = getInteger("dstSubfolderSpec");
-	files = getArray("files");
-	runOnlyForDeploymentPostprocessing = getInteger("runOnlyForDeploymentPostprocessing");
 }
 
-void PBXCopyFilesBuildPhase::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<PBXContainerItemProxy> pbx_container_item_proxy_fields[] = {
+	{ "containerPortal", &PBXContainerItemProxy::containerPortal },
+	{ "proxyType", &PBXContainerItemProxy::proxyType },
+	{ "remoteGlobalIDString", &PBXContainerItemProxy::remoteGlobalIDString },
+	{ "remoteInfo", &PBXContainerItemProxy::remoteInfo },
+};
 
-	setInteger("buildActionMask", buildActionMask);	
-	if (dstPath.length() > 0) {
-		setString("dstPath", dstPath);
-	}
-	setInteger("dstSubfolderSpec", dstSubfolderSpec);
-	setArray("files", files);
-	setInteger("runOnlyForDeploymentPostprocessing", runOnlyForDeploymentPostprocessing);
+const PBXFieldTable<PBXContainerItemProxy> PBXContainerItemProxy::fields(pbx_container_item_proxy_fields);
+
+
+/* PBXCopyFilesBuildPhase */
+
+PBXCopyFilesBuildPhase::PBXCopyFilesBuildPhase()
+{
+	files = std::make_shared<PBXArray>();
 }
 
+static constexpr PBXField<PBXCopyFilesBuildPhase> pbx_copy_files_build_phase_fields[] = {
+	{ "buildActionMask", &PBXCopyFilesBuildPhase::buildActionMask },
+	{ "dstPath", &PBXCopyFilesBuildPhase::dstPath, PBXFieldOmitEmpty },
+	{ "dstSubfolderSpec", &PBXCopyFilesBuildPhase::dstSubfolderSpec },
+	{ "files", &PBXCopyFilesBuildPhase::files },
+	{ "runOnlyForDeploymentPostprocessing", &PBXCopyFilesBuildPhase::runOnlyForDeploymentPostprocessing },
+};
+
+const PBXFieldTable<PBXCopyFilesBuildPhase> PBXCopyFilesBuildPhase::fields(pbx_copy_files_build_phase_fields);
+
 
 /* PBXFileReference */
 
@@ -944,6 +2255,8 @@ const std::string PBXFileReference::type_application      = "wrapper.application
 const std::string PBXFileReference::type_bundle           = "wrapper.cfbundle";
 const std::string PBXFileReference::type_framework        = "wrapper.framework";
 const std::string PBXFileReference::type_executable       = "compiled.mach-o.executable";
+const std::string PBXFileReference::type_project          = "wrapper.pb-project";
+const std::string PBXFileReference::type_xcconfig         = "text.xcconfig";
 
 bool PBXFileReference::extTypeMapInit = false;
 std::map<std::string,FileTypeMetaData*> PBXFileReference::extTypeMap;
@@ -978,7 +2291,8 @@ FileTypeMetaData* PBXFileReference::getFileMetaForPath(std::string path)
 
 FileTypeMetaData* PBXFileReference::getFileMetaForExtension(std::string extension)
 {
-	if (!extTypeMapInit) {
+	static std::once_flag extTypeMapOnce;
+	std::call_once(extTypeMapOnce, [] {
 		FileTypeMetaData *meta = typeMetaData;
 		while (meta->flags != FileTypeNone) {
 			for (std::string ext : meta->extensions) {
@@ -987,44 +2301,59 @@ FileTypeMetaData* PBXFileReference::getFileMetaForExtension(std::string extensio
 			meta++;
 		}
 		extTypeMapInit = true;
-	};
+	});
 	auto it = extTypeMap.find(extension);
 	return (it != extTypeMap.end()) ? it->second : nullptr;
 }
 
-PBXFileReference::PBXFileReference()
+PBXFileReference::PBXFileReference() : includeInIndex(1)
 {
 
 }
 
-void PBXFileReference::syncFromMap()
-{
-	PBXObject::syncFromMap();
+static constexpr PBXField<PBXFileReference> pbx_file_reference_fields[] = {
+	{ "explicitFileType", &PBXFileReference::explicitFileType, PBXFieldOmitEmpty },
+	{ "lastKnownFileType", &PBXFileReference::lastKnownFileType, PBXFieldOmitEmpty },
+	{ "includeInIndex", &PBXFileReference::includeInIndex, PBXFieldOmitNonZero, 1 },
+	{ "path", &PBXFileReference::path },
+	{ "sourceTree", &PBXFileReference::sourceTree },
+};
+
+const PBXFieldTable<PBXFileReference> PBXFileReference::fields(pbx_file_reference_fields);
 
-	explicitFileType = getString("explicitFileType");
-	lastKnownFileType = getString("lastKnownFileType");
-	includeInIndex = getInteger("includeInIndex", 1);
-	path = getString("path");
-	sourceTree = getString("sourceTree");
-}
 
-void PBXFileReference::syncToMap()
+/* PBXFileSystemSynchronizedBuildFileExceptionSet */
+
+PBXFileSystemSynchronizedBuildFileExceptionSet::PBXFileSystemSynchronizedBuildFileExceptionSet()
 {
-	PBXObject::syncToMap();
+	membershipExceptions = std::make_shared<PBXArray>();
+}
 
-	if (explicitFileType.length() > 0) {
-		setString("explicitFileType", explicitFileType);
-	}
-	if (lastKnownFileType.length() > 0) {
-		setString("lastKnownFileType", lastKnownFileType);
-	}
-	if (includeInIndex == 0) {
-		setInteger("includeInIndex", includeInIndex);
-	}
-	setString("path", path);
-	setString("sourceTree", sourceTree);
+static constexpr PBXField<PBXFileSystemSynchronizedBuildFileExceptionSet> pbx_file_system_synchronized_build_file_exception_set_fields[] = {
+	{ "membershipExceptions", &PBXFileSystemSynchronizedBuildFileExceptionSet::membershipExceptions },
+	{ "target", &PBXFileSystemSynchronizedBuildFileExceptionSet::target },
+};
+
+const PBXFieldTable<PBXFileSystemSynchronizedBuildFileExceptionSet> PBXFileSystemSynchronizedBuildFileExceptionSet::fields
+	(pbx_file_system_synchronized_build_file_exception_set_fields);
+
+
+/* PBXFileSystemSynchronizedRootGroup */
+
+PBXFileSystemSynchronizedRootGroup::PBXFileSystemSynchronizedRootGroup()
+{
+	exceptions = std::make_shared<PBXArray>();
 }
 
+static constexpr PBXField<PBXFileSystemSynchronizedRootGroup> pbx_file_system_synchronized_root_group_fields[] = {
+	{ "exceptions", &PBXFileSystemSynchronizedRootGroup::exceptions, PBXFieldOmitEmpty },
+	{ "path", &PBXFileSystemSynchronizedRootGroup::path },
+	{ "sourceTree", &PBXFileSystemSynchronizedRootGroup::sourceTree },
+};
+
+const PBXFieldTable<PBXFileSystemSynchronizedRootGroup> PBXFileSystemSynchronizedRootGroup::fields
+	(pbx_file_system_synchronized_root_group_fields);
+
 
 /* PBXFrameworksBuildPhase */
 
@@ -1033,23 +2362,13 @@ PBXFrameworksBuildPhase::PBXFrameworksBuildPhase()
 	files = std::make_shared<PBXArray>();
 }
 
-void PBXFrameworksBuildPhase::syncFromMap()
-{
-	PBXObject::syncFromMap();
-
-	buildActionMask = getInteger("buildActionMask");
-	files = getArray("files");
-	runOnlyForDeploymentPostprocessing = getInteger("runOnlyForDeploymentPostprocessing");
-}
-
-void PBXFrameworksBuildPhase::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<PBXFrameworksBuildPhase> pbx_frameworks_build_phase_fields[] = {
+	{ "buildActionMask", &PBXFrameworksBuildPhase::buildActionMask },
+	{ "files", &PBXFrameworksBuildPhase::files },
+	{ "runOnlyForDeploymentPostprocessing", &PBXFrameworksBuildPhase::runOnlyForDeploymentPostprocessing },
+};
 
-	setInteger("buildActionMask", buildActionMask);	
-	setArray("files", files);
-	setInteger("runOnlyForDeploymentPostprocessing", runOnlyForDeploymentPostprocessing);
-}
+const PBXFieldTable<PBXFrameworksBuildPhase> PBXFrameworksBuildPhase::fields(pbx_frameworks_build_phase_fields);
 
 
 /* PBXGroup */
@@ -1059,58 +2378,58 @@ PBXGroup::PBXGroup()
 	children = std::make_shared<PBXArray>();
 }
 
-void PBXGroup::syncFromMap()
-{
-	PBXObject::syncFromMap();
+static constexpr PBXField<PBXGroup> pbx_group_fields[] = {
+	{ "children", &PBXGroup::children },
+	{ "name", &PBXGroup::name, PBXFieldOmitEmpty },
+	{ "path", &PBXGroup::path, PBXFieldOmitEmpty },
+	{ "sourceTree", &PBXGroup::sourceTree },
+};
 
-	children = getArray("children");
-	name = getString("name");
-	path = getString("path");
-	sourceTree = getString("sourceTree");
-}
+const PBXFieldTable<PBXGroup> PBXGroup::fields(pbx_group_fields);
 
-void PBXGroup::syncToMap()
+void PBXGroup::prepareWrite()
 {
-	PBXObject::syncToMap();
-
 	sortChildren();
-
-	setArray("children", children);
-	if (name.length() > 0) {
-		setString("name", name);
-	}
-	if (path.length() > 0) {
-		setString("path", path);
-	}
-	setString("sourceTree", sourceTree);
 }
 
+/*
+ * Child names are resolved once up front rather than in every
+ * comparison; the comparisons and hence the order are unchanged.
+ */
+struct PBXGroupSortChild
+{
+	bool is_id;
+	const std::string *name;
+	PBXValuePtr val;
+};
+
 void PBXGroup::sortChildren()
 {
 	if (!xcodeproj) return;
-	sort(children->array_val.begin(), children->array_val.end(), 
-			[&](const PBXValuePtr &a, const PBXValuePtr &b)
-	{ 
-		if (a->type() != PBXTypeId || b->type() != PBXTypeId) return false;
-		auto aId = std::static_pointer_cast<PBXId>(a);
-		auto bId = std::static_pointer_cast<PBXId>(b);
-		auto aObj = xcodeproj->getObject<PBXObject>(*aId);
-		auto bObj = xcodeproj->getObject<PBXObject>(*bId);
-		std::string aName, bName;
-		if (aObj->type_name() == PBXGroup::type_name) {
-			aName = std::static_pointer_cast<PBXGroup>(aObj)->name;
-		}
-		else if (aObj->type_name() == PBXFileReference::type_name) {
-			aName = std::static_pointer_cast<PBXFileReference>(aObj)->path;
-		}
-		if (bObj->type_name() == PBXGroup::type_name) {
-			bName = std::static_pointer_cast<PBXGroup>(bObj)->name;
-		}
-		else if (bObj->type_name() == PBXFileReference::type_name) {
-			bName = std::static_pointer_cast<PBXFileReference>(bObj)->path;
-		}
-		return aName < bName; 
+	std::vector<PBXGroupSortChild> sorted;
+	sorted.reserve(children->array_val.size());
+	for (const PBXValuePtr &val : children->array_val) {
+		PBXGroupSortChild child = { val->type() == PBXTypeId, &PBXAtom::empty, val };
+		auto obj = child.is_id ? xcodeproj->getObject<PBXObject>(static_cast<PBXId&>(*val)) : PBXObjectPtr();
+		if (obj && obj->type_name() == PBXGroup::type_name) {
+			child.name = &std::static_pointer_cast<PBXGroup>(obj)->name.str();
+		}
+		else if (obj && obj->type_name() == PBXFileReference::type_name) {
+			child.name = &std::static_pointer_cast<PBXFileReference>(obj)->path.str();
+		}
+		else if (obj && obj->type_name() == PBXFileSystemSynchronizedRootGroup::type_name) {
+			child.name = &std::static_pointer_cast<PBXFileSystemSynchronizedRootGroup>(obj)->path.str();
+		}
+		sorted.push_back(child);
+	}
+	sort(sorted.begin(), sorted.end(), [](const PBXGroupSortChild &a, const PBXGroupSortChild &b)
+	{
+		if (!a.is_id || !b.is_id) return false;
+		return *a.name < *b.name;
 	});
+	for (size_t i = 0; i < sorted.size(); i++) {
+		children->array_val[i] = std::move(sorted[i].val);
+	}
 }
 
 
@@ -1121,60 +2440,35 @@ PBXHeadersBuildPhase::PBXHeadersBuildPhase()
 	files = std::make_shared<PBXArray>();
 }
 
-void PBXHeadersBuildPhase::syncFromMap()
-{
-	PBXObject::syncFromMap();
-
-	buildActionMask = getInteger("buildActionMask");
-	files = getArray("files");
-	runOnlyForDeploymentPostprocessing = getInteger("runOnlyForDeploymentPostprocessing");
-}
-
-void PBXHeadersBuildPhase::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<PBXHeadersBuildPhase> pbx_headers_build_phase_fields[] = {
+	{ "buildActionMask", &PBXHeadersBuildPhase::buildActionMask },
+	{ "files", &PBXHeadersBuildPhase::files },
+	{ "runOnlyForDeploymentPostprocessing", &PBXHeadersBuildPhase::runOnlyForDeploymentPostprocessing },
+};
 
-	setInteger("buildActionMask", buildActionMask);	
-	setArray("files", files);
-	setInteger("runOnlyForDeploymentPostprocessing", runOnlyForDeploymentPostprocessing);
-}
+const PBXFieldTable<PBXHeadersBuildPhase> PBXHeadersBuildPhase::fields(pbx_headers_build_phase_fields);
 
 
 /* PBXLegacyTarget */
 
 PBXLegacyTarget::PBXLegacyTarget()
-{
-	buildPhases = std::make_shared<PBXArray>();
-	dependencies = std::make_shared<PBXArray>();
-}
-
-void PBXLegacyTarget::syncFromMap()
-{
-	PBXObject::syncFromMap();
-
-	buildArgumentsString = getString("buildArgumentsString");
-	buildConfigurationList = getId("buildConfigurationList");
-	buildPhases = getArray("buildPhases");
-	buildToolPath = getString("buildToolPath");
-	dependencies = getArray("dependencies");
-	name = getString("name");
-	passBuildSettingsInEnvironment = getInteger("passBuildSettingsInEnvironment");
-	productName = getString("productName");
+{
+	buildPhases = std::make_shared<PBXArray>();
+	dependencies = std::make_shared<PBXArray>();
 }
 
-void PBXLegacyTarget::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<PBXLegacyTarget> pbx_legacy_target_fields[] = {
+	{ "buildArgumentsString", &PBXLegacyTarget::buildArgumentsString },
+	{ "buildConfigurationList", &PBXLegacyTarget::buildConfigurationList },
+	{ "buildPhases", &PBXLegacyTarget::buildPhases },
+	{ "buildToolPath", &PBXLegacyTarget::buildToolPath },
+	{ "dependencies", &PBXLegacyTarget::dependencies },
+	{ "name", &PBXLegacyTarget::name },
+	{ "passBuildSettingsInEnvironment", &PBXLegacyTarget::passBuildSettingsInEnvironment },
+	{ "productName", &PBXLegacyTarget::productName },
+};
 
-	setString("buildArgumentsString", buildArgumentsString);
-	setId("buildConfigurationList", buildConfigurationList);
-	setArray("buildPhases", buildPhases);
-	setString("buildToolPath", buildToolPath);
-	setArray("dependencies", dependencies);
-	setString("name", name);
-	setInteger("passBuildSettingsInEnvironment", passBuildSettingsInEnvironment);
-	setString("productName", productName);
-}
+const PBXFieldTable<PBXLegacyTarget> PBXLegacyTarget::fields(pbx_legacy_target_fields);
 
 
 /* PBXNativeTarget */
@@ -1191,35 +2485,23 @@ PBXNativeTarget::PBXNativeTarget()
 	buildPhases = std::make_shared<PBXArray>();
 	buildRules = std::make_shared<PBXArray>();
 	dependencies = std::make_shared<PBXArray>();
-}
-
-void PBXNativeTarget::syncFromMap()
-{
-	PBXObject::syncFromMap();
-
-	buildConfigurationList = getId("buildConfigurationList");
-	buildPhases = getArray("buildPhases");
-	buildRules = getArray("buildRules");
-	dependencies = getArray("dependencies");
-	name = getString("name");
-	productName = getString("productName");
-	productReference = getId("productReference");
-	productType = getString("productType");
-}
+	fileSystemSynchronizedGroups = std::make_shared<PBXArray>();
+}
+
+static constexpr PBXField<PBXNativeTarget> pbx_native_target_fields[] = {
+	{ "buildConfigurationList", &PBXNativeTarget::buildConfigurationList },
+	{ "buildPhases", &PBXNativeTarget::buildPhases },
+	{ "buildRules", &PBXNativeTarget::buildRules },
+	{ "dependencies", &PBXNativeTarget::dependencies },
+	{ "fileSystemSynchronizedGroups", &PBXNativeTarget::fileSystemSynchronizedGroups, PBXFieldOmitEmpty },
+	{ "name", &PBXNativeTarget::name },
+	{ "productName", &PBXNativeTarget::productName },
+	{ "productReference", &PBXNativeTarget::productReference },
+	{ "productType", &PBXNativeTarget::productType },
+};
 
-void PBXNativeTarget::syncToMap()
-{
-	PBXObject::syncToMap();
+const PBXFieldTable<PBXNativeTarget> PBXNativeTarget::fields(pbx_native_target_fields);
 
-	setId("buildConfigurationList", buildConfigurationList);
-	setArray("buildPhases", buildPhases);
-	setArray("buildRules", buildRules);
-	setArray("dependencies", dependencies);
-	setString("name", name);
-	setString("productName", productName);
-	setId("productReference", productReference);
-	setString("productType", productType);
-}
 
 /* PBXProject */
 
@@ -1231,45 +2513,28 @@ PBXProject::PBXProject()
 	hasScannedForEncodings = 0;
 	knownRegions = std::make_shared<PBXArray>();
 	knownRegions->add(std::make_shared<PBXLiteral>("en"));
+	preferredProjectObjectVersion = 0;
 	projectReferences = std::make_shared<PBXArray>();
 	targets = std::make_shared<PBXArray>();
 }
 
-void PBXProject::syncFromMap()
-{
-	PBXObject::syncFromMap();
-
-	attributes = getMap("attributes");
-	buildConfigurationList = getId("buildConfigurationList");
-	compatibilityVersion = getString("compatibilityVersion");
-	developmentRegion = getString("developmentRegion");
-	hasScannedForEncodings = getInteger("hasScannedForEncodings");
-	knownRegions = getArray("knownRegions");
-	mainGroup = getId("mainGroup");
-	productRefGroup = getId("productRefGroup");
-	projectReferences = getArray("projectReferences");
-	projectDirPath = getString("projectDirPath");
-	projectRoot = getString("projectRoot");
-	targets = getArray("targets");
-}
-
-void PBXProject::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<PBXProject> pbx_project_fields[] = {
+	{ "attributes", &PBXProject::attributes },
+	{ "buildConfigurationList", &PBXProject::buildConfigurationList },
+	{ "compatibilityVersion", &PBXProject::compatibilityVersion, PBXFieldOmitEmpty },
+	{ "developmentRegion", &PBXProject::developmentRegion },
+	{ "hasScannedForEncodings", &PBXProject::hasScannedForEncodings },
+	{ "knownRegions", &PBXProject::knownRegions },
+	{ "mainGroup", &PBXProject::mainGroup },
+	{ "preferredProjectObjectVersion", &PBXProject::preferredProjectObjectVersion, PBXFieldOmitZero },
+	{ "productRefGroup", &PBXProject::productRefGroup },
+	{ "projectDirPath", &PBXProject::projectDirPath },
+	{ "projectReferences", &PBXProject::projectReferences },
+	{ "projectRoot", &PBXProject::projectRoot },
+	{ "targets", &PBXProject::targets },
+};
 
-	setMap("attributes", attributes);
-	setId("buildConfigurationList", buildConfigurationList);
-	setString("compatibilityVersion", compatibilityVersion);
-	setString("developmentRegion", developmentRegion);
-	setInteger("hasScannedForEncodings", hasScannedForEncodings);
-	setArray("knownRegions", knownRegions);
-	setId("mainGroup", mainGroup);
-	setId("productRefGroup", productRefGroup);
-	setString("projectDirPath", projectDirPath);
-	setArray("projectReferences", projectReferences);
-	setString("projectRoot", projectRoot);
-	setArray("targets", targets);
-}
+const PBXFieldTable<PBXProject> PBXProject::fields(pbx_project_fields);
 
 
 /* PBXReferenceProxy */
@@ -1279,25 +2544,14 @@ PBXReferenceProxy::PBXReferenceProxy()
 
 }
 
-void PBXReferenceProxy::syncFromMap()
-{
-	PBXObject::syncFromMap();
-
-	type = getString("type");
-	path = getString("path");
-	remoteRef = getId("remoteRef");
-	sourceTree = getString("sourceTree");
-}
-
-void PBXReferenceProxy::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<PBXReferenceProxy> pbx_reference_proxy_fields[] = {
+	{ "fileType", &PBXReferenceProxy::fileType },
+	{ "path", &PBXReferenceProxy::path },
+	{ "remoteRef", &PBXReferenceProxy::remoteRef },
+	{ "sourceTree", &PBXReferenceProxy::sourceTree },
+};
 
-	setString("type", type);
-	setString("path", path);
-	setId("remoteRef", remoteRef);
-	setString("sourceTree", sourceTree);
-}
+const PBXFieldTable<PBXReferenceProxy> PBXReferenceProxy::fields(pbx_reference_proxy_fields);
 
 
 /* PBXResourcesBuildPhase */
@@ -1307,23 +2561,13 @@ PBXResourcesBuildPhase::PBXResourcesBuildPhase()
 	files = std::make_shared<PBXArray>();
 }
 
-void PBXResourcesBuildPhase::syncFromMap()
-{
-	PBXObject::syncFromMap();
-
-	buildActionMask = getInteger("buildActionMask");
-	files = getArray("files");
-	runOnlyForDeploymentPostprocessing = getInteger("runOnlyForDeploymentPostprocessing");
-}
-
-void PBXResourcesBuildPhase::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<PBXResourcesBuildPhase> pbx_resources_build_phase_fields[] = {
+	{ "buildActionMask", &PBXResourcesBuildPhase::buildActionMask },
+	{ "files", &PBXResourcesBuildPhase::files },
+	{ "runOnlyForDeploymentPostprocessing", &PBXResourcesBuildPhase::runOnlyForDeploymentPostprocessing },
+};
 
-	setInteger("buildActionMask", buildActionMask);	
-	setArray("files", files);
-	setInteger("runOnlyForDeploymentPostprocessing", runOnlyForDeploymentPostprocessing);
-}
+const PBXFieldTable<PBXResourcesBuildPhase> PBXResourcesBuildPhase::fields(pbx_resources_build_phase_fields);
 
 
 /* PBXShellScriptBuildPhase */
@@ -1335,31 +2579,17 @@ PBXShellScriptBuildPhase::PBXShellScriptBuildPhase()
 	outputPaths = std::make_shared<PBXArray>();
 }
 
-void PBXShellScriptBuildPhase::syncFromMap()
-{
-	PBXObject::syncFromMap();
-
-	buildActionMask = getInteger("buildActionMask");
-	files = getArray("files");
-	inputPaths = getArray("inputPaths");
-	outputPaths = getArray("outputPaths");
-	runOnlyForDeploymentPostprocessing = getInteger("runOnlyForDeploymentPostprocessing");
-	shellPath = getString("shellPath");
-	shellScript = getString("shellScript");
-}
-
-void PBXShellScriptBuildPhase::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<PBXShellScriptBuildPhase> pbx_shell_script_build_phase_fields[] = {
+	{ "buildActionMask", &PBXShellScriptBuildPhase::buildActionMask },
+	{ "files", &PBXShellScriptBuildPhase::files },
+	{ "inputPaths", &PBXShellScriptBuildPhase::inputPaths },
+	{ "outputPaths", &PBXShellScriptBuildPhase::outputPaths },
+	{ "runOnlyForDeploymentPostprocessing", &PBXShellScriptBuildPhase::runOnlyForDeploymentPostprocessing },
+	{ "shellPath", &PBXShellScriptBuildPhase::shellPath },
+	{ "shellScript", &PBXShellScriptBuildPhase::shellScript },
+};
 
-	setInteger("buildActionMask", buildActionMask);	
-	setArray("files", files);
-	setArray("inputPaths", inputPaths);
-	setArray("outputPaths", outputPaths);
-	setInteger("runOnlyForDeploymentPostprocessing", runOnlyForDeploymentPostprocessing);
-	setString("shellPath", shellPath);
-	setString("shellScript", shellScript);
-}
+const PBXFieldTable<PBXShellScriptBuildPhase> PBXShellScriptBuildPhase::fields(pbx_shell_script_build_phase_fields);
 
 
 /* PBXSourcesBuildPhase */
@@ -1369,23 +2599,13 @@ PBXSourcesBuildPhase::PBXSourcesBuildPhase()
 	files = std::make_shared<PBXArray>();
 }
 
-void PBXSourcesBuildPhase::syncFromMap()
-{
-	PBXObject::syncFromMap();
-
-	buildActionMask = getInteger("buildActionMask");
-	files = getArray("files");
-	runOnlyForDeploymentPostprocessing = getInteger("runOnlyForDeploymentPostprocessing");
-}
-
-void PBXSourcesBuildPhase::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<PBXSourcesBuildPhase> pbx_sources_build_phase_fields[] = {
+	{ "buildActionMask", &PBXSourcesBuildPhase::buildActionMask },
+	{ "files", &PBXSourcesBuildPhase::files },
+	{ "runOnlyForDeploymentPostprocessing", &PBXSourcesBuildPhase::runOnlyForDeploymentPostprocessing },
+};
 
-	setInteger("buildActionMask", buildActionMask);	
-	setArray("files", files);
-	setInteger("runOnlyForDeploymentPostprocessing", runOnlyForDeploymentPostprocessing);
-}
+const PBXFieldTable<PBXSourcesBuildPhase> PBXSourcesBuildPhase::fields(pbx_sources_build_phase_fields);
 
 
 /* PBXTargetDependency */
@@ -1395,21 +2615,13 @@ PBXTargetDependency::PBXTargetDependency()
 
 }
 
-void PBXTargetDependency::syncFromMap()
-{
-	PBXObject::syncFromMap();
-
-	target = getId("target");
-	targetProxy = getId("targetProxy");
-}
-
-void PBXTargetDependency::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<PBXTargetDependency> pbx_target_dependency_fields[] = {
+	{ "name", &PBXTargetDependency::name, PBXFieldOmitEmpty },
+	{ "target", &PBXTargetDependency::target, PBXFieldOmitEmpty },
+	{ "targetProxy", &PBXTargetDependency::targetProxy },
+};
 
-	setId("target", target);
-	setId("targetProxy", targetProxy);
-}
+const PBXFieldTable<PBXTargetDependency> PBXTargetDependency::fields(pbx_target_dependency_fields);
 
 
 /* PBXVariantGroup */
@@ -1419,29 +2631,14 @@ PBXVariantGroup::PBXVariantGroup()
 	children = std::make_shared<PBXArray>();
 }
 
-void PBXVariantGroup::syncFromMap()
-{
-	PBXObject::syncFromMap();
-
-	children = getArray("children");
-	name = getString("name");
-	path = getString("path");
-	sourceTree = getString("sourceTree");
-}
-
-void PBXVariantGroup::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<PBXVariantGroup> pbx_variant_group_fields[] = {
+	{ "children", &PBXVariantGroup::children },
+	{ "name", &PBXVariantGroup::name, PBXFieldOmitEmpty },
+	{ "path", &PBXVariantGroup::path, PBXFieldOmitEmpty },
+	{ "sourceTree", &PBXVariantGroup::sourceTree },
+};
 
-	setArray("children", children);
-	if (name.length() > 0) {
-		setString("name", name);
-	}
-	if (path.length() > 0) {
-		setString("path", path);
-	}
-	setString("sourceTree", sourceTree);
-}
+const PBXFieldTable<PBXVariantGroup> PBXVariantGroup::fields(pbx_variant_group_fields);
 
 
 /* XCBuildConfiguration */
@@ -1451,21 +2648,13 @@ XCBuildConfiguration::XCBuildConfiguration()
 	buildSettings = std::make_shared<PBXMap>();
 }
 
-void XCBuildConfiguration::syncFromMap()
-{
-	PBXObject::syncFromMap();
-
-	buildSettings = getMap("buildSettings");
-	name = getString("name");
-}
-
-void XCBuildConfiguration::syncToMap()
-{
-	PBXObject::syncToMap();
+static constexpr PBXField<XCBuildConfiguration> xc_build_configuration_fields[] = {
+	{ "baseConfigurationReference", &XCBuildConfiguration::baseConfigurationReference, PBXFieldOmitEmpty },
+	{ "buildSettings", &XCBuildConfiguration::buildSettings },
+	{ "name", &XCBuildConfiguration::name },
+};
 
-	setMap("buildSettings", buildSettings);
-	setString("name", name);
-}
+const PBXFieldTable<XCBuildConfiguration> XCBuildConfiguration::fields(xc_build_configuration_fields);
 
 
 /* XCConfigurationList */
@@ -1477,304 +2666,394 @@ XCConfigurationList::XCConfigurationList()
 	defaultConfigurationIsVisible = 0;
 }
 
-void XCConfigurationList::syncFromMap()
-{
-	PBXObject::syncFromMap();
+static constexpr PBXField<XCConfigurationList> xc_configuration_list_fields[] = {
+	{ "buildConfigurations", &XCConfigurationList::buildConfigurations },
+	{ "defaultConfigurationIsVisible", &XCConfigurationList::defaultConfigurationIsVisible },
+	{ "defaultConfigurationName", &XCConfigurationList::defaultConfigurationName, PBXFieldOmitEmpty },
+};
+
+const PBXFieldTable<XCConfigurationList> XCConfigurationList::fields(xc_configuration_list_fields);
+
+
+/* PBX tokenizer */
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PBX_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined (__AVX2__)
+#define PBX_USE_AVX2 1
+#include <immintrin.h>
+#endif
 
-	buildConfigurations = getArray("buildConfigurations");
-	defaultConfigurationIsVisible = getInteger("defaultConfigurationIsVisible");
-	defaultConfigurationName = getString("defaultConfigurationName");
+bool PBXParser::use_simd = true;
+
+static inline int pbx_ctz(uint32_t mask)
+{
+#if defined (_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
 }
 
-void XCConfigurationList::syncToMap()
+struct PBXCharSet
 {
-	PBXObject::syncToMap();
+	bool table[256];
+	size_t count;
+#if PBX_USE_SSE2
+	__m128i sse[8];
+#endif
+#if PBX_USE_AVX2
+	__m256i avx[8];
+#endif
+
+	PBXCharSet(const char *chars) : table(), count(strlen(chars))
+	{
+		for (size_t i = 0; i < count; i++) {
+			table[(unsigned char)chars[i]] = true;
+#if PBX_USE_SSE2
+			sse[i] = _mm_set1_epi8(chars[i]);
+#endif
+#if PBX_USE_AVX2
+			avx[i] = _mm256_set1_epi8(chars[i]);
+#endif
+		}
+	}
+};
 
-	setArray("buildConfigurations", buildConfigurations);
-	setInteger("defaultConfigurationIsVisible", defaultConfigurationIsVisible);
-	if (defaultConfigurationName.size() > 0) {
-		setString("defaultConfigurationName", defaultConfigurationName);
+static const PBXCharSet pbx_whitespace(" \t\n\v\f\r");
+static const PBXCharSet pbx_object_literal_delim(" \t\n\v\f\r;");
+static const PBXCharSet pbx_array_literal_delim(" \t\n\v\f\r,");
+static const PBXCharSet pbx_quote_delim("\"\\");
+static const PBXCharSet pbx_comment_delim("*");
+static const PBXCharSet pbx_object_delim("{}\"/");
+
+/* returns a pointer to the first character in [p,pe) that is in set, or pe */
+static const char* pbx_scan(const char *p, const char *pe, const PBXCharSet &set)
+{
+	if (PBXParser::use_simd) {
+#if PBX_USE_AVX2
+		while (pe - p >= 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)p);
+			__m256i m = _mm256_cmpeq_epi8(v, set.avx[0]);
+			for (size_t i = 1; i < set.count; i++) {
+				m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, set.avx[i]));
+			}
+			uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+			if (mask) return p + pbx_ctz(mask);
+			p += 32;
+		}
+#endif
+#if PBX_USE_SSE2
+		while (pe - p >= 16) {
+			__m128i v = _mm_loadu_si128((const __m128i*)p);
+			__m128i m = _mm_cmpeq_epi8(v, set.sse[0]);
+			for (size_t i = 1; i < set.count; i++) {
+				m = _mm_or_si128(m, _mm_cmpeq_epi8(v, set.sse[i]));
+			}
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(m);
+			if (mask) return p + pbx_ctz(mask);
+			p += 16;
+		}
+#endif
 	}
+	while (p < pe && !set.table[(unsigned char)*p]) p++;
+	return p;
 }
 
+/* whitespace runs are short (indentation) so they are skipped by table */
+static inline const char* pbx_skip_whitespace(const char *p, const char *pe)
+{
+	while (p < pe && pbx_whitespace.table[(unsigned char)*p]) p++;
+	return p;
+}
 
-/* PBX parser state machine */
+static inline bool pbx_comment_start(const char *p, const char *pe)
+{
+	return p + 1 < pe && p[0] == '/' && p[1] == '*';
+}
 
-PBXParseError PBXParser::parse(std::vector<char> &buf)
+/* returns a pointer to the closing star slash, or pe */
+static const char* pbx_comment_end(const char *p, const char *pe)
 {
-	PBXParseState state = PBXParseStateSlashBang;
-	PBXParseState saved_state = PBXParseStateNone;
-	std::vector<PBXParseState> stack;
-	std::stringbuf token;
-	size_t offset = 0;
-	char c, peek, last = 0;
-	while (offset < buf.size()) {
-		c = buf[offset];
-		peek = offset < buf.size() - 1 ? buf[offset + 1] : 0;
+	for (;;) {
+		p = pbx_scan(p, pe, pbx_comment_delim);
+		if (p + 1 >= pe) return pe;
+		if (p[1] == '/') return p;
+		p++;
+	}
+}
 
-		switch (state) {
-			case PBXParseStateSlashBang:
-				if (offset != 0 &&
-					buf.size() < pbxproj_slash_bang.size() &&
-					memcmp(&buf[offset], pbxproj_slash_bang.c_str(),
-							pbxproj_slash_bang.size()) != 0) {
-					return PBXParseErrorInvalidSlashBang;
-				} else {
-					offset += pbxproj_slash_bang.size();
-					saved_state = PBXParseStateObjectValue;
-					state = PBXParseStateEatWhitespace;
-				}
-				break;
+static inline size_t pbx_rtrim_length(const char *p, const char *q)
+{
+	while (q > p && pbx_whitespace.table[(unsigned char)q[-1]]) q--;
+	return q - p;
+}
 
-			case PBXParseStateEatWhitespace:
-				if (isspace(c)) {
-					offset++;
-				} else {
-					state = saved_state;
+/*
+ * scans a quoted string starting after the opening quote. Returns a
+ * pointer past the closing quote, or nullptr if unterminated. The value
+ * points into the buffer unless the string contains escapes, in which
+ * case it is unescaped into scratch.
+ */
+static const char* pbx_quoted(const char *p, const char *pe, std::string &scratch,
+	const char *&value, size_t &length)
+{
+	const char *q = pbx_scan(p, pe, pbx_quote_delim);
+	if (q < pe && *q == '"') {
+		value = p;
+		length = q - p;
+		return q + 1;
+	}
+	scratch.assign(p, q - p);
+	while (q < pe && *q == '\\') {
+		if (q + 1 >= pe) return nullptr;
+		scratch.push_back(q[1]);
+		p = q + 2;
+		q = pbx_scan(p, pe, pbx_quote_delim);
+		scratch.append(p, q - p);
+	}
+	if (q >= pe) return nullptr;
+	value = scratch.data();
+	length = scratch.size();
+	return q + 1;
+}
+
+/*
+ * scans an object value starting after the opening bracket, skipping
+ * quoted strings and comments. Returns a pointer past the matching
+ * closing bracket, or nullptr if the object is unterminated.
+ */
+static const char* pbx_skip_object(const char *p, const char *pe)
+{
+	size_t depth = 1;
+	for (;;) {
+		p = pbx_scan(p, pe, pbx_object_delim);
+		if (p == pe) return nullptr;
+		switch (*p) {
+			case '{':
+				depth++;
+				p++;
+				break;
+			case '}':
+				p++;
+				if (--depth == 0) return p;
+				break;
+			case '"':
+				for (p++;;) {
+					p = pbx_scan(p, pe, pbx_quote_delim);
+					if (p == pe) return nullptr;
+					if (*p == '"') break;
+					p += 2;
+					if (p >= pe) return nullptr;
 				}
+				p++;
 				break;
-
-			case PBXParseStateObjectComment:
-				if (c == '*' && peek == '/') {
-					object_comment(util::rtrim(token.str()));
-					token.str(std::string());
-					saved_state = PBXParseStateObjectAttrName;
-					state = PBXParseStateEatWhitespace;
-					offset += 2;
+			default:
+				if (pbx_comment_start(p, pe)) {
+					p = pbx_comment_end(p + 2, pe);
+					if (p == pe) return nullptr;
+					p += 2;
 				} else {
-					token.sputc(c);
-					offset++;
+					p++;
 				}
 				break;
+		}
+	}
+}
 
-			case PBXParseStateObjectAttrComment:
-				if (c == '*' && peek == '/') {
-					object_attr_comment(util::rtrim(token.str()));
-					token.str(std::string());
-					saved_state = PBXParseStateObjectAttrEquals;
-					state = PBXParseStateEatWhitespace;
-					offset += 2;
-				} else {
-					token.sputc(c);
-					offset++;
+PBXParseError PBXParser::read(std::string project_file)
+{
+	source = util::map_file(project_file);
+	return parse(source->data, source->size);
+}
+
+PBXParseError PBXParser::parse(const char *buf, size_t len)
+{
+	return parse(buf, len, PBXParseStateSlashBang);
+}
+
+PBXParseError PBXParser::parseValue(const char *buf, size_t len)
+{
+	return parse(buf, len, PBXParseStateObjectValue);
+}
+
+PBXParseError PBXParser::parse(const char *buf, size_t len, PBXParseState state)
+{
+	std::vector<PBXParseState> stack;
+	std::string scratch;
+	const char *p = buf, *pe = buf + len, *q, *value;
+	size_t length;
+
+	while (p < pe) {
+		switch (state) {
+			case PBXParseStateSlashBang:
+				if (len < pbxproj_slash_bang.size() ||
+					memcmp(p, pbxproj_slash_bang.c_str(), pbxproj_slash_bang.size()) != 0) {
+					return PBXParseErrorInvalidSlashBang;
 				}
+				p += pbxproj_slash_bang.size();
+				state = PBXParseStateObjectValue;
 				break;
 
+			case PBXParseStateObjectComment:
+			case PBXParseStateObjectAttrComment:
 			case PBXParseStateObjectValueComment:
-				if (c == '*' && peek == '/') {
-					object_value_comment(util::rtrim(token.str()));
-					token.str(std::string());
-					saved_state = PBXParseStateObjectValueSemicolon;
-					state = PBXParseStateEatWhitespace;
-					offset += 2;
-				} else {
-					token.sputc(c);
-					offset++;
+			case PBXParseStateArrayValueComment:
+				q = pbx_comment_end(p, pe);
+				if (q == pe) {
+					return PBXParseErrorUnterminatedComment;
+				}
+				length = pbx_rtrim_length(p, q);
+				switch (state) {
+					case PBXParseStateObjectComment:
+						object_comment(p, length);
+						state = PBXParseStateObjectAttrName;
+						break;
+					case PBXParseStateObjectAttrComment:
+						object_attr_comment(p, length);
+						state = PBXParseStateObjectAttrEquals;
+						break;
+					case PBXParseStateObjectValueComment:
+						object_value_comment(p, length);
+						state = PBXParseStateObjectValueSemicolon;
+						break;
+					default:
+						array_value_comment(p, length);
+						state = PBXParseStateArrayValueComma;
+						break;
 				}
+				p = q + 2;
 				break;
 
 			case PBXParseStateObjectAttrName:
-				if (c == '/' && peek == '*') {
-					saved_state = PBXParseStateObjectComment;
-					state = PBXParseStateEatWhitespace;
-					offset += 2;
-				} else if (c == '}') {
+				if (pbx_comment_start(p, pe)) {
+					state = PBXParseStateObjectComment;
+					p += 2;
+				} else if (*p == '}') {
 					end_object();
 					if (stack.size() == 0) {
 						return PBXParseErrorUnexpectedBracket;
-					} else {
-						saved_state = stack.back();
-						state = PBXParseStateEatWhitespace;
-						offset++;
-						stack.pop_back();
 					}
-				} else if (isspace(c)) {
-					object_attr(token.str());
-					token.str(std::string());
-					saved_state = PBXParseStateObjectAttrEquals;
-					state = PBXParseStateEatWhitespace;
+					state = stack.back();
+					stack.pop_back();
+					p++;
 				} else {
-					token.sputc(c);
-					offset++;
+					q = pbx_scan(p, pe, pbx_whitespace);
+					object_attr(p, q - p);
+					state = PBXParseStateObjectAttrEquals;
+					p = q;
 				}
 				break;
 
 			case PBXParseStateObjectAttrEquals:
-				if (c == '/' && peek == '*') {
-					saved_state = PBXParseStateObjectAttrComment;
-					state = PBXParseStateEatWhitespace;
-					offset += 2;
-				} else if (c == '=') {
-					saved_state = PBXParseStateObjectValue;
-					state = PBXParseStateEatWhitespace;
-					offset++;
+				if (pbx_comment_start(p, pe)) {
+					state = PBXParseStateObjectAttrComment;
+					p += 2;
+				} else if (*p == '=') {
+					state = PBXParseStateObjectValue;
+					p++;
 				} else {
 					return PBXParseErrorExpectedEquals;
 				}
 				break;
 
 			case PBXParseStateObjectValue:
-				if (c == '{') {
+				if (*p == '{' && skip_object()) {
+					q = pbx_skip_object(p + 1, pe);
+					if (!q) {
+						return PBXParseErrorUnexpectedBracket;
+					}
+					skipped_object(p, q - p);
+					state = PBXParseStateObjectValueSemicolon;
+					p = q;
+				} else if (*p == '{') {
 					begin_object();
-					saved_state = PBXParseStateObjectAttrName;
-					state = PBXParseStateEatWhitespace;
 					stack.push_back(PBXParseStateObjectValueSemicolon);
-					offset++;
-				} else if (c == '(') {
+					state = PBXParseStateObjectAttrName;
+					p++;
+				} else if (*p == '(') {
 					begin_array();
-					saved_state = PBXParseStateArrayValue;
-					state = PBXParseStateEatWhitespace;
 					stack.push_back(PBXParseStateObjectValueSemicolon);
-					offset++;
-				} else if (c == '"') {
-					offset++;
-					state = PBXParseStateObjectValueQuotedLiteral;
-				} else {
-					state = PBXParseStateObjectValueLiteral;
-				}
-				break;
-
-			case PBXParseStateObjectValueQuotedLiteral:
-				if (c == '\\' && last != '\\') {
-					offset++;
-				} else if (c == '"' && last != '\\') {
-					object_value_literal(token.str());
-					token.str(std::string());
-					saved_state = PBXParseStateObjectValueSemicolon;
-					state = PBXParseStateEatWhitespace;
-					offset++;
-				} else {
-					token.sputc(c);
-					offset++;
-				}
-				break;
-
-			case PBXParseStateObjectValueLiteral:
-				if (isspace(c) || c == ';') {
-					object_value_literal(token.str());
-					token.str(std::string());
-					saved_state = PBXParseStateObjectValueSemicolon;
-					state = PBXParseStateEatWhitespace;
+					state = PBXParseStateArrayValue;
+					p++;
+				} else if (*p == '"') {
+					p = pbx_quoted(p + 1, pe, scratch, value, length);
+					if (!p) {
+						return PBXParseErrorUnterminatedString;
+					}
+					object_value_literal(value, length);
+					state = PBXParseStateObjectValueSemicolon;
 				} else {
-					token.sputc(c);
-					offset++;
+					q = pbx_scan(p, pe, pbx_object_literal_delim);
+					object_value_literal(p, q - p);
+					state = PBXParseStateObjectValueSemicolon;
+					p = q;
 				}
 				break;
 
 			case PBXParseStateObjectValueSemicolon:
-				if (c == '/' && peek == '*') {
-					saved_state = PBXParseStateObjectValueComment;
-					state = PBXParseStateEatWhitespace;
-					offset += 2;
-				} else if (c == ';') {
-					saved_state = PBXParseStateObjectAttrName;
-					state = PBXParseStateEatWhitespace;
-					offset++;
+				if (pbx_comment_start(p, pe)) {
+					state = PBXParseStateObjectValueComment;
+					p += 2;
+				} else if (*p == ';') {
+					state = PBXParseStateObjectAttrName;
+					p++;
 				} else {
 					return PBXParseErrorExpectedSemicolon;
 				}
 				break;
 
 			case PBXParseStateArrayValue:
-				if (c == '"') {
-					offset++;
-					state = PBXParseStateArrayValueQuotedLiteral;
-				} else if (c == ')') {
+				if (*p == ')') {
 					end_array();
 					if (stack.size() == 0) {
 						return PBXParseErrorUnexpectedParenthesis;
-					} else {
-						saved_state = stack.back();
-						state = PBXParseStateEatWhitespace;
-						offset++;
-						stack.pop_back();
 					}
-				} else if (c == '{') {
+					state = stack.back();
+					stack.pop_back();
+					p++;
+				} else if (*p == '{') {
 					begin_object();
-					saved_state = PBXParseStateObjectAttrName;
-					state = PBXParseStateEatWhitespace;
 					stack.push_back(PBXParseStateArrayValueComma);
-					offset++;
-				} else {
-					state = PBXParseStateArrayValueLiteral;
-				}
-				break;
-
-			case PBXParseStateArrayValueComment:
-				if (c == '*' && peek == '/') {
-					array_value_comment(util::rtrim(token.str()));
-					token.str(std::string());
-					saved_state = PBXParseStateArrayValueComma;
-					state = PBXParseStateEatWhitespace;
-					offset += 2;
+					state = PBXParseStateObjectAttrName;
+					p++;
+				} else if (*p == '"') {
+					p = pbx_quoted(p + 1, pe, scratch, value, length);
+					if (!p) {
+						return PBXParseErrorUnterminatedString;
+					}
+					array_value_literal(value, length);
+					state = PBXParseStateArrayValueComma;
 				} else {
-					token.sputc(c);
-					offset++;
+					q = pbx_scan(p, pe, pbx_array_literal_delim);
+					array_value_literal(p, q - p);
+					state = PBXParseStateArrayValueComma;
+					p = q;
 				}
 				break;
 
 			case PBXParseStateArrayValueComma:
-				if (c == '/' && peek == '*') {
-					saved_state = PBXParseStateArrayValueComment;
-					state = PBXParseStateEatWhitespace;
-					offset += 2;
-				} else if (c == ',' || c == ')') {
-					saved_state = PBXParseStateArrayValue;
-					state = PBXParseStateEatWhitespace;
-					offset++;
+				if (pbx_comment_start(p, pe)) {
+					state = PBXParseStateArrayValueComment;
+					p += 2;
+				} else if (*p == ',') {
+					state = PBXParseStateArrayValue;
+					p++;
+				} else if (*p == ')') {
+					state = PBXParseStateArrayValue;
 				} else {
 					return PBXParseErrorExpectedArraySeparator;
 				}
 				break;
 
-			case PBXParseStateArrayValueQuotedLiteral:
-				if (c == '\\' && last != '\\') {
-					offset++;
-				} else if (c == '"' && last != '\\') {
-					array_value_literal(token.str());
-					token.str(std::string());
-					saved_state = PBXParseStateArrayValueComma;
-					state = PBXParseStateEatWhitespace;
-					offset++;
-				} else {
-					token.sputc(c);
-					offset++;
-				}
-				break;
-
-			case PBXParseStateArrayValueLiteral:
-				if (isspace(c) || c == ',') {
-					array_value_literal(token.str());
-					token.str(std::string());
-					saved_state = PBXParseStateArrayValueComma;
-					state = PBXParseStateEatWhitespace;
-				} else {
-					token.sputc(c);
-					offset++;
-				}
-				break;
-
-			case PBXParseStateFinalSemicolon:
-				if (c == ';') {
-					offset++;
-					state = PBXParseStateTrailingWhitespace;
-				} else {
-					return PBXParseErrorExpectedSemicolon;
-				}
-				break;
-
-			case PBXParseStateTrailingWhitespace:
-				if (isspace(c)) {
-					offset++;
-				} else {
-					return PBXParseErrorExpectedWhitespace;
-				}
-				break;
-
 			case PBXParseStateNone:
 				break;
 		}
-		last = c;
+		p = pbx_skip_whitespace(p, pe);
 	}
 
 	return PBXParseErrorNone;
@@ -1783,15 +3062,54 @@ PBXParseError PBXParser::parse(std::vector<char> &buf)
 
 /* PBX parser implementation */
 
-bool PBXParserImpl::literal_is_hex_id(std::string str)
+bool PBXParserImpl::literal_is_hex_id(const char *value, size_t length)
 {
-	if (str.size() != 24) return false;
-	for (size_t i = 0; i < str.length(); i++) {
-		if (strchr(util::HEX_DIGITS, str[i]) == NULL) return false;
+	if (length != 24) return false;
+	for (size_t i = 0; i < length; i++) {
+		if (value[i] == '\0' || strchr(util::HEX_DIGITS, value[i]) == NULL) return false;
 	}
 	return true;
 }
 
+bool PBXParserImpl::skip_object()
+{
+	return lazy_objects && value_stack.size() > 0 && value_stack.back() == lazy_objects;
+}
+
+void PBXParserImpl::skipped_object(const char *value, size_t length)
+{
+	if (debug) {
+		log_debug("skipped_object: %s (%zu bytes)", current_attr_name.c_str(), length);
+	}
+	PBXMap &objects = static_cast<PBXMap&>(*lazy_objects);
+	objects.put(current_attr_name, current_attr_comment, PBXValuePtr());
+	xcodeproj->lazySource = source;
+	xcodeproj->lazyObjects.resize(objects.entries.size());
+	xcodeproj->lazyObjects.back() = PBXLazyObject(value - source->data, length);
+	xcodeproj->lazyCount++;
+}
+
+/*
+ * literals are immutable once parsed so repeated values share one
+ * PBXLiteral, found through a direct mapped cache on the atom address.
+ * Ids are not shared as their comments are assigned after creation.
+ */
+PBXValuePtr PBXParserImpl::literal_value(const char *value, size_t length)
+{
+	if (literal_is_hex_id(value, length)) {
+		return std::make_shared<PBXId>(std::string(value, length));
+	}
+	PBXAtom atom(value, length);
+	if (literal_cache.size() == 0) {
+		literal_cache.resize(literal_cache_size);
+	}
+	PBXValuePtr &slot = literal_cache[((uintptr_t)atom.s >> 4) & (literal_cache_size - 1)];
+	if (!slot || static_cast<PBXLiteral&>(*slot).literal_val != atom) {
+		slot = std::make_shared<PBXLiteral>(atom);
+	}
+	return slot;
+}
+
 void PBXParserImpl::begin_object()
 {
 	if (debug) {
@@ -1807,13 +3125,16 @@ void PBXParserImpl::begin_object()
 			 value_stack.back()->type() == PBXTypeMap ||
 			 value_stack.back()->type() == PBXTypeObject)
 	{
-		valptr = PBXValuePtr(new PBXMap());
+		valptr = std::make_shared<PBXMap>();
 		static_cast<PBXMap&>(*value_stack.back()).put(current_attr_name, current_attr_comment, valptr);
 		value_stack.push_back(valptr);
+		if (lazy && source && value_stack.size() == 2 && current_attr_name.str() == "objects") {
+			lazy_objects = valptr;
+		}
 	}
 	else if (value_stack.back()->type() == PBXTypeArray)
 	{
-		valptr = PBXValuePtr(new PBXMap());
+		valptr = std::make_shared<PBXMap>();
 		static_cast<PBXArray&>(*value_stack.back()).add(valptr);
 		value_stack.push_back(valptr);
 	}
@@ -1827,6 +3148,7 @@ void PBXParserImpl::end_object()
 	if (value_stack.size() == 0) {
 		log_fatal_exit("value stack empty");
 	}
+	static_cast<PBXMap&>(*value_stack.back()).entries.shrink_to_fit();
 	if (value_stack.back()->type() == PBXTypeObject ||
 		value_stack.back()->type() == PBXTypeXcodeproj) {
 		static_cast<PBXObject&>(*value_stack.back()).syncFromMap();
@@ -1834,41 +3156,40 @@ void PBXParserImpl::end_object()
 	value_stack.pop_back();
 }
 
-void PBXParserImpl::object_comment(std::string str)
+void PBXParserImpl::object_comment(const char *value, size_t length)
 {
 	if (debug) {
-		log_debug("object_comment: \"%s\"", str.c_str());
+		log_debug("object_comment: \"%.*s\"", (int)length, value);
 	}
-	current_attr_comment = str;
+	current_attr_comment = PBXAtom(value, length);
 }
 
-void PBXParserImpl::object_attr(std::string str)
+void PBXParserImpl::object_attr(const char *value, size_t length)
 {
 	if (debug) {
-		log_debug("object_attr: \"%s\"", str.c_str());
+		log_debug("object_attr: \"%.*s\"", (int)length, value);
 	}
-	current_attr_name = str;
-	current_attr_comment = std::string();
+	current_attr_name = PBXAtom(value, length);
+	current_attr_comment = PBXAtom();
 }
 
-void PBXParserImpl::object_attr_comment(std::string str)
+void PBXParserImpl::object_attr_comment(const char *value, size_t length)
 {
 	if (debug) {
-		log_debug("object_attr_comment: \"%s\"", str.c_str());
+		log_debug("object_attr_comment: \"%.*s\"", (int)length, value);
 	}
-	current_attr_comment = str;
+	current_attr_comment = PBXAtom(value, length);
 }
 
-void PBXParserImpl::object_value_literal(std::string str)
+void PBXParserImpl::object_value_literal(const char *value, size_t length)
 {
 	if (debug) {
-		log_debug("object_value_literal: \"%s\"", str.c_str());
+		log_debug("object_value_literal: \"%.*s\"", (int)length, value);
 	}
-	bool is_id = literal_is_hex_id(str);
 	if (value_stack.size() == 0) {
 		log_fatal_exit("value stack empty");
 	}
-	else if (value_stack.back()->type() == PBXTypeMap && current_attr_name == "isa")
+	else if (value_stack.back()->type() == PBXTypeMap && current_attr_name.str() == "isa")
 	{
 		// pop the previous map off the value stack
 		PBXValuePtr old_map_ptr = value_stack.back();
@@ -1882,40 +3203,39 @@ void PBXParserImpl::object_value_literal(std::string str)
 		}
 
 		// reinstantiate with a concrete type
-		const PBXMap &old_map = static_cast<const PBXMap&>(*old_map_ptr);
+		PBXMap &old_map = static_cast<PBXMap&>(*old_map_ptr);
 		PBXMap &parent_map = static_cast<PBXMap&>(*value_stack.back());
-		PBXKey &last_key = parent_map.key_order.back();
-		PBXId id(last_key.str, last_key.comment);
-		valptr = xcodeproj->createObject(str, id, old_map);
-		parent_map.replace(last_key.str, valptr);
+		PBXEntry &last_entry = parent_map.entries.back();
+		PBXAtom isa(value, length);
+		PBXId id(last_entry.key, last_entry.comment);
+		valptr = xcodeproj->createObject(isa, id, old_map);
+		last_entry.val = valptr;
 		value_stack.push_back(valptr);
 
 		// add isa
-		static_cast<PBXMap&>(*value_stack.back()).put(current_attr_name, current_attr_comment, PBXValuePtr(new PBXLiteral(str)));
+		static_cast<PBXMap&>(*value_stack.back()).put(current_attr_name, current_attr_comment, std::make_shared<PBXLiteral>(isa));
 	}
 	else if (value_stack.back()->type() == PBXTypeXcodeproj ||
 			 value_stack.back()->type() == PBXTypeMap ||
 			 value_stack.back()->type() == PBXTypeObject)
 	{
-		valptr = PBXValuePtr(is_id ?
-			(PBXValue*)new PBXId(str) : (PBXValue*)new PBXLiteral(str));
+		valptr = literal_value(value, length);
 		static_cast<PBXMap&>(*value_stack.back()).put(current_attr_name, current_attr_comment, valptr);
 	}
 	else if (value_stack.back()->type() == PBXTypeArray)
 	{
-		valptr = PBXValuePtr(is_id ?
-			(PBXValue*)new PBXId(str) : (PBXValue*)new PBXLiteral(str));
+		valptr = literal_value(value, length);
 		static_cast<PBXArray&>(*value_stack.back()).add(valptr);
 	}
 }
 
-void PBXParserImpl::object_value_comment(std::string str)
+void PBXParserImpl::object_value_comment(const char *value, size_t length)
 {
 	if (debug) {
-		log_debug("object_value_comment: \"%s\"", str.c_str());
+		log_debug("object_value_comment: \"%.*s\"", (int)length, value);
 	}
 	if (valptr->type() == PBXTypeId) {
-		static_cast<PBXId&>(*valptr).comment = str;
+		static_cast<PBXId&>(*valptr).comment = PBXAtom(value, length);
 	}
 }
 
@@ -1931,13 +3251,13 @@ void PBXParserImpl::begin_array()
 			 value_stack.back()->type() == PBXTypeMap ||
 			 value_stack.back()->type() == PBXTypeObject)
 	{
-		valptr = PBXValuePtr(new PBXArray());
+		valptr = std::make_shared<PBXArray>();
 		static_cast<PBXMap&>(*value_stack.back()).put(current_attr_name, current_attr_comment, valptr);
 		value_stack.push_back(valptr);
 	}
 	else if (value_stack.back()->type() == PBXTypeArray)
 	{
-		valptr = PBXValuePtr(new PBXArray());
+		valptr = std::make_shared<PBXArray>();
 		static_cast<PBXArray&>(*value_stack.back()).add(valptr);
 		value_stack.push_back(valptr);
 	}
@@ -1951,118 +3271,240 @@ void PBXParserImpl::end_array()
 	value_stack.pop_back();
 }
 
-void PBXParserImpl::array_value_literal(std::string str)
+void PBXParserImpl::array_value_literal(const char *value, size_t length)
 {
 	if (debug) {
-		log_debug("array_value_literal: \"%s\"", str.c_str());
+		log_debug("array_value_literal: \"%.*s\"", (int)length, value);
 	}
-	bool is_id = literal_is_hex_id(str);
 	if (value_stack.size() == 0) {
 		log_fatal_exit("value stack empty");
 	}
 	else if (value_stack.back()->type() == PBXTypeArray)
 	{
-		valptr = PBXValuePtr(is_id ?
-			(PBXValue*)new PBXId(str) : (PBXValue*)new PBXLiteral(str));
+		valptr = literal_value(value, length);
 		static_cast<PBXArray&>(*value_stack.back()).array_val.push_back(valptr);
 	}
 }
 
-void PBXParserImpl::array_value_comment(std::string str)
+void PBXParserImpl::array_value_comment(const char *value, size_t length)
 {
 	if (debug) {
-		log_debug("array_value_comment: \"%s\"", str.c_str());
+		log_debug("array_value_comment: \"%.*s\"", (int)length, value);
 	}
 	if (valptr->type() == PBXTypeId) {
-		static_cast<PBXId&>(*valptr).comment = str;
+		static_cast<PBXId&>(*valptr).comment = PBXAtom(value, length);
 	}
 }
 
 
 /* PBX writer */
 
-const char* PBXWriter::LITERAL_CHARS = "/._";
+/*
+ * Literals made only of alphanumerics and "/._" are written bare and
+ * anything else is quoted, with embedded quotes escaped.
+ */
 
-bool PBXWriter::literal_requires_quotes(std::string str)
+struct PBXLiteralChars
 {
-	if (str.size() == 0) return true;
-	for (size_t i = 0; i < str.length(); i++) {
-		char c = str[i];
-		if (!isalnum(c) && strchr(LITERAL_CHARS, c) == NULL) return true;
+	bool plain[256];
+
+	PBXLiteralChars()
+	{
+		for (int c = 0; c < 256; c++) {
+			plain[c] = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
+				(c >= 'a' && c <= 'z') || c == '/' || c == '.' || c == '_';
+		}
 	}
-	return false;
+};
+
+static const PBXLiteralChars pbx_literal_chars;
+
+static const char pbx_tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
+PBXWriter::PBXWriter() {}
+
+void PBXWriter::write_indent(int indent)
+{
+	size_t n = indent;
+	while (n > sizeof(pbx_tabs) - 1) {
+		buf.append(pbx_tabs, sizeof(pbx_tabs) - 1);
+		n -= sizeof(pbx_tabs) - 1;
+	}
+	buf.append(pbx_tabs, n);
 }
 
-std::string PBXWriter::escape_quotes(std::string str)
+void PBXWriter::write_key(const PBXAtom &key, const PBXAtom &comment, int indent)
 {
-	std::stringstream ss;
-	for (size_t i = 0; i < str.length(); i++) {
-		char c = str[i];
-		if (c == '"') ss << "\\";
-		ss << c;
+	write_indent(indent + 1);
+	buf.append(key.str());
+	if (comment.length() > 0) {
+		buf.append(" /* ").append(comment.str()).append(" */");
+	}
+	buf.append(" = ");
+}
+
+void PBXWriter::write_literal(const std::string &str)
+{
+	const unsigned char *p = (const unsigned char*)str.data(), *end = p + str.size();
+	while (p < end && pbx_literal_chars.plain[*p]) p++;
+	if (p == end && str.size() > 0) {
+		buf.append(str);
+		return;
+	}
+	const char *run = str.data();
+	buf.push_back('"');
+	for (const char *q = run; q < str.data() + str.size(); q++) {
+		if (*q == '"') {
+			buf.append(run, q - run).push_back('\\');
+			run = q;
+		}
 	}
-	return ss.str();
+	buf.append(run, str.data() + str.size() - run).push_back('"');
 }
 
+void PBXWriter::write_integer(int val)
+{
+	char num[16];
+	int len = snprintf(num, sizeof(num), "%d", val);
+	buf.append(num, len);
+}
 
-void PBXWriter::write(PBXValuePtr value, std::ostream &out, int indent)
+void PBXWriter::write_id(const PBXId &id)
+{
+	char hex[sizeof(id.id.id_val) * 2];
+	for (size_t i = 0; i < sizeof(id.id.id_val); i++) {
+		hex[i * 2] = util::HEX_DIGITS[id.id.id_val[i] >> 4];
+		hex[i * 2 + 1] = util::HEX_DIGITS[id.id.id_val[i] & 0x0F];
+	}
+	buf.append(hex, sizeof(hex));
+	if (id.comment.length() > 0) {
+		buf.append(" /* ").append(id.comment.str()).append(" */");
+	}
+}
+
+/* writes a value, or opens it and returns true if it is a container */
+bool PBXWriter::begin_value(PBXValue &value, int indent)
 {
-	switch (value->type()) {
+	static const PBXAtom isa("isa");
+
+	switch (value.type()) {
 		case PBXTypeXcodeproj:
-			out << pbxproj_slash_bang << '\n';
+			buf.append(pbxproj_slash_bang).push_back('\n');
 		case PBXTypeObject:
-			static_cast<PBXObject&>(*value).syncToMap();
-		case PBXTypeMap:
 		{
-			out << "{" << '\n';
-			PBXMap &map = static_cast<PBXMap&>(*value);
-			for (const PBXKey &key : map.key_order) {
-				PBXValuePtr &val = map.object_val[key.str];
-				for (int i = 0; i <= indent; i++) out << "\t";
-				out << key.str;
-				if (key.comment.length() > 0) {
-					out << " /* " << key.comment << " */";
-				}
-				out << " = ";
-				write(val, out, indent + 1);
-				out << ";" << '\n';
+			PBXObject &obj = static_cast<PBXObject&>(value);
+			size_t count = obj.fieldCount();
+			if (count > 64) {
+				log_fatal_exit("%s: too many fields", obj.type_name().c_str());
 			}
-			for (int i = 0; i < indent; i++) out << "\t";
-			out << "}";
-			break;
-		}
-		case PBXTypeArray:
-		{
-			out << "(" << '\n';
-			PBXArray &arr = static_cast<PBXArray&>(*value);
-			for (PBXValuePtr &val : arr.array_val) {
-				for (int i = 0; i <= indent; i++) out << "\t";
-				write(val, out, indent + 1);
-				out << "," << '\n';
+			obj.prepareWrite();
+			buf.append("{\n");
+			if (value.type() == PBXTypeObject && !obj.find(isa)) {
+				write_key(isa, PBXAtom(), indent);
+				write_literal(obj.type_name());
+				buf.append(";\n");
 			}
-			for (int i = 0; i < indent; i++) out << "\t";
-			out << ")";
-			break;
+			stack.push_back(PBXWriterFrame(&value, indent, count));
+			return true;
 		}
+		case PBXTypeMap:
+			buf.append("{\n");
+			stack.push_back(PBXWriterFrame(&value, indent, 0));
+			return true;
+		case PBXTypeArray:
+			buf.append("(\n");
+			stack.push_back(PBXWriterFrame(&value, indent, 0));
+			return true;
 		case PBXTypeLiteral:
-		{
-			PBXLiteral &lit = static_cast<PBXLiteral&>(*value);
-			if (literal_requires_quotes(lit.literal_val)) {
-				out << "\"" << escape_quotes(lit.literal_val) << "\"";
-			} else {
-				out << lit.literal_val;
-			}
-			break;
-		}
+			write_literal(static_cast<PBXLiteral&>(value).literal_val);
+			return false;
 		case PBXTypeId:
-		{
-			PBXId &id = static_cast<PBXId&>(*value);
-			out << id.str();
-			if (id.comment.length() > 0) {
-				out << " /* " << id.comment << " */";
-			}
-			break;
+			write_id(static_cast<PBXId&>(value));
+			return false;
+	}
+	return false;
+}
+
+bool PBXWriter::begin_field(const PBXFieldValue &field, int indent)
+{
+	switch (field.kind) {
+		case PBXFieldString: write_literal(*field.string_val); return false;
+		case PBXFieldInteger: write_integer(*field.int_val); return false;
+		case PBXFieldId: write_id(*field.id_val); return false;
+		case PBXFieldArray: return begin_value(**field.array_val, indent);
+		case PBXFieldMap: return begin_value(**field.map_val, indent);
+	}
+	return false;
+}
+
+PBXWriteStep PBXWriter::next_element(PBXWriterFrame &frame)
+{
+	PBXArray &arr = static_cast<PBXArray&>(*frame.value);
+	if (frame.pos == arr.array_val.size()) {
+		return PBXWriteEnd;
+	}
+	write_indent(frame.indent + 1);
+	return begin_value(*arr.array_val[frame.pos++], frame.indent + 1) ? PBXWriteNested : PBXWriteValue;
+}
+
+/*
+ * Objects keep the key order of their parsed map. Keys that have a
+ * field are written from the typed member, and fields not yet in the
+ * map follow in table order.
+ */
+PBXWriteStep PBXWriter::next_entry(PBXWriterFrame &frame)
+{
+	PBXMap &map = static_cast<PBXMap&>(*frame.value);
+	PBXObject &obj = static_cast<PBXObject&>(map);
+	int indent = frame.indent;
+	bool nested;
+	if (frame.pos < map.entries.size()) {
+		const PBXEntry &entry = map.entries[frame.pos++];
+		write_key(entry.key, entry.comment, indent);
+		size_t i = frame.count > 0 ? obj.fieldIndex(entry.key) : 0;
+		PBXFieldValue field = i < frame.count ? obj.field(i) : PBXFieldValue();
+		if (i < frame.count && !field.is_null()) {
+			frame.written |= 1ULL << i;
+			nested = begin_field(field, indent + 1);
+		} else {
+			nested = begin_value(*entry.val, indent + 1);
 		}
+		return nested ? PBXWriteNested : PBXWriteValue;
+	}
+	while (frame.field < frame.count) {
+		size_t i = frame.field++;
+		if (frame.written & (1ULL << i)) continue;
+		PBXFieldValue field = obj.field(i);
+		if (field.omitted()) continue;
+		write_key(field.name, PBXAtom(), indent);
+		nested = begin_field(field, indent + 1);
+		return nested ? PBXWriteNested : PBXWriteValue;
+	}
+	return PBXWriteEnd;
+}
+
+void PBXWriter::write(PBXValue &value, int indent)
+{
+	if (!begin_value(value, indent)) return;
+	while (!stack.empty()) {
+		PBXWriterFrame &frame = stack.back();
+		bool is_array = frame.value->type() == PBXTypeArray;
+		PBXWriteStep step = is_array ? next_element(frame) : next_entry(frame);
+		if (step == PBXWriteNested) continue;
+		if (step == PBXWriteEnd) {
+			write_indent(frame.indent);
+			buf.push_back(is_array ? ')' : '}');
+			stack.pop_back();
+			if (stack.empty()) break;
+			is_array = stack.back().value->type() == PBXTypeArray;
+		}
+		buf.append(is_array ? ",\n" : ";\n");
 	}
 }
 
+void PBXWriter::write(PBXValuePtr value, std::ostream &out, int indent)
+{
+	PBXWriter writer;
+	writer.write(*value, indent);
+	out.write(writer.buf.data(), writer.buf.size());
+}
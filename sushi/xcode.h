@@ -30,18 +30,38 @@ enum PBXType
 	PBXTypeObject
 };
 
-struct SUSHI_LIB PBXKey
+/*
+ * PBXAtom is a handle to an interned string. Keys, comments and literals
+ * repeat heavily in project files so each distinct string is stored once
+ * in a process wide pool and atoms compare by pointer.
+ */
+
+struct SUSHI_LIB PBXAtom
 {
-	std::string str;
-	std::string comment;
+	const std::string *s;
+
+	static const std::string empty;
+
+	static size_t hash(const char *str, size_t len);
+	static const std::string* intern(const char *str, size_t len);
 
-	PBXKey(const std::string &str) : str(str) {}
-	PBXKey(const std::string &str, const std::string &comment) : str(str), comment(comment) {}
+	PBXAtom() : s(&empty) {}
+	PBXAtom(const std::string &str) : s(intern(str.data(), str.size())) {}
+	PBXAtom(const char *str) : s(intern(str, strlen(str))) {}
+	PBXAtom(const char *str, size_t len) : s(intern(str, len)) {}
 
-	bool operator<(const PBXKey &o) const { return str < o.str; }
-	bool operator==(const PBXKey &o) const { return str == o.str; }
+	const std::string& str() const { return *s; }
+	const char* c_str() const { return s->c_str(); }
+	size_t length() const { return s->length(); }
+	size_t size() const { return s->size(); }
+	operator const std::string&() const { return *s; }
+
+	bool operator==(const PBXAtom &o) const { return s == o.s; }
+	bool operator!=(const PBXAtom &o) const { return s != o.s; }
 };
 
+inline std::ostream& operator<<(std::ostream &out, const PBXAtom &atom) { return out << *atom.s; }
+
 struct SUSHI_LIB PBXValue
 {
 	virtual ~PBXValue() {}
@@ -63,16 +83,13 @@ union PBXIdUnion
 struct SUSHI_LIB PBXId : PBXValue
 {
 	PBXIdUnion id;
-	std::string comment;
+	PBXAtom comment;
 
-	static uint32_t next_id;
-
-	static PBXId createRootId();
-	static PBXId createId(const PBXId &o);
+	static PBXId createId(const std::string &key);
 
 	PBXId();
 	PBXId(std::string id_str);
-	PBXId(std::string id_str, std::string comment);
+	PBXId(std::string id_str, PBXAtom comment);
 	PBXId(const PBXId& o);
 
 	std::string str();
@@ -82,17 +99,52 @@ struct SUSHI_LIB PBXId : PBXValue
 	bool operator==(const PBXId &o);
 };
 
+/*
+ * PBXEntry is a key, its comment and value, held in insertion order in
+ * a flat vector by PBXMap. Maps that grow past index_threshold, such as
+ * objects, add an open addressed index of key hashes and positions;
+ * small maps are searched linearly.
+ */
+
+struct SUSHI_LIB PBXEntry
+{
+	PBXAtom key;
+	PBXAtom comment;
+	PBXValuePtr val;
+
+	PBXEntry(PBXAtom key, PBXAtom comment, PBXValuePtr val) : key(key), comment(comment), val(val) {}
+};
+
+struct SUSHI_LIB PBXIndexSlot
+{
+	uint32_t hash;
+	uint32_t pos;
+
+	PBXIndexSlot() : hash(0), pos(0) {}
+};
+
 struct SUSHI_LIB PBXMap : PBXValue
 {
-	std::map<std::string,PBXValuePtr> object_val;
-	std::vector<PBXKey> key_order;
+	static const size_t index_threshold = 16;
+
+	std::vector<PBXEntry> entries;
+	std::unique_ptr<std::vector<PBXIndexSlot>> index;
 
 	virtual PBXType type();
 
+	size_t size() { return entries.size(); }
+	size_t probe(const std::string &key, uint32_t hash);
+	void reindex(size_t size);
+	PBXEntry* find(const std::string &key);
+	PBXValuePtr get(const std::string &key);
+
 	void clear();
-	void put(std::string key, std::string comment, PBXValuePtr val);
+	void swap(PBXMap &o);
+	void put(PBXAtom key, PBXAtom comment, PBXValuePtr val);
 	void putObject(PBXObjectPtr obj);
-	void replace(std::string key, PBXValuePtr val);
+	void replace(const std::string &key, PBXValuePtr val);
+	void erase(const std::set<std::string> &keys);
+	void set(PBXAtom key, PBXValuePtr val);
 
 	PBXId getId(std::string key);
 	std::string getString(std::string key, std::string default_str = "");
@@ -122,13 +174,107 @@ struct SUSHI_LIB PBXArray : PBXValue
 
 struct SUSHI_LIB PBXLiteral : PBXValue
 {
-	std::string literal_val;
+	PBXAtom literal_val;
 
-	PBXLiteral(std::string literal_val);
+	PBXLiteral(PBXAtom literal_val);
 
 	virtual PBXType type();
 };
 
+/*
+ * PBXField describes a typed member of a PBX class by key, kind and
+ * member pointer. Each class lists its members in a constant table in
+ * the order keys are written for new objects; the reader fills members
+ * from the parsed map and the writer serializes members directly, so
+ * objects are never synced back into their map.
+ */
+
+enum PBXFieldKind
+{
+	PBXFieldString,
+	PBXFieldInteger,
+	PBXFieldId,
+	PBXFieldArray,
+	PBXFieldMap
+};
+
+enum PBXFieldFlags
+{
+	PBXFieldOmitEmpty      = 0x1, /* string, id or array written only when not empty */
+	PBXFieldOmitNonZero    = 0x2, /* integer written only when zero */
+	PBXFieldOmitZero       = 0x4  /* integer written only when not zero */
+};
+
+template <typename T> struct PBXField
+{
+	const char *name;
+	PBXFieldKind kind;
+	int flags;
+	int default_int;
+	union {
+		PBXAtom T::*string_member;
+		int T::*int_member;
+		PBXId T::*id_member;
+		PBXArrayPtr T::*array_member;
+		PBXMapPtr T::*map_member;
+	};
+
+	constexpr PBXField(const char *name, PBXAtom T::*member, int flags = 0)
+		: name(name), kind(PBXFieldString), flags(flags), default_int(0), string_member(member) {}
+	constexpr PBXField(const char *name, int T::*member, int flags = 0, int default_int = 0)
+		: name(name), kind(PBXFieldInteger), flags(flags), default_int(default_int), int_member(member) {}
+	constexpr PBXField(const char *name, PBXId T::*member, int flags = 0)
+		: name(name), kind(PBXFieldId), flags(flags), default_int(0), id_member(member) {}
+	constexpr PBXField(const char *name, PBXArrayPtr T::*member, int flags = 0)
+		: name(name), kind(PBXFieldArray), flags(flags), default_int(0), array_member(member) {}
+	constexpr PBXField(const char *name, PBXMapPtr T::*member)
+		: name(name), kind(PBXFieldMap), flags(0), default_int(0), map_member(member) {}
+};
+
+template <typename T> struct PBXFieldTable
+{
+	const PBXField<T> *list;
+	size_t count;
+
+	constexpr PBXFieldTable() : list(nullptr), count(0) {}
+	template <size_t N> constexpr PBXFieldTable(const PBXField<T> (&list)[N]) : list(list), count(N) {}
+};
+
+/* PBXFieldValue is a field of one object with its member pointer bound */
+
+struct SUSHI_LIB PBXFieldValue
+{
+	PBXAtom name;
+	PBXFieldKind kind;
+	int flags;
+	int default_int;
+	union {
+		PBXAtom *string_val;
+		int *int_val;
+		PBXId *id_val;
+		PBXArrayPtr *array_val;
+		PBXMapPtr *map_val;
+	};
+
+	PBXFieldValue() : kind(PBXFieldString), flags(0), default_int(0), string_val(nullptr) {}
+
+	template <typename T> PBXFieldValue(PBXAtom name, const PBXField<T> &field, T &obj)
+		: name(name), kind(field.kind), flags(field.flags), default_int(field.default_int)
+	{
+		switch (kind) {
+			case PBXFieldString: string_val = &(obj.*field.string_member); break;
+			case PBXFieldInteger: int_val = &(obj.*field.int_member); break;
+			case PBXFieldId: id_val = &(obj.*field.id_member); break;
+			case PBXFieldArray: array_val = &(obj.*field.array_member); break;
+			case PBXFieldMap: map_val = &(obj.*field.map_member); break;
+		}
+	}
+
+	void read(PBXValuePtr val);
+	bool is_null() const;
+	bool omitted() const;
+};
+
 struct SUSHI_LIB PBXObject : PBXMap
 {
 	PBXId id;
@@ -142,10 +288,12 @@ struct SUSHI_LIB PBXObject : PBXMap
 
 	virtual const std::string& type_name();
 
-	virtual void syncFromMap() {}
-	virtual void syncToMap() {
-		setString("isa", type_name());
-	}
+	virtual size_t fieldCount() { return 0; }
+	virtual size_t fieldIndex(PBXAtom key) { return 0; }
+	virtual PBXFieldValue field(size_t i) { return PBXFieldValue(); }
+
+	virtual void syncFromMap();
+	virtual void prepareWrite() {}
 
 	virtual std::string to_string() {
 		std::stringstream ss;
@@ -165,6 +313,8 @@ struct PBXBuildStyle;
 struct PBXContainerItemProxy;
 struct PBXCopyFilesBuildPhase;
 struct PBXFileReference;
+struct PBXFileSystemSynchronizedBuildFileExceptionSet;
+struct PBXFileSystemSynchronizedRootGroup;
 struct PBXFrameworksBuildPhase;
 struct PBXGroup;
 struct PBXHeadersBuildPhase;
@@ -189,6 +339,8 @@ typedef std::shared_ptr<PBXBuildStyle> PBXBuildStylePtr;
 typedef std::shared_ptr<PBXContainerItemProxy> PBXContainerItemProxyPtr;
 typedef std::shared_ptr<PBXCopyFilesBuildPhase> PBXCopyFilesBuildPhasePtr;
 typedef std::shared_ptr<PBXFileReference> PBXFileReferencePtr;
+typedef std::shared_ptr<PBXFileSystemSynchronizedBuildFileExceptionSet> PBXFileSystemSynchronizedBuildFileExceptionSetPtr;
+typedef std::shared_ptr<PBXFileSystemSynchronizedRootGroup> PBXFileSystemSynchronizedRootGroupPtr;
 typedef std::shared_ptr<PBXFrameworksBuildPhase> PBXFrameworksBuildPhasePtr;
 typedef std::shared_ptr<PBXGroup> PBXGroupPtr;
 typedef std::shared_ptr<PBXHeadersBuildPhase> PBXHeadersBuildPhasePtr;
@@ -223,12 +375,61 @@ struct PBXObjectFactoryImpl : PBXObjectFactory
 
 template <typename T> struct PBXObjectImpl : PBXObject
 {
+	static const PBXFieldTable<T> fields;
+
 	const std::string& type_name() { return T::type_name; }
+
+	static std::vector<PBXAtom> internFieldNames()
+	{
+		std::vector<PBXAtom> names;
+		for (size_t i = 0; i < T::fields.count; i++) {
+			names.push_back(PBXAtom(T::fields.list[i].name));
+		}
+		return names;
+	}
+
+	static const std::vector<PBXAtom>& fieldNames()
+	{
+		static const std::vector<PBXAtom> names = internFieldNames();
+		return names;
+	}
+
+	size_t fieldCount() { return T::fields.count; }
+
+	size_t fieldIndex(PBXAtom key)
+	{
+		const std::vector<PBXAtom> &names = fieldNames();
+		size_t i = 0;
+		while (i < names.size() && names[i] != key) i++;
+		return i;
+	}
+
+	PBXFieldValue field(size_t i)
+	{
+		return PBXFieldValue(fieldNames()[i], T::fields.list[i], static_cast<T&>(*this));
+	}
+};
+
+template <typename T> const PBXFieldTable<T> PBXObjectImpl<T>::fields;
+
+/*
+ * PBXLazyObject is the byte range of an unparsed object in the source
+ * buffer of a lazily read project.
+ */
+
+struct SUSHI_LIB PBXLazyObject
+{
+	size_t offset;
+	size_t length;
+
+	PBXLazyObject() : offset(0), length(0) {}
+	PBXLazyObject(size_t offset, size_t length) : offset(offset), length(length) {}
 };
 
 struct SUSHI_LIB Xcodeproj : PBXObjectImpl<Xcodeproj>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<Xcodeproj> fields;
 	virtual PBXType type() { return PBXTypeXcodeproj; }
 
 	static bool factoryInit;
@@ -248,57 +449,146 @@ struct SUSHI_LIB Xcodeproj : PBXObjectImpl<Xcodeproj>
 	PBXMapPtr objects;
 	PBXId rootObject;
 
+	/* name that the ids of created objects are derived under */
+	std::string projectName;
+
+	/* generated xcconfig files by path, when settings are not inline */
+	std::string configDir;
+	std::map<std::string,std::string> configFiles;
+
+	/*
+	 * Secondary indexes keyed by id string, maintained by createObject
+	 * and at the points where relationships are made, and rebuilt from
+	 * the object map after parsing. childIndex is keyed by group id, isa
+	 * and path component and also serves product lookups in Products.
+	 */
+	std::unordered_map<std::string,std::vector<PBXObjectPtr>> isaIndex;
+	std::unordered_map<std::string,PBXBuildFilePtr> buildFileIndex;
+	std::unordered_map<std::string,PBXObjectPtr> childIndex;
+
+	/*
+	 * Objects not yet parsed when read lazily, by position in objects.
+	 * The entries keep file order while their values are filled in on
+	 * first access from lazySource, and indexes are built once everything
+	 * is materialized.
+	 */
+	mapped_file_ptr lazySource;
+	std::vector<PBXLazyObject> lazyObjects;
+	size_t lazyCount;
+
 	Xcodeproj();
 
+	void indexObject(PBXObjectPtr obj);
+	void indexChild(PBXGroupPtr group, PBXObjectPtr child, std::string path);
+	void rebuildIndexes();
+	PBXObjectPtr findChild(PBXGroupPtr group, std::string isa, std::string path);
+	std::vector<PBXObjectPtr>& getObjectsOfType(std::string isa) { return isaIndex[isa]; }
+
 	PBXFileReferencePtr getFileReferenceForPath(std::string path, bool create = true);
 	PBXFileReferencePtr getProductReference(std::string path);
 	PBXBuildFilePtr getBuildFile(PBXFileReferencePtr &fileRef, std::string comment);
 
 	static XcodeprojPtr createProject(project_root_ptr root);
+	static XcodeprojPtr updateProject(project_root_ptr root);
 	
 	void createEmptyProject(project_root_ptr root, std::string projectName);
+	void setObjectVersion(project_root_ptr root);
+	void setParallelBuild(project_root_ptr root);
+	static std::string getConfigDir(project_root_ptr root);
+	void projectBuildSettings(project_root_ptr root, std::string config_name, PBXMapPtr buildSettings);
+	XCBuildConfigurationPtr createProjectConfiguration(project_root_ptr root, std::string config_name);
+	void addConfigFile(project_root_ptr root, std::string config_name);
+	std::string configFilePath(std::string config_name);
+	void setBaseConfiguration(XCBuildConfigurationPtr configuration);
+	XCBuildConfigurationPtr createTargetConfiguration(std::string targetName, std::string config_name);
+	PBXBuildFilePtr getSourceBuildFile(std::string sourceFile);
 	PBXNativeTargetPtr createNativeTarget(project_root_ptr root, std::map<std::string,std::string> defines,
 		std::string targetName, std::string targetProduct,
 		std::string targetType, std::string targetProductType,
 		std::vector<std::string> libraries,
-		std::vector<std::string> source);
-	void linkNativeTarget(PBXNativeTargetPtr nativeTarget, std::vector<std::string> libraries);
+		std::vector<std::string> source,
+		std::string sourceDir = std::string());
+	PBXFileSystemSynchronizedRootGroupPtr getSynchronizedGroup(std::string dir);
+	PBXFileSystemSynchronizedBuildFileExceptionSetPtr getExceptionSet(PBXFileSystemSynchronizedRootGroupPtr group,
+		PBXNativeTargetPtr nativeTarget);
+	bool syncSynchronizedGroup(PBXNativeTargetPtr nativeTarget, std::string dir,
+		const std::vector<std::string> &source, std::set<std::string> &removed);
+	PBXFrameworksBuildPhasePtr linkNativeTarget(PBXNativeTargetPtr nativeTarget, std::vector<std::string> libraries);
+	void linkProjectReference(PBXNativeTargetPtr nativeTarget, PBXFrameworksBuildPhasePtr frameworkBuildPhase,
+		std::string projectPath, std::string targetName, std::string targetProduct, std::string targetType);
+	PBXNativeTargetPtr getTargetForProduct(PBXFileReferencePtr &productRef);
+	void addTargetDependency(PBXNativeTargetPtr nativeTarget, PBXNativeTargetPtr dependency);
+
+	void mergeProject(project_root_ptr root);
+	void syncConfigurations(PBXId listId, project_root_ptr root, std::set<std::string> &removed,
+		std::function<XCBuildConfigurationPtr(std::string)> create);
+	bool rebaseProjectConfiguration(project_root_ptr root, XCBuildConfigurationPtr configuration);
+	void rebaseTargetConfigurations(PBXId listId);
+	void removeNativeTarget(PBXNativeTargetPtr nativeTarget, std::set<std::string> &removed);
+	void syncTargetDependencies(PBXNativeTargetPtr nativeTarget,
+		const std::vector<PBXNativeTargetPtr> &dependencies, std::set<std::string> &removed);
+	bool pruneGroup(PBXGroupPtr group, std::string prefix,
+		const std::set<std::string> &keep, std::set<std::string> &removed);
 
 	void write(project_root_ptr root);
 	void write(std::string project_file);
+	void writeSchemes(std::string project_dir);
+	void writeConfigFiles();
 
 	void syncFromMap();
-	void syncToMap();
+	void prepareWrite();
+
+	PBXObjectPtr materializeObject(std::string id_str);
+	void materializeEntry(size_t i);
+	void materializeAll();
 
 	PBXProjectPtr getProject()
 	{
-		return std::static_pointer_cast<PBXProject>(objects->getObject(rootObject));
+		return getObject<PBXProject>(rootObject);
 	}
 
 	template<typename T> std::shared_ptr<T> getObject(PBXId id)
 	{
+		if (lazyCount > 0) {
+			return std::static_pointer_cast<T>(materializeObject(id.str()));
+		}
 		return std::static_pointer_cast<T>(objects->getObject(id));
 	}
 
-	PBXObjectPtr createObject(std::string class_name, const PBXId &id, const PBXMap &map)
+	PBXObjectPtr createObject(std::string class_name, const PBXId &id, PBXMap &map)
 	{
 		init();
 		auto it = factoryMap.find(class_name);
 		PBXObjectPtr ptr = it != factoryMap.end() ? it->second->create() : std::make_shared<PBXObject>();
 		ptr->id = id;
 		ptr->xcodeproj = this;
-		ptr->object_val = map.object_val;
-		ptr->key_order = map.key_order;
+		ptr->swap(map);
 		return ptr;
 	}
 
-	template<typename T> std::shared_ptr<T> createObject(std::string comment)
+	/*
+	 * Ids are derived from the project name, class and identity of the
+	 * object, such as its path or owning target, and rehashed with a
+	 * counter in the unlikely event of a collision. Other projects derive
+	 * the ids of objects they refer to in the same way.
+	 */
+	static std::string objectKey(std::string projectName, std::string className, std::string identity)
+	{
+		return projectName + "/" + className + "/" + identity;
+	}
+
+	template<typename T> std::shared_ptr<T> createObject(std::string comment, std::string identity)
 	{
 		auto obj = std::make_shared<T>();
-		obj->id = PBXId::createId(rootObject);
+		std::string key = objectKey(projectName, T::type_name, identity);
+		obj->id = PBXId::createId(key);
+		for (int salt = 1; objects->find(obj->id.str()); salt++) {
+			obj->id = PBXId::createId(key + "/" + std::to_string(salt));
+		}
 		obj->id.comment = comment;
 		obj->xcodeproj = this;
 		objects->putObject(obj);
+		indexObject(obj);
 		return obj;
 	}
 };
@@ -306,104 +596,90 @@ struct SUSHI_LIB Xcodeproj : PBXObjectImpl<Xcodeproj>
 struct SUSHI_LIB PBXAggregateTarget : PBXObjectImpl<PBXAggregateTarget>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXAggregateTarget> fields;
 
 	PBXId buildConfigurationList;
 	PBXArrayPtr buildPhases;
 	PBXArrayPtr dependencies;
-	std::string name;
-	std::string productName;
+	PBXAtom name;
+	PBXAtom productName;
 
 	PBXAggregateTarget();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXAppleScriptBuildPhase : PBXObjectImpl<PBXAppleScriptBuildPhase>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXAppleScriptBuildPhase> fields;
 
 	int buildActionMask;
 	PBXArrayPtr files;
 	int runOnlyForDeploymentPostprocessing;
 
 	PBXAppleScriptBuildPhase();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXBuildFile : PBXObjectImpl<PBXBuildFile>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXBuildFile> fields;
 
 	PBXId fileRef;
 
 	PBXBuildFile();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXBuildRule : PBXObjectImpl<PBXBuildRule>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXBuildRule> fields;
 
-	std::string compilerSpec;
-	std::string filePatterns;
-	std::string type;
+	PBXAtom compilerSpec;
+	PBXAtom filePatterns;
+	PBXAtom type;
 	int isEditable;
 	PBXArrayPtr outputFiles;
-	std::string script;
+	PBXAtom script;
 
 	PBXBuildRule();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXBuildStyle : PBXObjectImpl<PBXBuildStyle>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXBuildStyle> fields;
 
 	PBXMapPtr buildSettings;
-	std::string name;
+	PBXAtom name;
 
 	PBXBuildStyle();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXContainerItemProxy : PBXObjectImpl<PBXContainerItemProxy>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXContainerItemProxy> fields;
 
 	PBXId containerPortal;
 	int proxyType;
 	PBXId remoteGlobalIDString;
-	std::string remoteInfo;
+	PBXAtom remoteInfo;
 
 	PBXContainerItemProxy();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXCopyFilesBuildPhase : PBXObjectImpl<PBXCopyFilesBuildPhase>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXCopyFilesBuildPhase> fields;
 
 	int buildActionMask;
-	std::string dstPath;
+	PBXAtom dstPath;
 	int dstSubfolderSpec;
 	PBXArrayPtr files;
 	int runOnlyForDeploymentPostprocessing;
 
 	PBXCopyFilesBuildPhase();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 enum FileType
@@ -439,6 +715,7 @@ struct SUSHI_LIB FileTypeMetaData
 struct SUSHI_LIB PBXFileReference : PBXObjectImpl<PBXFileReference>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXFileReference> fields;
 
 	static const std::string ext_c_source;
 	static const std::string ext_c_header;
@@ -469,6 +746,8 @@ struct SUSHI_LIB PBXFileReference : PBXObjectImpl<PBXFileReference>
 	static const std::string type_bundle;
 	static const std::string type_framework;
 	static const std::string type_executable;
+	static const std::string type_project;
+	static const std::string type_xcconfig;
 
 	static bool extTypeMapInit;
 	static std::map<std::string,FileTypeMetaData*> extTypeMap;
@@ -478,84 +757,99 @@ struct SUSHI_LIB PBXFileReference : PBXObjectImpl<PBXFileReference>
 	static FileTypeMetaData* getFileMetaForPath(std::string path);
 	static FileTypeMetaData* getFileMetaForExtension(std::string ext);
 
-	std::string explicitFileType;
-	std::string lastKnownFileType;
+	PBXAtom explicitFileType;
+	PBXAtom lastKnownFileType;
 	int includeInIndex;
-	std::string path;
-	std::string sourceTree;
+	PBXAtom path;
+	PBXAtom sourceTree;
 
 	PBXFileReference();
+};
 
-	void syncFromMap();
-	void syncToMap();
+struct SUSHI_LIB PBXFileSystemSynchronizedBuildFileExceptionSet : PBXObjectImpl<PBXFileSystemSynchronizedBuildFileExceptionSet>
+{
+	static const std::string type_name;
+	static const PBXFieldTable<PBXFileSystemSynchronizedBuildFileExceptionSet> fields;
+
+	PBXArrayPtr membershipExceptions;
+	PBXId target;
+
+	PBXFileSystemSynchronizedBuildFileExceptionSet();
+};
+
+struct SUSHI_LIB PBXFileSystemSynchronizedRootGroup : PBXObjectImpl<PBXFileSystemSynchronizedRootGroup>
+{
+	static const std::string type_name;
+	static const PBXFieldTable<PBXFileSystemSynchronizedRootGroup> fields;
+
+	PBXArrayPtr exceptions;
+	PBXAtom path;
+	PBXAtom sourceTree;
+
+	PBXFileSystemSynchronizedRootGroup();
 };
 
 struct SUSHI_LIB PBXFrameworksBuildPhase : PBXObjectImpl<PBXFrameworksBuildPhase>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXFrameworksBuildPhase> fields;
 
 	int buildActionMask;
 	PBXArrayPtr files;
 	int runOnlyForDeploymentPostprocessing;
 
 	PBXFrameworksBuildPhase();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXGroup : PBXObjectImpl<PBXGroup>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXGroup> fields;
 
 	PBXArrayPtr children;
-	std::string name;
-	std::string path;
-	std::string sourceTree;
+	PBXAtom name;
+	PBXAtom path;
+	PBXAtom sourceTree;
 
 	PBXGroup();
 
-	void syncFromMap();
-	void syncToMap();
+	void prepareWrite();
 	void sortChildren();
 };
 
 struct SUSHI_LIB PBXHeadersBuildPhase : PBXObjectImpl<PBXHeadersBuildPhase>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXHeadersBuildPhase> fields;
 
 	int buildActionMask;
 	PBXArrayPtr files;
 	int runOnlyForDeploymentPostprocessing;
 
 	PBXHeadersBuildPhase();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXLegacyTarget : PBXObjectImpl<PBXLegacyTarget>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXLegacyTarget> fields;
 
-	std::string buildArgumentsString;
+	PBXAtom buildArgumentsString;
 	PBXId buildConfigurationList;
 	PBXArrayPtr buildPhases;
-	std::string buildToolPath;
+	PBXAtom buildToolPath;
 	PBXArrayPtr dependencies;
-	std::string name;
+	PBXAtom name;
 	int passBuildSettingsInEnvironment;
-	std::string productName;
+	PBXAtom productName;
 
 	PBXLegacyTarget();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXNativeTarget : PBXObjectImpl<PBXNativeTarget>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXNativeTarget> fields;
 
 	static const std::string type_application;
 	static const std::string type_bundle;
@@ -568,154 +862,137 @@ struct SUSHI_LIB PBXNativeTarget : PBXObjectImpl<PBXNativeTarget>
 	PBXArrayPtr buildPhases;
 	PBXArrayPtr buildRules;
 	PBXArrayPtr dependencies;
-	std::string name;
-	std::string productName;
+	PBXArrayPtr fileSystemSynchronizedGroups;
+	PBXAtom name;
+	PBXAtom productName;
 	PBXId productReference;
-	std::string productType;
+	PBXAtom productType;
 
 	PBXNativeTarget();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXProject : PBXObjectImpl<PBXProject>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXProject> fields;
 
 	PBXMapPtr attributes;
 	PBXId buildConfigurationList;
-	std::string compatibilityVersion;
-	std::string developmentRegion;
+	PBXAtom compatibilityVersion;
+	PBXAtom developmentRegion;
 	int hasScannedForEncodings;
 	PBXArrayPtr knownRegions;
 	PBXId mainGroup;
+	int preferredProjectObjectVersion;
 	PBXId productRefGroup;
-	std::string projectDirPath;
+	PBXAtom projectDirPath;
 	PBXArrayPtr projectReferences;
-	std::string projectRoot;
+	PBXAtom projectRoot;
 	PBXArrayPtr targets;
 
 	PBXProject();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXReferenceProxy : PBXObjectImpl<PBXReferenceProxy>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXReferenceProxy> fields;
 
-	std::string type;
-	std::string path;
+	PBXAtom fileType;
+	PBXAtom path;
 	PBXId remoteRef;
-	std::string sourceTree;
+	PBXAtom sourceTree;
 
 	PBXReferenceProxy();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXResourcesBuildPhase : PBXObjectImpl<PBXResourcesBuildPhase>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXResourcesBuildPhase> fields;
 
 	int buildActionMask;
 	PBXArrayPtr files;
 	int runOnlyForDeploymentPostprocessing;
 
 	PBXResourcesBuildPhase();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXShellScriptBuildPhase : PBXObjectImpl<PBXShellScriptBuildPhase>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXShellScriptBuildPhase> fields;
 
 	int buildActionMask;
 	PBXArrayPtr files;
 	PBXArrayPtr inputPaths;
 	PBXArrayPtr outputPaths;
 	int runOnlyForDeploymentPostprocessing;
-	std::string shellPath;
-	std::string shellScript;
+	PBXAtom shellPath;
+	PBXAtom shellScript;
 
 	PBXShellScriptBuildPhase();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXSourcesBuildPhase : PBXObjectImpl<PBXSourcesBuildPhase>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXSourcesBuildPhase> fields;
 
 	int buildActionMask;
 	PBXArrayPtr files;
 	int runOnlyForDeploymentPostprocessing;
 
 	PBXSourcesBuildPhase();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXTargetDependency : PBXObjectImpl<PBXTargetDependency>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXTargetDependency> fields;
 
+	PBXAtom name;
 	PBXId target;
 	PBXId targetProxy;
 
 	PBXTargetDependency();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB PBXVariantGroup : PBXObjectImpl<PBXVariantGroup>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<PBXVariantGroup> fields;
 
 	PBXArrayPtr children;
-	std::string name;
-	std::string path;
-	std::string sourceTree;
+	PBXAtom name;
+	PBXAtom path;
+	PBXAtom sourceTree;
 
 	PBXVariantGroup();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB XCBuildConfiguration : PBXObjectImpl<XCBuildConfiguration>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<XCBuildConfiguration> fields;
 
+	PBXId baseConfigurationReference;
 	PBXMapPtr buildSettings;
-	std::string name;
+	PBXAtom name;
 
 	XCBuildConfiguration();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB XCConfigurationList : PBXObjectImpl<XCConfigurationList>
 {
 	static const std::string type_name;
+	static const PBXFieldTable<XCConfigurationList> fields;
 
 	PBXArrayPtr buildConfigurations;
 	int defaultConfigurationIsVisible;
-	std::string defaultConfigurationName;
+	PBXAtom defaultConfigurationName;
 
 	XCConfigurationList();
-
-	void syncFromMap();
-	void syncToMap();
 };
 
 struct SUSHI_LIB XCVersionGroup : PBXObjectImpl<XCVersionGroup>
@@ -724,29 +1001,46 @@ struct SUSHI_LIB XCVersionGroup : PBXObjectImpl<XCVersionGroup>
 };
 
 
+/* Xcode workspace */
+
+struct Xcworkspace;
+typedef std::shared_ptr<Xcworkspace> XcworkspacePtr;
+
+/*
+ * Xcworkspace holds one project per library and tool, so Xcode opens and
+ * indexes modules separately and regenerating rewrites only the projects
+ * that changed. Projects link the products of the projects they use with
+ * reference proxies. Ids of objects in other projects are derived rather
+ * than looked up, so the projects are created and written in parallel.
+ */
+struct SUSHI_LIB Xcworkspace
+{
+	static const std::string projects_dir;
+
+	std::vector<XcodeprojPtr> projects;
+
+	static XcworkspacePtr createWorkspace(project_root_ptr root);
+
+	void write(project_root_ptr root);
+};
+
+
 /* PBX parser state machine */
 
 enum PBXParseState
 {
 	PBXParseStateNone                       = 0,
 	PBXParseStateSlashBang                  = 1,
-	PBXParseStateEatWhitespace              = 2,
-	PBXParseStateObjectComment              = 3,
-	PBXParseStateObjectAttrName             = 4,
-	PBXParseStateObjectAttrComment          = 5,
-	PBXParseStateObjectAttrEquals           = 6,
-	PBXParseStateObjectValue                = 7,
-	PBXParseStateObjectValueQuotedLiteral   = 8,
-	PBXParseStateObjectValueLiteral         = 9,
-	PBXParseStateObjectValueComment         = 10,
-	PBXParseStateObjectValueSemicolon       = 11,
-	PBXParseStateArrayValue                 = 12,
-	PBXParseStateArrayValueLiteral          = 13,
-	PBXParseStateArrayValueQuotedLiteral    = 14,
-	PBXParseStateArrayValueComment          = 15,
-	PBXParseStateArrayValueComma            = 16,
-	PBXParseStateFinalSemicolon             = 17,
-	PBXParseStateTrailingWhitespace         = 18,
+	PBXParseStateObjectComment              = 2,
+	PBXParseStateObjectAttrName             = 3,
+	PBXParseStateObjectAttrComment          = 4,
+	PBXParseStateObjectAttrEquals           = 5,
+	PBXParseStateObjectValue                = 6,
+	PBXParseStateObjectValueComment         = 7,
+	PBXParseStateObjectValueSemicolon       = 8,
+	PBXParseStateArrayValue                 = 9,
+	PBXParseStateArrayValueComment          = 10,
+	PBXParseStateArrayValueComma            = 11,
 };
 
 enum PBXParseError
@@ -758,62 +1052,138 @@ enum PBXParseError
 	PBXParseErrorUnexpectedBracket          = 4,
 	PBXParseErrorUnexpectedParenthesis      = 5,
 	PBXParseErrorExpectedArraySeparator     = 6,
-	PBXParseErrorExpectedWhitespace         = 7
+	PBXParseErrorExpectedWhitespace         = 7,
+	PBXParseErrorUnterminatedComment        = 8,
+	PBXParseErrorUnterminatedString         = 9
 };
 
+/*
+ * PBXParser tokenizes a buffer in place and passes each token to the
+ * callbacks as a pointer and length into the buffer; only quoted strings
+ * containing escapes are copied. Delimiters are found with SSE2 or AVX2
+ * compares when available, falling back to a table lookup per byte.
+ *
+ * A subclass that returns true from skip_object is passed the bytes of
+ * the object value instead, found by bracket matching without callbacks.
+ */
+
 struct SUSHI_LIB PBXParser
 {
-	PBXParseError parse(std::vector<char> &buf);
+	static bool use_simd;
+
+	mapped_file_ptr source;
+
+	virtual ~PBXParser() {}
+
+	PBXParseError read(std::string project_file);
+	PBXParseError parse(const char *buf, size_t len);
+	PBXParseError parse(std::vector<char> &buf) { return parse(buf.data(), buf.size()); }
+	PBXParseError parseValue(const char *buf, size_t len);
+	PBXParseError parse(const char *buf, size_t len, PBXParseState state);
+
+	virtual bool skip_object() { return false; }
+	virtual void skipped_object(const char *value, size_t length) {}
 
 	virtual void begin_object() = 0;
 	virtual void end_object() = 0;
-	virtual void object_comment(std::string str) = 0;
-	virtual void object_attr(std::string str) = 0;
-	virtual void object_attr_comment(std::string str) = 0;
-	virtual void object_value_literal(std::string str) = 0;
-	virtual void object_value_comment(std::string str) = 0;
+	virtual void object_comment(const char *value, size_t length) = 0;
+	virtual void object_attr(const char *value, size_t length) = 0;
+	virtual void object_attr_comment(const char *value, size_t length) = 0;
+	virtual void object_value_literal(const char *value, size_t length) = 0;
+	virtual void object_value_comment(const char *value, size_t length) = 0;
 	virtual void begin_array() = 0;
 	virtual void end_array() = 0;
-	virtual void array_value_literal(std::string str) = 0;
-	virtual void array_value_comment(std::string str) = 0;
+	virtual void array_value_literal(const char *value, size_t length) = 0;
+	virtual void array_value_comment(const char *value, size_t length) = 0;
 };
 
 
-/* PBX parser implementation */
+/*
+ * PBXParserImpl builds an Xcodeproj. In lazy mode, which applies to
+ * projects opened with read, the values of the objects dictionary are
+ * skipped and recorded as byte ranges, to be parsed by getObject.
+ */
 
 struct SUSHI_LIB PBXParserImpl : PBXParser
 {
 	static const bool debug = false;
 
-	static bool literal_is_hex_id(std::string str);
+	static bool literal_is_hex_id(const char *value, size_t length);
+	static const size_t literal_cache_size = 4096;
 
+	bool lazy;
 	XcodeprojPtr xcodeproj;
 	PBXValuePtr valptr;
+	PBXValuePtr lazy_objects;
 	std::vector<PBXValuePtr> value_stack;
-	std::string current_attr_name;
-	std::string current_attr_comment;
+	std::vector<PBXValuePtr> literal_cache;
+	PBXAtom current_attr_name;
+	PBXAtom current_attr_comment;
 
+	PBXParserImpl() : lazy(false) {}
+
+	PBXValuePtr literal_value(const char *value, size_t length);
+	bool skip_object();
+	void skipped_object(const char *value, size_t length);
 	void begin_object();
 	void end_object();
-	void object_comment(std::string str);
-	void object_attr(std::string str);
-	void object_attr_comment(std::string str);
-	void object_value_literal(std::string str);
-	void object_value_comment(std::string str);
+	void object_comment(const char *value, size_t length);
+	void object_attr(const char *value, size_t length);
+	void object_attr_comment(const char *value, size_t length);
+	void object_value_literal(const char *value, size_t length);
+	void object_value_comment(const char *value, size_t length);
 	void begin_array();
 	void end_array();
-	void array_value_literal(std::string str);
-	void array_value_comment(std::string str);
+	void array_value_literal(const char *value, size_t length);
+	void array_value_comment(const char *value, size_t length);
 };
 
 
 /* PBX writer */
 
+/*
+ * PBXWriter serializes into one contiguous buffer, walking maps, objects
+ * and arrays with an explicit stack of frames instead of recursion.
+ */
+
+enum PBXWriteStep
+{
+	PBXWriteValue,
+	PBXWriteNested,
+	PBXWriteEnd
+};
+
+struct SUSHI_LIB PBXWriterFrame
+{
+	PBXValue *value;
+	int indent;
+	size_t pos;
+	size_t field;
+	size_t count;
+	uint64_t written;
+
+	PBXWriterFrame(PBXValue *value, int indent, size_t count)
+		: value(value), indent(indent), pos(0), field(0), count(count), written(0) {}
+};
+
 struct SUSHI_LIB PBXWriter
 {
-	static const char* LITERAL_CHARS;
-	static bool literal_requires_quotes(std::string str);
-	static std::string escape_quotes(std::string str);
+	std::string buf;
+	std::vector<PBXWriterFrame> stack;
+
+	PBXWriter();
+
+	void write_indent(int indent);
+	void write_key(const PBXAtom &key, const PBXAtom &comment, int indent);
+	void write_literal(const std::string &str);
+	void write_integer(int val);
+	void write_id(const PBXId &id);
+	bool begin_value(PBXValue &value, int indent);
+	bool begin_field(const PBXFieldValue &field, int indent);
+	PBXWriteStep next_element(PBXWriterFrame &frame);
+	PBXWriteStep next_entry(PBXWriterFrame &frame);
+	void write(PBXValue &value, int indent);
+
 	static void write(PBXValuePtr value, std::ostream &out, int indent);
 };
 
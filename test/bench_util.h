@@ -0,0 +1,24 @@
+//
+//  bench_util.h
+//
+
+#ifndef bench_util_h
+#define bench_util_h
+
+/* matches --name=value and returns the value */
+static inline bool match_option(const char *arg, const char *name, std::string &value)
+{
+	size_t len = strlen(name);
+	if (strncmp(arg, name, len) != 0 || arg[len] != '=') return false;
+	value = arg + len + 1;
+	return true;
+}
+
+/* writes a generated source or project file, creating its directories */
+static inline void write_tree_file(std::string path, std::string contents)
+{
+	util::make_directories(path);
+	util::write_file(path, contents);
+}
+
+#endif
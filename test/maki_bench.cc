@@ -0,0 +1,420 @@
+//
+//  maki_bench.cc
+//
+
+#include <cmath>
+
+#ifdef _WIN32
+#include <direct.h>
+#define chdir _chdir
+#define getcwd _getcwd
+#else
+#include <unistd.h>
+#endif
+
+#include "sushi.h"
+#include "bench_util.h"
+
+
+/* options */
+
+struct bench_shape
+{
+	int libs;
+	int tools;
+	int files;
+	int fanout;
+	int depth;
+	int dir_depth;
+
+	bench_shape() : libs(8), tools(2), files(16), fanout(2), depth(3), dir_depth(2) {}
+};
+
+static bench_shape shape;
+static std::vector<int> sizes = { 1, 2, 4, 8, 16 };
+static std::vector<std::string> backends = { "xcode", "vs", "ninja" };
+static std::string bench_dir = "bench";
+static std::string out_file;
+static int runs = 3;
+static double threshold = 1.3;
+
+static void print_usage(char **argv)
+{
+	fprintf(stderr, "usage: %s [options]\n", argv[0]);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  --libs=<n>            libraries at size 1 (default %d)\n", shape.libs);
+	fprintf(stderr, "  --tools=<n>           tools at size 1 (default %d)\n", shape.tools);
+	fprintf(stderr, "  --files=<n>           source files per target (default %d)\n", shape.files);
+	fprintf(stderr, "  --fanout=<n>          libs each target links against (default %d)\n", shape.fanout);
+	fprintf(stderr, "  --depth=<n>           layers in the dependency graph (default %d)\n", shape.depth);
+	fprintf(stderr, "  --dir-depth=<n>       directory nesting above each target (default %d)\n", shape.dir_depth);
+	fprintf(stderr, "  --sizes=<n,...>       target count multipliers (default 1,2,4,8,16)\n");
+	fprintf(stderr, "  --backends=<b,...>    backends to time (default xcode,vs,ninja)\n");
+	fprintf(stderr, "  --runs=<n>            runs per point, the fastest is kept (default %d)\n", runs);
+	fprintf(stderr, "  --threshold=<slope>   log-log slope reported as super-linear (default %.1f)\n", threshold);
+	fprintf(stderr, "  --dir=<path>          directory for generated trees (default %s)\n", bench_dir.c_str());
+	fprintf(stderr, "  --out=<file.json>     write results to file instead of stdout\n");
+	exit(1);
+}
+
+static void parse_options(int argc, char **argv)
+{
+	std::string value;
+	for (int i = 1; i < argc; i++) {
+		if (match_option(argv[i], "--libs", value)) {
+			shape.libs = std::max(1, atoi(value.c_str()));
+		} else if (match_option(argv[i], "--tools", value)) {
+			shape.tools = std::max(0, atoi(value.c_str()));
+		} else if (match_option(argv[i], "--files", value)) {
+			shape.files = std::max(1, atoi(value.c_str()));
+		} else if (match_option(argv[i], "--fanout", value)) {
+			shape.fanout = std::max(0, atoi(value.c_str()));
+		} else if (match_option(argv[i], "--depth", value)) {
+			shape.depth = std::max(1, atoi(value.c_str()));
+		} else if (match_option(argv[i], "--dir-depth", value)) {
+			shape.dir_depth = std::max(0, atoi(value.c_str()));
+		} else if (match_option(argv[i], "--sizes", value)) {
+			sizes.clear();
+			for (std::string size : util::split(value, ",")) {
+				sizes.push_back(std::max(1, atoi(size.c_str())));
+			}
+		} else if (match_option(argv[i], "--backends", value)) {
+			backends = util::split(value, ",");
+		} else if (match_option(argv[i], "--runs", value)) {
+			runs = std::max(1, atoi(value.c_str()));
+		} else if (match_option(argv[i], "--threshold", value)) {
+			threshold = atof(value.c_str());
+		} else if (match_option(argv[i], "--dir", value)) {
+			bench_dir = value;
+		} else if (match_option(argv[i], "--out", value)) {
+			out_file = value;
+		} else {
+			print_usage(argv);
+		}
+	}
+	for (std::string backend : backends) {
+		if (backend != "xcode" && backend != "xcworkspace" && backend != "vs" && backend != "ninja") {
+			fprintf(stderr, "unknown project format: %s\n", backend.c_str());
+			print_usage(argv);
+		}
+	}
+}
+
+
+/* synthetic project */
+
+/*
+ * Libraries are arranged in depth layers and each target links against
+ * fanout libraries from the layer below it, so the transitive closure
+ * grows with both fanout and depth. Targets are spread over a directory
+ * tree dir_depth levels deep and each is matched with a source glob.
+ */
+
+struct bench_target
+{
+	std::string name;
+	std::string dir;
+	std::vector<std::string> libs;
+};
+
+struct bench_tree
+{
+	std::string dir;
+	std::vector<bench_target> libs;
+	std::vector<bench_target> tools;
+	size_t file_count;
+
+	bench_tree() : file_count(0) {}
+};
+
+static std::string target_dir(std::string kind, int index)
+{
+	std::string dir = kind;
+	for (int d = 0; d < shape.dir_depth; d++) {
+		dir += format_string("/g%d", (index >> (d * 2)) & 3);
+	}
+	return dir;
+}
+
+static std::vector<std::string> layer_libs(std::vector<bench_target> &libs, int layer, int depth, int seed)
+{
+	std::vector<std::string> deps;
+	size_t layer_size = (libs.size() + depth - 1) / depth;
+	size_t layer_begin = layer * layer_size;
+	size_t layer_end = std::min(libs.size(), layer_begin + layer_size);
+	if (layer_begin >= layer_end) return deps;
+	size_t count = std::min((size_t)shape.fanout, layer_end - layer_begin);
+	for (size_t j = 0; j < count; j++) {
+		deps.push_back(libs[layer_begin + (seed * 7 + j) % (layer_end - layer_begin)].name);
+	}
+	return deps;
+}
+
+static void write_target_sources(bench_tree &tree, bench_target &target)
+{
+	for (int f = 0; f < shape.files; f++) {
+		std::string base = format_string("%s/%s/%s_%d", tree.dir.c_str(),
+			target.dir.c_str(), target.name.c_str(), f);
+		write_tree_file(base + ".h", format_string("int %s_%d();\n", target.name.c_str(), f));
+		write_tree_file(base + ".cc", format_string("#include \"%s_%d.h\"\nint %s_%d() { return %d; }\n",
+			target.name.c_str(), f, target.name.c_str(), f, f));
+		tree.file_count += 2;
+	}
+}
+
+static void write_target_block(std::stringstream &ss, std::string kind, bench_target &target)
+{
+	ss << "\t" << kind << " " << target.name << " {\n";
+	ss << "\t\tsource " << target.dir << "/" << target.name << "_*.(cc|h);\n";
+	if (kind == "lib") {
+		ss << "\t\texport_includes " << target.dir << ";\n";
+	}
+	if (target.libs.size() > 0) {
+		ss << "\t\tlibs " << util::join(target.libs, " ") << ";\n";
+	}
+	ss << "\t}\n\n";
+}
+
+static bench_tree generate_tree(int size)
+{
+	bench_tree tree;
+	tree.dir = format_string("%s/size_%d", bench_dir.c_str(), size);
+
+	int nlibs = shape.libs * size;
+	int ntools = shape.tools * size;
+	int depth = std::min(shape.depth, nlibs);
+	for (int i = 0; i < nlibs; i++) {
+		bench_target lib;
+		lib.name = format_string("lib%d", i);
+		lib.dir = target_dir("libs", i) + "/" + lib.name;
+		tree.libs.push_back(lib);
+	}
+	int layer_size = (nlibs + depth - 1) / depth;
+	for (int i = 0; i < nlibs; i++) {
+		tree.libs[i].libs = layer_libs(tree.libs, i / layer_size + 1, depth, i);
+	}
+	for (int i = 0; i < ntools; i++) {
+		bench_target tool;
+		tool.name = format_string("tool%d", i);
+		tool.dir = target_dir("tools", i) + "/" + tool.name;
+		tool.libs = layer_libs(tree.libs, 0, depth, i);
+		tree.tools.push_back(tool);
+	}
+
+	std::stringstream ss;
+	ss << "project bench {\n\n";
+	ss << "\tconfig * {\n";
+	ss << "\t\tset x_apple_sdkroot macosx;\n";
+	ss << "\t\tset x_apple_target 10.10;\n";
+	ss << "\t\tset x_ms_platform_toolset v120;\n";
+	ss << "\t\tset x_ms_platform_version 8.1;\n";
+	ss << "\t}\n\n";
+	ss << "\tconfig Debug {\n\t\tdefines DEBUG;\n\t\tset optimization 0;\n\t}\n\n";
+	ss << "\tconfig Release {\n\t\tdefines NDEBUG;\n\t\tset optimization 3;\n\t}\n\n";
+	ss << "\tlib * {\n\t\ttype static;\n\t}\n\n";
+	for (auto &lib : tree.libs) {
+		write_target_sources(tree, lib);
+		write_target_block(ss, "lib", lib);
+	}
+	for (auto &tool : tree.tools) {
+		write_target_sources(tree, tool);
+		write_target_block(ss, "tool", tool);
+	}
+	ss << "}\n";
+	write_tree_file(tree.dir + "/bench.sushi", ss.str());
+
+	return tree;
+}
+
+
+/* benchmark */
+
+struct bench_point
+{
+	int size;
+	size_t targets;
+	size_t files;
+	double total;
+	std::map<std::string,double> phases;
+};
+
+typedef std::map<std::string,std::vector<bench_point>> bench_results;
+
+static double run_backend(std::string backend, std::map<std::string,double> &phases)
+{
+	stats::reset();
+	uint64_t start = trace::now();
+
+	project proj;
+	proj.read("bench.sushi");
+	if (backend == "xcode") {
+		XcodeprojPtr xcodeproj = Xcodeproj::createProject(proj.root);
+		xcodeproj->write(proj.root);
+	} else if (backend == "xcworkspace") {
+		XcworkspacePtr workspace = Xcworkspace::createWorkspace(proj.root);
+		workspace->write(proj.root);
+	} else if (backend == "vs") {
+		VSSolutionPtr solution = VSSolution::createSolution(proj.root);
+		solution->write(proj.root);
+	} else if (backend == "ninja") {
+		NinjaPtr ninja = Ninja::createBuild(proj.root);
+		ninja->write(proj.root);
+	}
+
+	double total = (trace::now() - start) / 1000.0;
+	for (const stats_phase &phase : stats::phases) {
+		phases[phase.name] = phase.dur / 1000.0;
+	}
+	return total;
+}
+
+static bench_point measure(bench_tree &tree, int size, std::string backend)
+{
+	bench_point point;
+	point.size = size;
+	point.targets = tree.libs.size() + tree.tools.size();
+	point.files = tree.file_count;
+	point.total = -1;
+
+	char cwd[4096];
+	if (!getcwd(cwd, sizeof(cwd))) {
+		log_fatal_exit("getcwd: %s", strerror(errno));
+	}
+	if (chdir(tree.dir.c_str()) < 0) {
+		log_fatal_exit("chdir: %s: %s", tree.dir.c_str(), strerror(errno));
+	}
+	for (int r = 0; r < runs; r++) {
+		std::map<std::string,double> phases;
+		double total = run_backend(backend, phases);
+		if (point.total < 0 || total < point.total) {
+			point.total = total;
+			point.phases = phases;
+		}
+	}
+	if (chdir(cwd) < 0) {
+		log_fatal_exit("chdir: %s: %s", cwd, strerror(errno));
+	}
+	return point;
+}
+
+/*
+ * least squares slope of log(ms) against log(files). 1.0 is linear,
+ * 2.0 is quadratic. Phases that stay under a tenth of a millisecond
+ * are dominated by timer noise and are not fitted.
+ */
+
+static bool fit_slope(std::vector<bench_point> &points, std::string phase, double &slope)
+{
+	std::vector<double> xs, ys;
+	for (auto &point : points) {
+		double ms = phase == "total" ? point.total : point.phases[phase];
+		if (ms < 0.1) continue;
+		xs.push_back(log((double)point.files));
+		ys.push_back(log(ms));
+	}
+	if (xs.size() < 2) return false;
+	double n = xs.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+	for (size_t i = 0; i < xs.size(); i++) {
+		sx += xs[i];
+		sy += ys[i];
+		sxx += xs[i] * xs[i];
+		sxy += xs[i] * ys[i];
+	}
+	double denom = n * sxx - sx * sx;
+	if (denom == 0) return false;
+	slope = (n * sxy - sx * sy) / denom;
+	return true;
+}
+
+static void write_json(std::ostream &out, bench_results &results)
+{
+	out << "{\n";
+	out << format_string("  \"shape\": {\"libs\": %d, \"tools\": %d, \"files\": %d, "
+		"\"fanout\": %d, \"depth\": %d, \"dir_depth\": %d},\n",
+		shape.libs, shape.tools, shape.files, shape.fanout, shape.depth, shape.dir_depth);
+	out << format_string("  \"runs\": %d,\n", runs);
+	out << format_string("  \"threshold\": %.2f,\n", threshold);
+	out << "  \"backends\": {";
+	bool first_backend = true;
+	for (std::string backend : backends) {
+		std::vector<bench_point> &points = results[backend];
+		std::vector<std::string> phase_names = { "total" };
+		for (auto &point : points) {
+			for (auto &ent : point.phases) {
+				if (std::find(phase_names.begin(), phase_names.end(), ent.first) == phase_names.end()) {
+					phase_names.push_back(ent.first);
+				}
+			}
+		}
+
+		out << (first_backend ? "\n" : ",\n");
+		first_backend = false;
+		out << "    \"" << backend << "\": {\n";
+		out << "      \"points\": [";
+		for (size_t i = 0; i < points.size(); i++) {
+			bench_point &point = points[i];
+			out << (i == 0 ? "\n" : ",\n");
+			out << format_string("        {\"size\": %d, \"targets\": %zu, \"files\": %zu, \"total_ms\": %.3f, \"phases_ms\": {",
+				point.size, point.targets, point.files, point.total);
+			bool first_phase = true;
+			for (auto &ent : point.phases) {
+				out << format_string("%s\"%s\": %.3f", first_phase ? "" : ", ", ent.first.c_str(), ent.second);
+				first_phase = false;
+			}
+			out << "}}";
+		}
+		out << "\n      ],\n";
+
+		std::vector<std::string> superlinear;
+		out << "      \"slopes\": {";
+		bool first_slope = true;
+		for (std::string phase : phase_names) {
+			double slope;
+			if (!fit_slope(points, phase, slope)) continue;
+			out << format_string("%s\"%s\": %.3f", first_slope ? "" : ", ", phase.c_str(), slope);
+			first_slope = false;
+			if (slope > threshold) {
+				superlinear.push_back(phase);
+				log_info("%s: %s scales super-linearly (slope %.2f)", backend.c_str(), phase.c_str(), slope);
+			}
+		}
+		out << "},\n";
+		out << "      \"superlinear\": [";
+		for (size_t i = 0; i < superlinear.size(); i++) {
+			out << (i == 0 ? "" : ", ") << "\"" << superlinear[i] << "\"";
+		}
+		out << "]\n";
+		out << "    }";
+	}
+	out << "\n  }\n";
+	out << "}\n";
+}
+
+
+/* main */
+
+int main(int argc, char **argv)
+{
+	parse_options(argc, argv);
+	stats::enable();
+
+	bench_results results;
+	for (int size : sizes) {
+		bench_tree tree = generate_tree(size);
+		log_info("size %d: %zu targets, %zu files", size,
+			tree.libs.size() + tree.tools.size(), tree.file_count);
+		for (std::string backend : backends) {
+			results[backend].push_back(measure(tree, size, backend));
+		}
+	}
+
+	if (out_file.size() > 0) {
+		std::ofstream out(out_file.c_str());
+		if (!out) {
+			log_fatal_exit("error opening: %s: %s", out_file.c_str(), strerror(errno));
+		}
+		write_json(out, results);
+	} else {
+		write_json(std::cout, results);
+	}
+}
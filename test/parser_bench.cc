@@ -0,0 +1,362 @@
+//
+//  parser_bench.cc
+//
+
+#ifdef _WIN32
+#include <direct.h>
+#define chdir _chdir
+#define getcwd _getcwd
+#else
+#include <unistd.h>
+#endif
+
+#include "sushi.h"
+#include "bench_util.h"
+
+
+/* options */
+
+static std::vector<int> sizes = { 1, 4, 16, 64 };
+static std::vector<std::string> extra_files;
+static std::string bench_dir = "parser_bench";
+static std::string out_file;
+static int files_per_lib = 16;
+static int runs = 5;
+
+static void print_usage(char **argv)
+{
+	fprintf(stderr, "usage: %s [options] [project.pbxproj|solution.sln ...]\n", argv[0]);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  --sizes=<n,...>       generated corpus sizes in multiples of 8 libs (default 1,4,16,64)\n");
+	fprintf(stderr, "  --files=<n>           source files per lib (default %d)\n", files_per_lib);
+	fprintf(stderr, "  --runs=<n>            runs per measurement, the fastest is kept (default %d)\n", runs);
+	fprintf(stderr, "  --dir=<path>          directory for the generated corpus (default %s)\n", bench_dir.c_str());
+	fprintf(stderr, "  --out=<file.json>     write results to file instead of stdout\n");
+	exit(1);
+}
+
+static void parse_options(int argc, char **argv)
+{
+	std::string value;
+	for (int i = 1; i < argc; i++) {
+		if (match_option(argv[i], "--sizes", value)) {
+			sizes.clear();
+			for (std::string size : util::split(value, ",", false)) {
+				sizes.push_back(std::max(1, atoi(size.c_str())));
+			}
+		} else if (match_option(argv[i], "--files", value)) {
+			files_per_lib = std::max(1, atoi(value.c_str()));
+		} else if (match_option(argv[i], "--runs", value)) {
+			runs = std::max(1, atoi(value.c_str()));
+		} else if (match_option(argv[i], "--dir", value)) {
+			bench_dir = value;
+		} else if (match_option(argv[i], "--out", value)) {
+			out_file = value;
+		} else if (strncmp(argv[i], "--", 2) == 0) {
+			print_usage(argv);
+		} else {
+			extra_files.push_back(argv[i]);
+		}
+	}
+}
+
+
+/* corpus */
+
+/*
+ * The corpus is produced by the real generators from a synthetic source
+ * tree so the pbxproj, sln and vcxproj files have the same shape as the
+ * output of maki. The libs form a binary tree rooted at the tool.
+ */
+
+struct corpus_entry
+{
+	std::string label;
+	std::string kind;
+	std::string path;
+
+	corpus_entry(std::string label, std::string kind, std::string path)
+		: label(label), kind(kind), path(path) {}
+};
+
+static void generate_corpus(std::vector<corpus_entry> &corpus, int size)
+{
+	std::string dir = format_string("%s/size_%d", bench_dir.c_str(), size);
+	int nlibs = size * 8;
+
+	std::stringstream ss;
+	ss << "project bench {\n\n";
+	ss << "\tconfig * {\n";
+	ss << "\t\tset x_apple_sdkroot macosx;\n";
+	ss << "\t\tset x_apple_target 10.10;\n";
+	ss << "\t\tset x_ms_platform_toolset v120;\n";
+	ss << "\t\tset x_ms_platform_version 8.1;\n";
+	ss << "\t}\n\n";
+	ss << "\tconfig Debug {\n\t\tdefines DEBUG;\n\t\tset optimization 0;\n\t}\n\n";
+	ss << "\tconfig Release {\n\t\tdefines NDEBUG;\n\t\tset optimization 3;\n\t}\n\n";
+	ss << "\tlib * {\n\t\ttype static;\n\t}\n\n";
+	for (int i = 0; i < nlibs; i++) {
+		for (int f = 0; f < files_per_lib; f++) {
+			std::string base = format_string("%s/libs/lib%d/lib%d_%d", dir.c_str(), i, i, f);
+			write_tree_file(base + ".h", "\n");
+			write_tree_file(base + ".cc", "\n");
+		}
+		ss << "\tlib lib" << i << " {\n";
+		ss << "\t\tsource libs/lib" << i << "/*.(cc|h);\n";
+		ss << "\t\texport_includes libs/lib" << i << ";\n";
+		if (i * 2 + 1 < nlibs) {
+			ss << "\t\tlibs lib" << (i * 2 + 1);
+			if (i * 2 + 2 < nlibs) ss << " lib" << (i * 2 + 2);
+			ss << ";\n";
+		}
+		ss << "\t}\n\n";
+	}
+	ss << "\ttool bench {\n\t\tsource main.cc;\n\t\tlibs lib0;\n\t}\n\n";
+	ss << "}\n";
+	write_tree_file(dir + "/main.cc", "\n");
+	write_tree_file(dir + "/bench.sushi", ss.str());
+
+	char cwd[4096];
+	if (!getcwd(cwd, sizeof(cwd))) {
+		log_fatal_exit("getcwd: %s", strerror(errno));
+	}
+	if (chdir(dir.c_str()) < 0) {
+		log_fatal_exit("chdir: %s: %s", dir.c_str(), strerror(errno));
+	}
+	project proj;
+	proj.read("bench.sushi");
+	Xcodeproj::createProject(proj.root)->write(proj.root);
+	VSSolution::createSolution(proj.root)->write(proj.root);
+	if (chdir(cwd) < 0) {
+		log_fatal_exit("chdir: %s: %s", cwd, strerror(errno));
+	}
+
+	std::string label = format_string("size_%d", size);
+	corpus.push_back(corpus_entry(label, "pbxproj", dir + "/bench.xcodeproj/project.pbxproj"));
+	corpus.push_back(corpus_entry(label, "sln", dir + "/bench.vsproj/bench.sln"));
+}
+
+
+/* measurements */
+
+struct bench_result
+{
+	std::string label;
+	std::string op;
+	size_t bytes;
+	double ms;
+	uint64_t allocs;
+	uint64_t alloc_bytes;
+	int roundtrip;
+
+	bench_result(std::string label, std::string op)
+		: label(label), op(op), bytes(0), ms(-1), allocs(0), alloc_bytes(0), roundtrip(-1) {}
+
+	double mb_per_sec() { return ms > 0 ? bytes / (ms * 1000.0) : 0; }
+};
+
+static std::vector<bench_result> results;
+
+static void measure(bench_result &result, std::function<void()> fn)
+{
+	for (int r = 0; r < runs; r++) {
+		stats_counters start = stats::counters();
+		uint64_t t0 = trace::now();
+		fn();
+		double ms = (trace::now() - t0) / 1000.0;
+		stats_counters end = stats::counters();
+		if (result.ms < 0 || ms < result.ms) {
+			result.ms = ms;
+			result.allocs = end.allocs - start.allocs;
+			result.alloc_bytes = end.bytes - start.bytes;
+		}
+	}
+}
+
+static void report(bench_result &result)
+{
+	log_info("%-12s %-14s %10zu bytes %9.3f ms %8.2f MB/s %10llu allocs%s",
+		result.label.c_str(), result.op.c_str(), result.bytes, result.ms, result.mb_per_sec(),
+		(unsigned long long)result.allocs,
+		result.roundtrip < 0 ? "" : result.roundtrip ? "  roundtrip ok" : "  ROUNDTRIP MISMATCH");
+	results.push_back(result);
+}
+
+static std::string roundtrip_path(std::string path)
+{
+	std::replace(path.begin(), path.end(), '/', '_');
+	std::replace(path.begin(), path.end(), '\\', '_');
+	return bench_dir + "/roundtrip/" + path;
+}
+
+static bool same_contents(std::string path, std::vector<char> &expected)
+{
+	std::vector<char> actual = util::read_file(path);
+	return actual == expected;
+}
+
+static void bench_pbxproj(corpus_entry &entry)
+{
+	std::vector<char> buf = util::read_file(entry.path);
+
+	bench_result read(entry.label, "pbxproj read");
+	read.bytes = buf.size();
+	measure(read, [&]() {
+		PBXParserImpl pbx;
+		if (pbx.parse(buf) != PBXParseErrorNone) {
+			log_fatal_exit("error parsing project: %s", entry.path.c_str());
+		}
+	});
+	report(read);
+
+	PBXParserImpl pbx;
+	pbx.parse(buf);
+	std::string output;
+	bench_result write(entry.label, "pbxproj write");
+	write.bytes = buf.size();
+	measure(write, [&]() {
+		std::stringstream ss;
+		PBXWriter::write(pbx.xcodeproj, ss, 0);
+		ss << '\n';
+		output = ss.str();
+	});
+	write.roundtrip = output.size() == buf.size() && memcmp(output.data(), buf.data(), buf.size()) == 0;
+	if (!write.roundtrip) {
+		log_error("%s: pbxproj round trip differs", entry.path.c_str());
+	}
+	report(write);
+}
+
+static void bench_sln(corpus_entry &entry)
+{
+	std::vector<char> buf = util::read_file(entry.path);
+
+	bench_result read(entry.label, "sln read");
+	read.bytes = buf.size();
+	measure(read, [&]() {
+		VSSolution sol;
+		if (!sol.parse(buf.data(), buf.size())) {
+			log_fatal_exit("VSSolution: parse error: %s", entry.path.c_str());
+		}
+	});
+	report(read);
+
+	VSSolution sol;
+	sol.read(entry.path);
+	std::string sln_rt = roundtrip_path(entry.path);
+	util::make_directories(sln_rt);
+	bench_result write(entry.label, "sln write");
+	write.bytes = buf.size();
+	measure(write, [&]() { sol.write_solution(sln_rt); });
+	write.roundtrip = same_contents(sln_rt, buf);
+	if (!write.roundtrip) {
+		log_error("%s: sln round trip differs", entry.path.c_str());
+	}
+	report(write);
+
+	std::vector<std::string> project_files;
+	std::vector<std::vector<char>> project_bufs;
+	bench_result project_read(entry.label, "vcxproj read");
+	for (auto project : sol.projects) {
+		project_files.push_back(util::path_relative_to_path(project->path, entry.path));
+		project_bufs.push_back(util::read_file(project_files.back()));
+		project_read.bytes += project_bufs.back().size();
+	}
+	measure(project_read, [&]() {
+		for (std::string project_file : project_files) {
+			VSProject project;
+			project.read(project_file);
+		}
+	});
+	report(project_read);
+
+	bench_result project_load(entry.label, "vcxproj load");
+	project_load.bytes = project_read.bytes;
+	measure(project_load, [&]() {
+		VSSolution lazy_sol;
+		lazy_sol.lazy = true;
+		lazy_sol.read(entry.path);
+		lazy_sol.loadProjects();
+	});
+	report(project_load);
+
+	bench_result project_write(entry.label, "vcxproj write");
+	project_write.bytes = project_read.bytes;
+	measure(project_write, [&]() {
+		for (size_t i = 0; i < sol.projects.size(); i++) {
+			sol.projects[i]->getProject()->write(roundtrip_path(project_files[i]));
+		}
+	});
+	project_write.roundtrip = 1;
+	for (size_t i = 0; i < project_files.size(); i++) {
+		if (!same_contents(roundtrip_path(project_files[i]), project_bufs[i])) {
+			log_error("%s: vcxproj round trip differs", project_files[i].c_str());
+			project_write.roundtrip = 0;
+		}
+	}
+	report(project_write);
+}
+
+static void write_json(std::ostream &out)
+{
+	out << "{\n";
+	out << format_string("  \"runs\": %d,\n", runs);
+	out << "  \"results\": [";
+	for (size_t i = 0; i < results.size(); i++) {
+		bench_result &result = results[i];
+		out << (i == 0 ? "\n" : ",\n");
+		out << format_string("    {\"corpus\": \"%s\", \"op\": \"%s\", \"bytes\": %zu, \"ms\": %.3f, "
+			"\"mb_per_sec\": %.2f, \"allocs\": %llu, \"alloc_bytes\": %llu",
+			result.label.c_str(), result.op.c_str(), result.bytes, result.ms, result.mb_per_sec(),
+			(unsigned long long)result.allocs, (unsigned long long)result.alloc_bytes);
+		if (result.roundtrip >= 0) {
+			out << ", \"roundtrip\": " << (result.roundtrip ? "true" : "false");
+		}
+		out << "}";
+	}
+	out << "\n  ]\n";
+	out << "}\n";
+}
+
+
+/* main */
+
+int main(int argc, char **argv)
+{
+	parse_options(argc, argv);
+
+	std::vector<corpus_entry> corpus;
+	for (int size : sizes) {
+		generate_corpus(corpus, size);
+	}
+	for (std::string file : extra_files) {
+		std::string ext = file.substr(file.find_last_of('.') + 1);
+		if (ext != "pbxproj" && ext != "sln") {
+			log_fatal_exit("unknown corpus file type: %s", file.c_str());
+		}
+		corpus.push_back(corpus_entry(file, ext, file));
+	}
+
+	stats::enable();
+	for (corpus_entry &entry : corpus) {
+		if (entry.kind == "pbxproj") {
+			bench_pbxproj(entry);
+		} else {
+			bench_sln(entry);
+		}
+	}
+
+	if (out_file.size() > 0) {
+		std::ofstream out(out_file.c_str());
+		if (!out) {
+			log_fatal_exit("error opening: %s: %s", out_file.c_str(), strerror(errno));
+		}
+		write_json(out);
+	} else {
+		write_json(std::cout);
+	}
+
+	for (bench_result &result : results) {
+		if (result.roundtrip == 0) exit(1);
+	}
+}
@@ -4,16 +4,129 @@
 
 #include "sushi.h"
 
+/* token counting parser */
+
+struct PBXTokenCounter : PBXParser
+{
+	size_t tokens;
+
+	PBXTokenCounter() : tokens(0) {}
+
+	void begin_object() { tokens++; }
+	void end_object() { tokens++; }
+	void object_comment(const char *value, size_t length) { tokens++; }
+	void object_attr(const char *value, size_t length) { tokens++; }
+	void object_attr_comment(const char *value, size_t length) { tokens++; }
+	void object_value_literal(const char *value, size_t length) { tokens++; }
+	void object_value_comment(const char *value, size_t length) { tokens++; }
+	void begin_array() { tokens++; }
+	void end_array() { tokens++; }
+	void array_value_literal(const char *value, size_t length) { tokens++; }
+	void array_value_comment(const char *value, size_t length) { tokens++; }
+};
+
+/* benchmark */
+
+static const int bench_runs = 10;
+
+template <typename T>
+static void bench_parser(const char *name, mapped_file_ptr mf, bool use_simd)
+{
+	PBXParser::use_simd = use_simd;
+	uint64_t best = 0;
+	for (int r = 0; r < bench_runs; r++) {
+		T parser;
+		uint64_t start = trace::now();
+		PBXParseError error = parser.parse(mf->data, mf->size);
+		uint64_t dur = trace::now() - start;
+		if (error != PBXParseErrorNone) {
+			log_fatal_exit("error parsing project: %d", error);
+		}
+		if (r == 0 || dur < best) best = dur;
+	}
+	double ms = best / 1000.0;
+	printf("%-10s %-7s %10.3f ms %10.2f MB/s\n", name, use_simd ? "simd" : "scalar",
+		ms, ms > 0 ? mf->size / (ms * 1000.0) : 0);
+}
+
+/* lazy read of the project and its targets */
+
+static void bench_lazy(const char *file, size_t size, bool lazy)
+{
+	uint64_t best = 0;
+	size_t targets = 0;
+	for (int r = 0; r < bench_runs; r++) {
+		PBXParserImpl parser;
+		parser.lazy = lazy;
+		uint64_t start = trace::now();
+		PBXParseError error = parser.read(file);
+		if (error != PBXParseErrorNone) {
+			log_fatal_exit("error parsing project: %d", error);
+		}
+		auto xcodeproj = parser.xcodeproj;
+		auto project = xcodeproj->getProject();
+		targets = 0;
+		for (auto &val : project->targets->array_val) {
+			auto target = xcodeproj->getObject<PBXNativeTarget>(static_cast<PBXId&>(*val));
+			if (target && xcodeproj->getObject<XCConfigurationList>(target->buildConfigurationList)) {
+				targets++;
+			}
+		}
+		uint64_t dur = trace::now() - start;
+		if (r == 0 || dur < best) best = dur;
+	}
+	double ms = best / 1000.0;
+	printf("%-10s %-7s %10.3f ms %10.2f MB/s (%zu targets)\n", "targets", lazy ? "lazy" : "eager",
+		ms, ms > 0 ? size / (ms * 1000.0) : 0, targets);
+}
+
+/* allocations per object for an eager parse */
+
+static void bench_memory(mapped_file_ptr mf)
+{
+	stats::enable();
+	stats_counters start = stats::counters();
+	auto parser = std::make_shared<PBXParserImpl>();
+	PBXParseError error = parser->parse(mf->data, mf->size);
+	if (error != PBXParseErrorNone) {
+		log_fatal_exit("error parsing project: %d", error);
+	}
+	stats_counters end = stats::counters();
+	size_t objects = parser->xcodeproj->objects->size();
+	size_t rss = stats::peak_rss();
+	parser.reset();
+	size_t n = objects > 0 ? objects : 1;
+	printf("%-10s %zu objects, %.1f allocs/object, %.1f bytes/object, %.1f MB peak RSS\n", "memory",
+		objects, (double)(end.allocs - start.allocs) / n, (double)(end.bytes - start.bytes) / n,
+		rss / 1048576.0);
+}
+
 /* main */
 
 int main(int argc, char **argv) {
-	if (argc != 2) {
-		fprintf(stderr, "usage: %s <xcodeproj>\n", argv[0]);
+	bool bench = argc == 3 && strcmp(argv[1], "--bench") == 0;
+	bool lazy = argc == 3 && strcmp(argv[1], "--lazy") == 0;
+	if (argc != 2 && !bench && !lazy) {
+		fprintf(stderr, "usage: %s [--bench|--lazy] <xcodeproj>\n", argv[0]);
 		exit(1);
 	}
+
+	if (bench) {
+		mapped_file_ptr mf = util::map_file(argv[2]);
+		printf("%s: %zu bytes, best of %d runs\n", argv[2], mf->size, bench_runs);
+		bench_memory(mf);
+		bench_parser<PBXTokenCounter>("tokenize", mf, false);
+		bench_parser<PBXTokenCounter>("tokenize", mf, true);
+		bench_parser<PBXParserImpl>("parse", mf, false);
+		bench_parser<PBXParserImpl>("parse", mf, true);
+		bench_lazy(argv[2], mf->size, false);
+		bench_lazy(argv[2], mf->size, true);
+		return 0;
+	}
+
 	PBXParserImpl pbx;
-	std::vector<char> buf = util::read_file(argv[1]);
-	PBXParseError error = pbx.parse(buf);
+	pbx.lazy = lazy;
+	PBXParseError error = pbx.read(argv[argc - 1]);
 	if (error != PBXParseErrorNone) {
 		log_fatal_exit("error parsing project: %d", error);
 	}
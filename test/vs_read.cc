@@ -21,6 +21,6 @@ int main(int argc, char **argv) {
 	for (auto project : sol.projects) {
 		std::string new_project_file_path = util::path_relative_to_path(project->path, solution_file) + ".new";
 		std::cout << "writing " << new_project_file_path << std::endl;
-		project->project->write(new_project_file_path);
+		project->getProject()->write(new_project_file_path);
 	}
 }